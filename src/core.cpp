@@ -0,0 +1,318 @@
+#include "core.hpp"
+#include "debugfile.hpp"
+#include "elf.hpp"
+#include "parallel.hpp"
+
+#include <fmt/format.h>
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+
+Analysis::Analysis(const std::string& libraryPath, const AnalysisOptions& options, Stats *stats)
+    : m_input{timePhase(stats, "open", [&] { return InputFile(libraryPath, options.input); })}, m_options{options}, m_stats{stats}, m_formatter{m_out.functionTable}
+{
+    auto program = m_input.data();
+    auto size = m_input.size();
+
+    // A stripped library has its symbols in a separate debug file. That one is mapped lazily whatever the strategy,
+    // only its symbol and string tables are read, and debug info if a placeholder needs it.
+    if (ElfImage elfImage(program, size); elfImage.error().empty() && !elfImage.findSection(".symtab", SHT_SYMTAB))
+    {
+        timePhase(stats, "debug file", [&]
+        {
+            auto debugPath = findDebugFile(libraryPath, elfImage, options.debugDirectories, m_warnings);
+            if (!debugPath)
+            {
+                m_warnings.push_back(fmt::format("'{}' has no symbol table and no debug file was found for it", libraryPath));
+                return;
+            }
+
+            InputOptions debugOptions;
+            debugOptions.strategy = options.input.strategy == IoStrategy::WillNeed ? IoStrategy::WillNeed : IoStrategy::Mmap;
+            debugOptions.keepPageCache = options.input.keepPageCache;
+
+            try
+            {
+                m_debugInput.emplace(debugPath->string(), debugOptions);
+                m_debugFilePath = debugPath;
+            }
+            catch (const std::exception& e)
+            {
+                m_warnings.push_back(fmt::format("debug file {} is ignored - {}", debugPath->string(), e.what()));
+            }
+        });
+    }
+
+    if (options.input.strategy == IoStrategy::WillNeed)
+    {
+        timePhase(stats, "prefetch", [&]
+        {
+            for (auto input : {&m_input, m_debugInput ? &*m_debugInput : nullptr})
+            {
+                if (!input)
+                {
+                    continue;
+                }
+
+                ElfImage elfImage(input->data(), input->size());
+                for (const auto& section : elfImage.sections())
+                {
+                    if (std::ranges::find(READER_SECTION_NAMES, section.name) != READER_SECTION_NAMES.end())
+                    {
+                        input->prefetch(section.offset, section.size);
+                    }
+                }
+            }
+        });
+    }
+
+    auto readerOptions = options.reader;
+    if (options.releaseTables)
+    {
+        m_input.advise(MADV_SEQUENTIAL);
+        readerOptions.skipUnusedSymbols = !options.keepSymbols;
+    }
+
+    std::span<char> debugImage;
+    if (m_debugInput)
+    {
+        debugImage = {m_debugInput->data(), m_debugInput->size()};
+    }
+
+    m_programInfo = timePhase(stats, "process", [&] { return process(program, size, readerOptions, debugImage); });
+
+    std::ranges::move(m_programInfo.warnings, std::back_inserter(m_warnings));
+    m_programInfo.warnings.clear();
+
+    // The warnings usually explain the failure, like a missing debug file.
+    if (!m_programInfo.error.empty())
+    {
+        auto message = fmt::format("Failed to process input file '{}': {}", libraryPath, m_programInfo.error);
+        for (const auto& warning : m_warnings)
+        {
+            message += fmt::format("\n{}", warning);
+        }
+
+        throw std::runtime_error(message);
+    }
+}
+
+bool Analysis::ensureParsed(const std::function<void(const ClassInfo&)>& onClass)
+{
+    if (m_options.streamClasses)
+    {
+        return false;
+    }
+
+    auto parsed = false;
+    std::call_once(m_parsed, [&]
+    {
+        prepareParse();
+
+        ScopedPhase phase(m_stats, "parse");
+
+        std::size_t slots = 0;
+        for (const auto& classInfo : streamClasses())
+        {
+            for (const auto& vtable : classInfo.vtables)
+            {
+                slots += vtable.functionIds.size();
+            }
+
+            if (onClass)
+            {
+                onClass(classInfo);
+            }
+        }
+
+        phase.setSlots(slots);
+        parsed = true;
+    });
+
+    return parsed;
+}
+
+void Analysis::prepareParse()
+{
+    // The two largest sections, decoded side by side.
+    timePhase(m_stats, "decode", [this]
+    {
+        std::vector<std::function<void()>> tasks;
+        tasks.emplace_back([this] { m_programInfo.symbols.get(); });
+        tasks.emplace_back([this] { m_programInfo.relocations.get(); });
+        runConcurrently(tasks, m_options.reader.jobs);
+    });
+
+    if (m_options.symbolCache)
+    {
+        timePhase(m_stats, "imports", [this] { m_options.symbolCache->resolveImports(m_programInfo); });
+    }
+}
+
+void Analysis::releaseTables()
+{
+    if (m_options.releaseTables)
+    {
+        // parse() copied everything it needs except symbol names, and those are faulted back in from the file on access.
+        m_programInfo.relocations.release();
+        m_programInfo.rodataChunks = {};
+        m_programInfo.relRodataChunks = {};
+        if (!m_options.keepSymbols)
+        {
+            m_programInfo.symbols.release();
+        }
+
+        m_input.advise(MADV_DONTNEED);
+        if (m_debugInput)
+        {
+            m_debugInput->advise(MADV_DONTNEED);
+        }
+    }
+}
+
+Generator<const ClassInfo&> Analysis::streamClasses()
+{
+    // ensureParsed() prepared already, outside of its parse phase.
+    if (m_options.streamClasses)
+    {
+        prepareParse();
+    }
+
+    for (const auto& classInfo : parseClasses(m_programInfo, m_out))
+    {
+        m_classesByName.emplace(classInfo.name, &classInfo);
+        co_yield classInfo;
+    }
+
+    releaseTables();
+}
+
+const ClassInfo *Analysis::findClass(std::string_view name)
+{
+    ensureParsed();
+
+    auto it = m_classesByName.find(name);
+    return it != m_classesByName.end() ? it->second : nullptr;
+}
+
+std::span<const Out2> Analysis::vtable(const ClassInfo& classInfo)
+{
+    ensureParsed();
+
+    std::scoped_lock lock(m_mutex);
+
+    auto it = m_vtables.find(&classInfo);
+    if (it == m_vtables.end())
+    {
+        it = m_vtables.emplace(&classInfo, m_formatter.format(classInfo)).first;
+    }
+
+    return it->second;
+}
+
+const Offsets& Analysis::offsets()
+{
+    ensureParsed();
+
+    std::scoped_lock lock(m_mutex);
+
+    if (!m_offsets)
+    {
+        m_offsets = prepareOffsets(m_out, nullptr, m_options.reader.jobs);
+    }
+
+    return *m_offsets;
+}
+
+std::optional<int> Analysis::resolvePlaceholder(std::string_view placeholder)
+{
+    auto entryTypeEndPos = placeholder.find('.');
+    if (entryTypeEndPos == std::string_view::npos)
+    {
+        throw std::runtime_error(fmt::format("incorrect format of placeholder {} (missing \'.\' separator)", placeholder));
+    }
+
+    auto entryType = placeholder.substr(0, entryTypeEndPos);
+    placeholder.remove_prefix(entryTypeEndPos + 1);
+
+    std::string error;
+    std::optional<int> offset;
+    if (entryType == "VTableMethod")
+    {
+        offset = getVTableMethodOffset(offsets(), placeholder, &error);
+    }
+    else if (entryType == "VTableField")
+    {
+        offset = getVTableFieldOffset(m_programInfo.memberOffsets.get(), placeholder, &error);
+    }
+    else
+    {
+        error = fmt::format("unknown entryType {}", entryType);
+    }
+
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+
+    return offset;
+}
+
+int Analysis::writeGamedata(const std::vector<std::filesystem::path>& inputFilePaths, const std::vector<std::filesystem::path>& outputDirectoryPaths, const WriterOptions& options)
+{
+    if (inputFilePaths.empty() || outputDirectoryPaths.empty())
+    {
+        return EXIT_SUCCESS;
+    }
+
+    TemplateReader templates(inputFilePaths);
+    return writeGamedata(templates, outputDirectoryPaths, options);
+}
+
+int Analysis::writeGamedata(TemplateReader& templates, const std::vector<std::filesystem::path>& outputDirectoryPaths, const WriterOptions& options)
+{
+    const Offsets *cachedOffsets = nullptr;
+    {
+        std::scoped_lock lock(m_mutex);
+        if (m_offsets)
+        {
+            cachedOffsets = &*m_offsets;
+        }
+    }
+
+    if (cachedOffsets)
+    {
+        return writeGamedataFile(*cachedOffsets, m_programInfo.memberOffsets, templates, outputDirectoryPaths, options);
+    }
+
+    // Called on the writer's format thread, which formats each file while the rest of the library is parsed. The parse
+    // phases nest in the caller's one. Classes parsed before, by another query or streamClasses(), are replayed.
+    auto classes = [this, parent = m_stats ? m_stats->currentPhase() : Stats::NONE](const std::function<void(const ClassInfo&)>& onClass)
+    {
+        PhaseContext context(m_stats, parent);
+        if (ensureParsed(onClass))
+        {
+            return;
+        }
+
+        for (const auto& classInfo : m_out.classes)
+        {
+            onClass(classInfo);
+        }
+    };
+
+    return writeGamedataFile(classes, m_out.functionTable, m_programInfo.memberOffsets, templates, outputDirectoryPaths, options);
+}
+
+void Analysis::close()
+{
+    m_input.close();
+    if (m_debugInput)
+    {
+        m_debugInput->close();
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "formatter.hpp"
+#include "input.hpp"
+#include "parser.hpp"
+#include "reader.hpp"
+#include "stats.hpp"
+#include "symbolcache.hpp"
+#include "writer.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct AnalysisOptions
+{
+    InputOptions input;
+    ReaderOptions reader;
+    bool releaseTables{false}; // Drop what parse() no longer needs, and the library pages, once it's done
+    bool keepSymbols{true}; // Keep ProgramInfo::symbols around with releaseTables
+    bool streamClasses{false}; // Leave parsing to streamClasses()
+    SymbolCache *symbolCache{}; // Resolves vtable functions imported from other libraries, has to outlive the analysis
+    std::vector<std::filesystem::path> debugDirectories{"/usr/lib/debug"}; // Searched for the debug file of a stripped library
+};
+
+// A library loaded once, then queried any number of times. It is parsed the first time a query needs classes, and
+// ProgramInfo sections are decoded on first access, so queries that don't need them never pay for them.
+// Everything returned points into the analysis and stays valid as long as it does, symbol names until close(), which
+// has to come after the last query. The query functions can be called from several threads.
+class Analysis
+{
+public:
+    // Throws std::runtime_error if the library can't be read or isn't a supported ELF file.
+    explicit Analysis(const std::string& libraryPath, const AnalysisOptions& options = {}, Stats *stats = nullptr);
+
+    Analysis(const Analysis&) = delete;
+    Analysis& operator=(const Analysis&) = delete;
+
+    const ProgramInfo& programInfo() const { return m_programInfo; }
+
+    // Problems that didn't stop the analysis, like a debug file that can't be used, for the caller to report.
+    const std::vector<std::string>& warnings() const { return m_warnings; }
+    const std::list<ClassInfo>& classes() { ensureParsed(); return m_out.classes; }
+    const std::list<FunctionInfo>& functions() { ensureParsed(); return m_out.functions; }
+    const FunctionTable& functionTable() { ensureParsed(); return m_out.functionTable; }
+    const ClassHierarchy& hierarchy() { ensureParsed(); return m_out.hierarchy; }
+    const MemberOffsetIndex& memberOffsets() const { return m_programInfo.memberOffsets.get(); }
+
+    // The separate debug file symbols were read from, for a stripped library.
+    const std::optional<std::filesystem::path>& debugFilePath() const { return m_debugFilePath; }
+
+    // Parses the library, yielding every class as soon as its vtables are read, see parseClasses(). Only with
+    // AnalysisOptions::streamClasses, and it has to run to the end before anything but functionTable() is called.
+    Generator<const ClassInfo&> streamClasses();
+
+    // The first class with that name, like the writer picks.
+    const ClassInfo *findClass(std::string_view name);
+
+    // Formatted primary vtable, computed on first use.
+    std::span<const Out2> vtable(const ClassInfo& classInfo);
+
+    // Offsets of every class, computed on first use with the reader's job count.
+    const Offsets& offsets();
+
+    // A gamedata placeholder without the '#'s, e.g. "VTableMethod.CBasePlayer::CBaseEntity::Touch(CBaseEntity*).linux".
+    // Nothing for a function without an index on that platform or an unknown field. Throws std::runtime_error if the
+    // placeholder is malformed or its class, namespace or function isn't there.
+    std::optional<int> resolvePlaceholder(std::string_view placeholder);
+
+    int writeGamedata(const std::vector<std::filesystem::path>& inputFilePaths, const std::vector<std::filesystem::path>& outputDirectoryPaths, const WriterOptions& options = {});
+
+    // Same, with the input files read by a reader created earlier. Formats only the classes the files refer to, unless
+    // offsets() was computed already, and if no query parsed the library before, formats them while it is parsed.
+    int writeGamedata(TemplateReader& templates, const std::vector<std::filesystem::path>& outputDirectoryPaths, const WriterOptions& options = {});
+
+    // Releases the library image.
+    void close();
+
+private:
+    // Parses the library unless that is left to streamClasses() or done already, calling `onClass` with each class as
+    // soon as it is parsed. Returns whether this call parsed it.
+    bool ensureParsed(const std::function<void(const ClassInfo&)>& onClass = {});
+
+    // Decodes what parse() reads and resolves imported functions.
+    void prepareParse();
+
+    // With AnalysisOptions::releaseTables, drops what parse() no longer needs.
+    void releaseTables();
+
+    InputFile m_input;
+    std::optional<InputFile> m_debugInput; // Of a stripped library
+    std::optional<std::filesystem::path> m_debugFilePath;
+    std::vector<std::string> m_warnings;
+    ProgramInfo m_programInfo;
+    Out m_out;
+    std::unordered_map<std::string_view, const ClassInfo*> m_classesByName;
+    AnalysisOptions m_options;
+    Stats *m_stats;
+    std::once_flag m_parsed;
+
+    std::mutex m_mutex;
+    VTableFormatter m_formatter;
+    std::unordered_map<const ClassInfo*, std::vector<Out2>> m_vtables;
+    std::optional<Offsets> m_offsets;
+};
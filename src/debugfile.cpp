@@ -0,0 +1,129 @@
+#include "debugfile.hpp"
+#include "input.hpp"
+#include "trace.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+// CRC-32 (IEEE 802.3, reflected) as used by .gnu_debuglink.
+static uint32_t crc32(std::ifstream& file)
+{
+    static const auto table = []
+    {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < table.size(); ++i)
+        {
+            auto crc = i;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc & 1) ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+            }
+            table[i] = crc;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xffffffff;
+    std::vector<char> buffer(1 << 20);
+    while (file)
+    {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        for (std::streamsize i = 0; i < file.gcount(); ++i)
+        {
+            crc = table[(crc ^ static_cast<unsigned char>(buffer[i])) & 0xff] ^ (crc >> 8);
+        }
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+static bool hasBuildId(const std::filesystem::path& path, std::span<const unsigned char> buildId, std::vector<std::string>& warnings)
+{
+    try
+    {
+        InputOptions options;
+        options.keepPageCache = true;
+
+        InputFile input(path.string(), options);
+        ElfImage elfImage(input.data(), input.size());
+        return elfImage.error().empty() && std::ranges::equal(readBuildId(elfImage), buildId);
+    }
+    catch (const std::exception& e)
+    {
+        warnings.push_back(fmt::format("debug file {} is ignored - {}", path.string(), e.what()));
+        return false;
+    }
+}
+
+static bool hasCrc(const std::filesystem::path& path, uint32_t crc, std::vector<std::string>& warnings)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+
+    if (crc32(file) != crc)
+    {
+        warnings.push_back(fmt::format("debug file {} is ignored - its CRC doesn't match the debug link", path.string()));
+        return false;
+    }
+
+    return true;
+}
+
+std::optional<std::filesystem::path> findDebugFile(const std::filesystem::path& libraryPath, const ElfImage& elfImage, const std::vector<std::filesystem::path>& debugDirectories, std::vector<std::string>& warnings)
+{
+    TRACE_SCOPE("find debug file");
+
+    std::error_code error;
+
+    auto buildId = readBuildId(elfImage);
+    if (buildId.size() >= 2)
+    {
+        std::string hex;
+        for (auto byte : buildId)
+        {
+            hex += fmt::format("{:02x}", byte);
+        }
+
+        for (const auto& directory : debugDirectories)
+        {
+            auto path = directory / ".build-id" / hex.substr(0, 2) / (hex.substr(2) + ".debug");
+            if (std::filesystem::is_regular_file(path, error) && hasBuildId(path, buildId, warnings))
+            {
+                return path;
+            }
+        }
+    }
+
+    auto debugLink = readDebugLink(elfImage);
+    if (!debugLink)
+    {
+        return std::nullopt;
+    }
+
+    auto libraryDirectory = std::filesystem::absolute(libraryPath, error).parent_path();
+
+    std::vector<std::filesystem::path> candidates{libraryDirectory / debugLink->fileName, libraryDirectory / ".debug" / debugLink->fileName};
+    for (const auto& directory : debugDirectories)
+    {
+        candidates.push_back(directory / libraryDirectory.relative_path() / debugLink->fileName);
+    }
+
+    for (const auto& path : candidates)
+    {
+        // A library can link to a debug file of its own name, in another directory.
+        if (std::filesystem::is_regular_file(path, error) && !std::filesystem::equivalent(path, libraryPath, error) && hasCrc(path, debugLink->crc, warnings))
+        {
+            return path;
+        }
+    }
+
+    return std::nullopt;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "elf.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+// The separate debug file of a stripped library, looked up like gdb does:
+//   <dir>/.build-id/xx/yyyy.debug for the NT_GNU_BUILD_ID note, in each debug directory
+//   then the .gnu_debuglink name next to the library, in its .debug directory and under <dir>/<library directory>
+// A build id candidate has to carry the same build id, a debug link one the CRC32 the link was written with.
+// Nothing if the library has neither or no candidate matches. Candidates that can't be used are added to `warnings`.
+std::optional<std::filesystem::path> findDebugFile(const std::filesystem::path& libraryPath, const ElfImage& elfImage, const std::vector<std::filesystem::path>& debugDirectories, std::vector<std::string>& warnings);
@@ -0,0 +1,1147 @@
+#include "demangler.hpp"
+
+#include <cxxabi.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+constexpr std::pair<std::string_view, std::string_view> OPERATORS[] =
+{
+    {"aN", "&="}, {"aS", "="}, {"aa", "&&"}, {"ad", "&"}, {"an", "&"}, {"cl", "()"}, {"cm", ","}, {"co", "~"},
+    {"dV", "/="}, {"da", "delete[]"}, {"de", "*"}, {"dl", "delete"}, {"dv", "/"}, {"eO", "^="}, {"eo", "^"},
+    {"eq", "=="}, {"ge", ">="}, {"gt", ">"}, {"ix", "[]"}, {"lS", "<<="}, {"le", "<="}, {"ls", "<<"}, {"lt", "<"},
+    {"mI", "-="}, {"mL", "*="}, {"mi", "-"}, {"ml", "*"}, {"mm", "--"}, {"na", "new[]"}, {"ne", "!="}, {"ng", "-"},
+    {"nt", "!"}, {"nw", "new"}, {"oR", "|="}, {"oo", "||"}, {"or", "|"}, {"pL", "+="}, {"pl", "+"}, {"pm", "->*"},
+    {"pp", "++"}, {"ps", "+"}, {"pt", "->"}, {"qu", "?"}, {"rM", "%="}, {"rS", ">>="}, {"rm", "%"}, {"rs", ">>"},
+    {"ss", "<=>"},
+};
+
+// The text __cxa_demangle() puts before the entity of a special name, by the two characters after "_ZT".
+constexpr std::pair<char, std::string_view> SPECIAL_NAMES[] =
+{
+    {'V', "vtable for "},
+    {'I', "typeinfo for "},
+    {'S', "typeinfo name for "},
+    {'T', "VTT for "},
+    {'h', "non-virtual thunk to "},
+    {'v', "virtual thunk to "},
+    {'c', "covariant return thunk to "},
+};
+
+constexpr std::string_view specialNamePrefix(char kind)
+{
+    for (const auto& [name, prefix] : SPECIAL_NAMES)
+    {
+        if (name == kind)
+        {
+            return prefix;
+        }
+    }
+
+    return {};
+}
+
+constexpr std::string_view builtinType(char code)
+{
+    switch (code)
+    {
+    case 'v': return "void";
+    case 'w': return "wchar_t";
+    case 'b': return "bool";
+    case 'c': return "char";
+    case 'a': return "signed char";
+    case 'h': return "unsigned char";
+    case 's': return "short";
+    case 't': return "unsigned short";
+    case 'i': return "int";
+    case 'j': return "unsigned int";
+    case 'l': return "long";
+    case 'm': return "unsigned long";
+    case 'x': return "long long";
+    case 'y': return "unsigned long long";
+    case 'n': return "__int128";
+    case 'o': return "unsigned __int128";
+    case 'f': return "float";
+    case 'd': return "double";
+    case 'e': return "long double";
+    case 'g': return "__float128";
+    case 'z': return "...";
+    default: return {};
+    }
+}
+
+constexpr bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool isUpper(char c)
+{
+    return c >= 'A' && c <= 'Z';
+}
+
+constexpr bool isLower(char c)
+{
+    return c >= 'a' && c <= 'z';
+}
+
+}
+
+// Recursive descent over the mangled name. Every production appends its text to `scratch`, and the text of a
+// substitution candidate is always one contiguous range of it. A production returns false for anything outside the
+// supported subset, the caller then falls back to __cxa_demangle().
+struct Demangler::Parser
+{
+    struct Range
+    {
+        std::size_t pos;
+        std::size_t size;
+    };
+
+    enum class Kind
+    {
+        Plain,
+        Function, // Not printable on its own
+        FunctionPointer, // Printable, but can't take more modifiers
+    };
+
+    struct Substitution
+    {
+        Range range;
+        Kind kind;
+        std::size_t lastComponent; // Offset of the last name component in the range, 0 if unqualified
+    };
+
+    // Positions in `scratch`, the scope ones equal `lastComponent` for an unqualified name.
+    struct Name
+    {
+        Range range{};
+        std::size_t scopeComponent{}; // Last component of the scope, the class of a member function
+        std::size_t scopeEnd{}; // The "::" before the last component
+        std::size_t lastComponent{};
+        bool isTemplate{false};
+        bool isCtorDtor{false};
+        bool isConst{false};
+    };
+
+    // Name a constructor or destructor is printed with: the last source name, or the one a std abbreviation stands for.
+    struct LastName
+    {
+        Range range{};
+        std::string_view literal;
+        bool valid{false};
+    };
+
+    std::string_view input;
+    std::size_t pos{};
+
+    std::string scratch;
+    std::string text;
+    std::size_t entityOffset{};
+
+    // Parts of the entity, in `text`. Empty for what isn't a function or variable.
+    Range nameSpace{};
+    Range className{};
+    Range shortName{};
+    Range parameters{};
+
+    std::vector<Substitution> substitutions;
+    std::size_t substitutionComponent{}; // Substitution::lastComponent of the last one appended
+    LastName lastName;
+
+    char peek(std::size_t offset = 0) const
+    {
+        return pos + offset < input.size() ? input[pos + offset] : '\0';
+    }
+
+    bool consume(char c)
+    {
+        if (peek() != c)
+        {
+            return false;
+        }
+
+        pos++;
+        return true;
+    }
+
+    std::size_t mark() const
+    {
+        return scratch.size();
+    }
+
+    Range since(std::size_t start) const
+    {
+        return {start, scratch.size() - start};
+    }
+
+    std::string_view view(Range range) const
+    {
+        return std::string_view(scratch).substr(range.pos, range.size);
+    }
+
+    void append(std::string_view s)
+    {
+        scratch += s;
+    }
+
+    void appendRange(Range range)
+    {
+        scratch.append(scratch, range.pos, range.size);
+    }
+
+    void addSubstitution(Range range, Kind kind = Kind::Plain, std::size_t lastComponent = 0)
+    {
+        substitutions.push_back({range, kind, lastComponent});
+    }
+
+    bool parseNumber(std::size_t &value)
+    {
+        if (!isDigit(peek()))
+        {
+            return false;
+        }
+
+        value = 0;
+        while (isDigit(peek()))
+        {
+            if (value > UINT32_MAX)
+            {
+                return false;
+            }
+
+            value = value * 10 + static_cast<std::size_t>(input[pos++] - '0');
+        }
+
+        return true;
+    }
+
+    // [n] <number>
+    bool parseOffset()
+    {
+        consume('n');
+
+        std::size_t value;
+        return parseNumber(value);
+    }
+
+    // h <nv-offset> _ | v <v-offset> _
+    bool parseCallOffset(char kind)
+    {
+        if (kind == 'h')
+        {
+            return parseOffset() && consume('_');
+        }
+
+        return parseOffset() && consume('_') && parseOffset() && consume('_');
+    }
+
+    bool parseSourceName()
+    {
+        std::size_t length;
+        if (!parseNumber(length) || length == 0 || length > input.size() - pos)
+        {
+            return false;
+        }
+
+        auto identifier = input.substr(pos, length);
+        pos += length;
+
+        auto start = mark();
+        if (identifier.size() >= 10 && identifier.starts_with("_GLOBAL_") && (identifier[8] == '.' || identifier[8] == '_' || identifier[8] == '$') && identifier[9] == 'N')
+        {
+            append("(anonymous namespace)");
+        }
+        else
+        {
+            append(identifier);
+        }
+
+        lastName = {since(start), {}, true};
+        return true;
+    }
+
+    bool parseOperatorName()
+    {
+        auto code = input.substr(pos, 2);
+        for (const auto& [operatorCode, operatorName] : OPERATORS)
+        {
+            if (operatorCode == code)
+            {
+                pos += 2;
+                append("operator");
+                if (isLower(operatorName.front()))
+                {
+                    append(" ");
+                }
+                append(operatorName);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool parseCtorDtorName(bool &isCtorDtor)
+    {
+        auto kind = peek();
+        auto variant = peek(1);
+        if (kind == 'C' ? (variant < '1' || variant > '5') : (variant != '0' && variant != '1' && variant != '2' && variant != '4' && variant != '5'))
+        {
+            return false;
+        }
+
+        if (!lastName.valid)
+        {
+            return false;
+        }
+
+        pos += 2;
+
+        if (kind == 'D')
+        {
+            append("~");
+        }
+
+        if (lastName.literal.empty())
+        {
+            appendRange(lastName.range);
+        }
+        else
+        {
+            append(lastName.literal);
+        }
+
+        isCtorDtor = true;
+        return true;
+    }
+
+    bool parseUnqualifiedName(bool &isCtorDtor)
+    {
+        isCtorDtor = false;
+
+        auto c = peek();
+        auto parsed = false;
+        if (isDigit(c))
+        {
+            parsed = parseSourceName();
+        }
+        else if (c == 'C' || c == 'D')
+        {
+            parsed = parseCtorDtorName(isCtorDtor);
+        }
+        else if (isLower(c))
+        {
+            // Not in the table: cv (conversion), li (literal) and v (vendor) operators
+            parsed = parseOperatorName();
+        }
+
+        if (!parsed)
+        {
+            return false;
+        }
+
+        // ABI tags don't change the name constructors are printed with.
+        auto savedLastName = lastName;
+        while (consume('B'))
+        {
+            append("[abi:");
+            if (!parseSourceName())
+            {
+                return false;
+            }
+            append("]");
+        }
+        lastName = savedLastName;
+
+        return true;
+    }
+
+    // S_, S <seq-id> _ and the std abbreviations. `prefix` is set for the first component of a nested name.
+    bool parseSubstitution(bool prefix, Kind &kind)
+    {
+        pos++; // S
+        kind = Kind::Plain;
+
+        auto c = peek();
+        if (c == '_' || isDigit(c) || isUpper(c))
+        {
+            std::size_t index = 0;
+            if (!consume('_'))
+            {
+                while (isDigit(peek()) || isUpper(peek()))
+                {
+                    auto digit = input[pos++];
+                    index = index * 36 + static_cast<std::size_t>(isDigit(digit) ? digit - '0' : digit - 'A' + 10);
+                    if (index > input.size())
+                    {
+                        return false;
+                    }
+                }
+
+                if (!consume('_'))
+                {
+                    return false;
+                }
+
+                index++;
+            }
+
+            if (index >= substitutions.size())
+            {
+                return false;
+            }
+
+            kind = substitutions[index].kind;
+            substitutionComponent = substitutions[index].lastComponent;
+            appendRange(substitutions[index].range);
+            return true;
+        }
+
+        std::string_view expansion;
+        std::string_view name;
+        switch (c)
+        {
+        case 't': expansion = "std"; break;
+        case 'a': expansion = "std::allocator"; name = "allocator"; break;
+        case 'b': expansion = "std::basic_string"; name = "basic_string"; break;
+        case 's': expansion = "std::string"; name = "basic_string"; break;
+        case 'i': expansion = "std::istream"; name = "basic_istream"; break;
+        case 'o': expansion = "std::ostream"; name = "basic_ostream"; break;
+        case 'd': expansion = "std::iostream"; name = "basic_iostream"; break;
+        default: return false;
+        }
+
+        pos++;
+
+        // A constructor or destructor of std::string and the streams prints the full template name instead.
+        if (prefix && (c == 's' || c == 'i' || c == 'o' || c == 'd') && (peek() == 'C' || peek() == 'D'))
+        {
+            return false;
+        }
+
+        if (!name.empty())
+        {
+            lastName = {{}, name, true};
+        }
+
+        substitutionComponent = c == 't' ? 0 : std::string_view("std::").size();
+        append(expansion);
+        return true;
+    }
+
+    // L <builtin type> [n] <number> E, for the integer types printed without a cast.
+    bool parseLiteral()
+    {
+        pos++; // L
+
+        auto type = peek();
+        pos++;
+
+        auto negative = consume('n');
+
+        auto start = pos;
+        while (isDigit(peek()))
+        {
+            pos++;
+        }
+        auto value = input.substr(start, pos - start);
+
+        if (value.empty() || !consume('E'))
+        {
+            return false;
+        }
+
+        std::string_view suffix;
+        switch (type)
+        {
+        case 'b':
+            if (negative || (value != "0" && value != "1"))
+            {
+                return false;
+            }
+            append(value == "1" ? "true" : "false");
+            return true;
+        case 'i': break;
+        case 'j': suffix = "u"; break;
+        case 'l': suffix = "l"; break;
+        case 'm': suffix = "ul"; break;
+        case 'x': suffix = "ll"; break;
+        case 'y': suffix = "ull"; break;
+        default: return false;
+        }
+
+        if (negative)
+        {
+            append("-");
+        }
+        append(value);
+        append(suffix);
+        return true;
+    }
+
+    bool parseTemplateArgs()
+    {
+        pos++; // I
+
+        if (!scratch.empty() && scratch.back() == '<')
+        {
+            append(" ");
+        }
+        append("<");
+
+        // Names inside the arguments don't change the name constructors are printed with.
+        auto savedLastName = lastName;
+
+        auto first = true;
+        while (!consume('E'))
+        {
+            if (!first)
+            {
+                append(", ");
+            }
+            first = false;
+
+            auto c = peek();
+            if (c == 'L')
+            {
+                if (peek(1) == '_' || !parseLiteral())
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            Kind kind;
+            if (c == 'X' || c == 'J' || !parseType(kind) || kind == Kind::Function)
+            {
+                return false;
+            }
+        }
+
+        if (scratch.back() == '>')
+        {
+            append(" ");
+        }
+        append(">");
+
+        lastName = savedLastName;
+        return true;
+    }
+
+    // N [K] <prefix> <unqualified-name> E, every prefix but the whole name is a substitution candidate.
+    bool parseNestedName(Name &name)
+    {
+        pos++; // N
+
+        name.isConst = consume('K');
+        if (peek() == 'r' || peek() == 'V' || peek() == 'K' || peek() == 'R' || peek() == 'O')
+        {
+            return false;
+        }
+
+        auto start = mark();
+        auto first = true;
+        name.scopeComponent = name.scopeEnd = name.lastComponent = start;
+        while (true)
+        {
+            auto c = peek();
+            if (c == 'S' && first)
+            {
+                Kind kind;
+                if (!parseSubstitution(true, kind) || kind != Kind::Plain || peek() == 'E')
+                {
+                    return false;
+                }
+
+                first = false;
+                name.lastComponent = start + substitutionComponent;
+                name.isTemplate = false;
+                name.isCtorDtor = false;
+                continue;
+            }
+
+            if (c == 'I' && !first)
+            {
+                if (!parseTemplateArgs())
+                {
+                    return false;
+                }
+                name.isTemplate = true;
+            }
+            else
+            {
+                if (!first)
+                {
+                    name.scopeComponent = name.lastComponent;
+                    name.scopeEnd = mark();
+                    append("::");
+                    name.lastComponent = mark();
+                }
+                if (!parseUnqualifiedName(name.isCtorDtor))
+                {
+                    return false;
+                }
+                name.isTemplate = false;
+            }
+
+            first = false;
+
+            if (consume('E'))
+            {
+                break;
+            }
+
+            addSubstitution(since(start), Kind::Plain, name.lastComponent - start);
+        }
+
+        name.range = since(start);
+        return true;
+    }
+
+    // <nested-name>, <unscoped-name> or <unscoped-template-name> <template-args>. A `substitutable` name is a type and
+    // becomes a substitution candidate itself, unless it is just a std abbreviation.
+    bool parseName(Name &name, bool substitutable)
+    {
+        auto start = mark();
+        auto isSubstitution = false;
+        name.scopeComponent = name.scopeEnd = name.lastComponent = start;
+
+        auto c = peek();
+        if (c == 'N')
+        {
+            if (!parseNestedName(name))
+            {
+                return false;
+            }
+        }
+        else if (c == 'S')
+        {
+            if (peek(1) == 't')
+            {
+                pos += 2;
+                append("std");
+                name.scopeEnd = mark();
+                append("::");
+                name.lastComponent = mark();
+                if (!parseUnqualifiedName(name.isCtorDtor))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                Kind kind;
+                if (!parseSubstitution(false, kind) || kind != Kind::Plain)
+                {
+                    return false;
+                }
+                isSubstitution = true;
+                name.lastComponent = start + substitutionComponent;
+                if (substitutionComponent != 0)
+                {
+                    name.scopeEnd = name.lastComponent - 2;
+                }
+            }
+        }
+        else if (!parseUnqualifiedName(name.isCtorDtor))
+        {
+            return false;
+        }
+
+        if (c != 'N' && peek() == 'I')
+        {
+            if (!isSubstitution)
+            {
+                addSubstitution(since(start), Kind::Plain, name.lastComponent - start);
+            }
+
+            if (!parseTemplateArgs())
+            {
+                return false;
+            }
+
+            isSubstitution = false;
+            name.isTemplate = true;
+        }
+
+        name.range = since(start);
+
+        if (substitutable && !isSubstitution)
+        {
+            addSubstitution(name.range, Kind::Plain, name.lastComponent - start);
+        }
+
+        return true;
+    }
+
+    // F <return type> <parameter types> E, printed as a pointer or reference to it.
+    bool parseFunctionPointer(std::size_t start, std::string_view modifier, Kind &kind)
+    {
+        pos++; // F
+
+        Kind returnKind;
+        if (peek() == 'Y' || !parseType(returnKind) || returnKind != Kind::Plain)
+        {
+            return false;
+        }
+
+        append(" (");
+        append(modifier);
+        append(")");
+
+        if (!parseParameters('E') || !consume('E'))
+        {
+            return false;
+        }
+
+        addSubstitution({}, Kind::Function);
+        addSubstitution(since(start), Kind::FunctionPointer);
+        kind = Kind::FunctionPointer;
+        return true;
+    }
+
+    bool parseType(Kind &kind)
+    {
+        kind = Kind::Plain;
+
+        auto start = mark();
+        auto c = peek();
+
+        auto builtin = builtinType(c);
+        if (!builtin.empty())
+        {
+            pos++;
+            append(builtin);
+            return true;
+        }
+
+        switch (c)
+        {
+        case 'D':
+        {
+            switch (peek(1))
+            {
+            case 'n': builtin = "decltype(nullptr)"; break;
+            case 'i': builtin = "char32_t"; break;
+            case 's': builtin = "char16_t"; break;
+            case 'u': builtin = "char8_t"; break;
+            default: return false;
+            }
+
+            pos += 2;
+            append(builtin);
+            return true;
+        }
+
+        case 'K':
+        {
+            pos++;
+
+            Kind innerKind;
+            if (peek() == 'r' || peek() == 'V' || peek() == 'K' || !parseType(innerKind) || innerKind != Kind::Plain)
+            {
+                return false;
+            }
+
+            append(" const");
+            addSubstitution(since(start));
+            return true;
+        }
+
+        case 'P':
+        case 'R':
+        case 'O':
+        {
+            pos++;
+
+            auto modifier = c == 'P' ? "*" : c == 'R' ? "&" : "&&";
+            if (peek() == 'F')
+            {
+                return parseFunctionPointer(start, modifier, kind);
+            }
+
+            Kind innerKind;
+            if (!parseType(innerKind) || innerKind != Kind::Plain)
+            {
+                return false;
+            }
+
+            append(modifier);
+            addSubstitution(since(start));
+            return true;
+        }
+
+        case 'S':
+        {
+            auto next = peek(1);
+            if (next == '_' || isDigit(next) || isUpper(next))
+            {
+                if (!parseSubstitution(false, kind))
+                {
+                    return false;
+                }
+
+                if (peek() == 'I')
+                {
+                    auto lastComponent = substitutionComponent;
+                    if (kind != Kind::Plain || !parseTemplateArgs())
+                    {
+                        return false;
+                    }
+
+                    addSubstitution(since(start), Kind::Plain, lastComponent);
+                }
+
+                return true;
+            }
+
+            Name name;
+            return parseName(name, true);
+        }
+
+        case 'N':
+        {
+            Name name;
+            return parseName(name, true) && !name.isConst;
+        }
+
+        default:
+        {
+            if (!isDigit(c))
+            {
+                return false;
+            }
+
+            Name name;
+            return parseName(name, true);
+        }
+        }
+    }
+
+    // Parameter types up to `end`, with a lone void printed as "()".
+    bool parseParameters(char end)
+    {
+        append("(");
+
+        if (peek() == 'v' && peek(1) == end)
+        {
+            pos++;
+            append(")");
+            return true;
+        }
+
+        auto first = true;
+        while (peek() != end)
+        {
+            if (!first)
+            {
+                append(", ");
+            }
+            first = false;
+
+            Kind kind;
+            if (!parseType(kind) || kind == Kind::Function)
+            {
+                return false;
+            }
+        }
+
+        append(")");
+        return true;
+    }
+
+    // The parts of `name`, which is appended to `text` at `offset`.
+    void setEntityParts(const Name &name, std::size_t offset, Range parameterList)
+    {
+        auto toText = [&](std::size_t scratchPos) { return offset + scratchPos - name.range.pos; };
+
+        nameSpace = {toText(name.range.pos), name.scopeEnd - name.range.pos};
+        className = {toText(name.scopeComponent), name.scopeEnd - name.scopeComponent};
+        shortName = {toText(name.lastComponent), name.range.pos + name.range.size - name.lastComponent};
+        parameters = parameterList;
+    }
+
+    // <name> [<return type>] <parameter types>, or a data <name>. Appends to `text`.
+    bool parseEncoding()
+    {
+        Name name;
+        if (!parseName(name, false))
+        {
+            return false;
+        }
+
+        if (peek() == '\0')
+        {
+            setEntityParts(name, text.size(), {});
+            text += view(name.range);
+            return !name.isConst;
+        }
+
+        // Only function templates mangle their return type.
+        std::optional<Range> returnType;
+        if (name.isTemplate && !name.isCtorDtor)
+        {
+            auto start = mark();
+
+            Kind kind;
+            if (!parseType(kind) || kind != Kind::Plain)
+            {
+                return false;
+            }
+
+            returnType = since(start);
+        }
+
+        auto parametersStart = mark();
+        if (!parseParameters('\0'))
+        {
+            return false;
+        }
+
+        if (returnType)
+        {
+            text += view(*returnType);
+            text += ' ';
+        }
+
+        auto parameterList = since(parametersStart);
+        setEntityParts(name, text.size(), {text.size() + name.range.size, parameterList.size});
+        text += view(name.range);
+        text += view(parameterList);
+
+        if (name.isConst)
+        {
+            text += " const";
+        }
+
+        return true;
+    }
+
+    bool parse(std::string_view symbol)
+    {
+        input = symbol;
+        pos = 0;
+        scratch.clear();
+        text.clear();
+        entityOffset = 0;
+        nameSpace = className = shortName = parameters = {};
+        substitutions.clear();
+        lastName = {};
+
+        if (!symbol.starts_with("_Z"))
+        {
+            return false;
+        }
+
+        pos = 2;
+
+        if (peek() == 'T')
+        {
+            auto kind = peek(1);
+            auto prefix = specialNamePrefix(kind);
+            if (prefix.empty())
+            {
+                return false;
+            }
+
+            pos += 2;
+            text = prefix;
+            entityOffset = prefix.size();
+
+            switch (kind)
+            {
+            case 'h':
+            case 'v':
+                if (!parseCallOffset(kind) || !parseEncoding())
+                {
+                    return false;
+                }
+                break;
+
+            case 'c':
+            {
+                for (auto i = 0; i < 2; i++)
+                {
+                    auto callOffsetKind = peek();
+                    pos++;
+                    if ((callOffsetKind != 'h' && callOffsetKind != 'v') || !parseCallOffset(callOffsetKind))
+                    {
+                        return false;
+                    }
+                }
+
+                if (!parseEncoding())
+                {
+                    return false;
+                }
+                break;
+            }
+
+            default:
+            {
+                Kind typeKind;
+                auto start = mark();
+                if (!parseType(typeKind) || typeKind == Kind::Function)
+                {
+                    return false;
+                }
+
+                text += view(since(start));
+                break;
+            }
+            }
+        }
+        else if (!parseEncoding())
+        {
+            return false;
+        }
+
+        // Clone suffixes like ".constprop.0" and anything unparsed go to the fallback.
+        return pos == input.size();
+    }
+};
+
+// The parts of an entity __cxa_demangle() printed, for the symbols the parser gives up on. Brackets are matched so that
+// a "::" or "(" in template arguments or parameter types doesn't end the scope, and an operator name is taken whole.
+static DemangledSymbol splitEntity(std::string_view text, std::string_view entity)
+{
+    constexpr std::string_view ANONYMOUS_NAMESPACE = "(anonymous namespace)";
+
+    std::size_t depth = 0;
+    std::size_t scopeStart = 0;
+    std::size_t scopeComponent = 0;
+    std::size_t scopeEnd = 0;
+    std::size_t lastComponent = 0;
+    std::size_t parametersStart = entity.size();
+    for (std::size_t index = 0; index < entity.size(); ++index)
+    {
+        auto rest = entity.substr(index);
+        auto c = entity[index];
+        if (depth == 0 && rest.starts_with(ANONYMOUS_NAMESPACE))
+        {
+            index += ANONYMOUS_NAMESPACE.size() - 1;
+        }
+        else if (depth == 0 && index == lastComponent && rest.starts_with("operator"))
+        {
+            // Up to the parameters, "operator()" has its own parentheses.
+            parametersStart = std::min(entity.find('(', index + (rest.starts_with("operator()") ? 10 : 8)), entity.size());
+            break;
+        }
+        else if (depth == 0 && c == '(')
+        {
+            parametersStart = index;
+            break;
+        }
+        else if (c == '<' || c == '(' || c == '[' || c == '{')
+        {
+            depth++;
+        }
+        else if ((c == '>' || c == ')' || c == ']' || c == '}') && depth > 0)
+        {
+            depth--;
+        }
+        else if (depth == 0 && rest.starts_with("::"))
+        {
+            scopeComponent = lastComponent;
+            scopeEnd = index;
+            lastComponent = index + 2;
+            index++;
+        }
+        else if (depth == 0 && c == ' ')
+        {
+            // What came before is the return type of a function template.
+            scopeStart = scopeComponent = scopeEnd = lastComponent = index + 1;
+        }
+    }
+
+    auto parametersEnd = parametersStart;
+    for (depth = 0; parametersEnd < entity.size(); )
+    {
+        auto c = entity[parametersEnd++];
+        if (c == '(')
+        {
+            depth++;
+        }
+        else if (c == ')' && --depth == 0)
+        {
+            break;
+        }
+    }
+
+    return {
+        text,
+        entity,
+        entity.substr(scopeStart, scopeEnd - scopeStart),
+        entity.substr(scopeComponent, scopeEnd - scopeComponent),
+        entity.substr(lastComponent, parametersStart - lastComponent),
+        entity.substr(parametersStart, parametersEnd - parametersStart),
+        entity.substr(lastComponent),
+    };
+}
+
+Demangler::Demangler() : m_parser{std::make_unique<Parser>()}
+{
+
+}
+
+Demangler::~Demangler()
+{
+    std::free(m_fallbackBuffer);
+}
+
+DemangledSymbol Demangler::demangle(const char *symbol)
+{
+    std::string_view name(symbol);
+
+    auto& text = m_parser->text;
+
+    if (m_parser->parse(name))
+    {
+        std::string_view result(text);
+        auto part = [&](Parser::Range range) { return result.substr(range.pos, range.size); };
+
+        return {
+            result,
+            result.substr(m_parser->entityOffset),
+            part(m_parser->nameSpace),
+            part(m_parser->className),
+            part(m_parser->shortName),
+            part(m_parser->parameters),
+            result.substr(m_parser->shortName.pos),
+        };
+    }
+
+    m_fallbackCount++;
+
+    // __cxa_demangle() reallocs the buffer when it is too small.
+    int status = -4;
+    auto buffer = abi::__cxa_demangle(symbol, m_fallbackBuffer, &m_fallbackBufferSize, &status);
+    if (status != 0 || !buffer)
+    {
+        return splitEntity(name, name);
+    }
+
+    m_fallbackBuffer = buffer;
+    text = buffer;
+
+    std::string_view result(text);
+    if (name.starts_with("_ZT") && name.size() > 3)
+    {
+        auto prefix = specialNamePrefix(name[3]);
+        if (!prefix.empty() && result.starts_with(prefix))
+        {
+            return splitEntity(result, result.substr(prefix.size()));
+        }
+    }
+
+    return splitEntity(result, result);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+struct DemangledSymbol
+{
+    std::string_view text; // non-virtual thunk to CNEO_Player::EndTouch(CBaseEntity*)
+    std::string_view entity; // CNEO_Player::EndTouch(CBaseEntity*), without the "vtable for "/"... thunk to " part
+
+    // Parts of the entity of a function or variable, empty for other symbols.
+    std::string_view nameSpace; // ns::CNEO_Player, everything the name is qualified with
+    std::string_view className; // CNEO_Player, the last component of nameSpace
+    std::string_view shortName; // EndTouch
+    std::string_view parameters; // (CBaseEntity*)
+    std::string_view name; // EndTouch(CBaseEntity*) const, from the short name to the end
+};
+
+// Itanium demangler for the symbols vtables are made of: functions, vtables, typeinfo and thunks, with class templates,
+// std abbreviations, function pointers and ABI tags. Anything else goes to abi::__cxa_demangle(), and the text matches
+// what it returns in both cases. Parsing writes into buffers kept between calls, so most calls don't allocate.
+class Demangler
+{
+public:
+    Demangler();
+    ~Demangler();
+
+    Demangler(const Demangler&) = delete;
+    Demangler& operator=(const Demangler&) = delete;
+
+    // The result stays valid until the next call. A symbol that can't be demangled is returned as is.
+    DemangledSymbol demangle(const char *symbol);
+
+    // Symbols that went to abi::__cxa_demangle().
+    std::size_t fallbackCount() const { return m_fallbackCount; }
+
+private:
+    struct Parser;
+
+    std::unique_ptr<Parser> m_parser;
+    char *m_fallbackBuffer{};
+    std::size_t m_fallbackBufferSize{};
+    std::size_t m_fallbackCount{};
+};
@@ -0,0 +1,46 @@
+#include "depfile.hpp"
+#include "output.hpp"
+
+#include <string>
+
+// Spaces and '#' are escaped with a backslash and '$' doubled, which both Make and Ninja undo.
+static void appendEscaped(std::string& out, const std::filesystem::path& path)
+{
+    for (auto c : path.string())
+    {
+        if (c == ' ' || c == '#')
+        {
+            out += '\\';
+        }
+        else if (c == '$')
+        {
+            out += '$';
+        }
+        out += c;
+    }
+}
+
+void writeDepfile(const std::filesystem::path& path, const std::vector<std::filesystem::path>& targets, const std::vector<std::filesystem::path>& dependencies)
+{
+    std::string contents;
+    for (const auto& target : targets)
+    {
+        if (!contents.empty())
+        {
+            contents += ' ';
+        }
+        appendEscaped(contents, target);
+    }
+
+    contents += ':';
+
+    for (const auto& dependency : dependencies)
+    {
+        contents += " \\\n  ";
+        appendEscaped(contents, dependency);
+    }
+
+    contents += '\n';
+
+    writeOutputFile(path, contents);
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+// Writes a Make rule "targets: dependencies" that Make and Ninja read back as a depfile, so the build reruns the tool
+// only when one of the files it read changed. Throws std::runtime_error on failure.
+void writeDepfile(const std::filesystem::path& path, const std::vector<std::filesystem::path>& targets, const std::vector<std::filesystem::path>& dependencies);
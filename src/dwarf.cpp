@@ -0,0 +1,1455 @@
+#include "dwarf.hpp"
+#include "trace.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+// The few DWARF 5 constants read here.
+constexpr uint64_t DW_TAG_class_type = 0x02;
+constexpr uint64_t DW_TAG_member = 0x0d;
+constexpr uint64_t DW_TAG_structure_type = 0x13;
+constexpr uint64_t DW_TAG_typedef = 0x16;
+constexpr uint64_t DW_TAG_union_type = 0x17;
+constexpr uint64_t DW_TAG_inheritance = 0x1c;
+constexpr uint64_t DW_TAG_const_type = 0x26;
+constexpr uint64_t DW_TAG_volatile_type = 0x35;
+constexpr uint64_t DW_TAG_namespace = 0x39;
+
+constexpr uint64_t DW_AT_sibling = 0x01;
+constexpr uint64_t DW_AT_name = 0x03;
+constexpr uint64_t DW_AT_data_member_location = 0x38;
+constexpr uint64_t DW_AT_declaration = 0x3c;
+constexpr uint64_t DW_AT_external = 0x3f;
+constexpr uint64_t DW_AT_type = 0x49;
+constexpr uint64_t DW_AT_data_bit_offset = 0x6b;
+constexpr uint64_t DW_AT_str_offsets_base = 0x72;
+
+constexpr uint64_t DW_FORM_addr = 0x01;
+constexpr uint64_t DW_FORM_block2 = 0x03;
+constexpr uint64_t DW_FORM_block4 = 0x04;
+constexpr uint64_t DW_FORM_data2 = 0x05;
+constexpr uint64_t DW_FORM_data4 = 0x06;
+constexpr uint64_t DW_FORM_data8 = 0x07;
+constexpr uint64_t DW_FORM_string = 0x08;
+constexpr uint64_t DW_FORM_block = 0x09;
+constexpr uint64_t DW_FORM_block1 = 0x0a;
+constexpr uint64_t DW_FORM_data1 = 0x0b;
+constexpr uint64_t DW_FORM_flag = 0x0c;
+constexpr uint64_t DW_FORM_sdata = 0x0d;
+constexpr uint64_t DW_FORM_strp = 0x0e;
+constexpr uint64_t DW_FORM_udata = 0x0f;
+constexpr uint64_t DW_FORM_ref_addr = 0x10;
+constexpr uint64_t DW_FORM_ref1 = 0x11;
+constexpr uint64_t DW_FORM_ref2 = 0x12;
+constexpr uint64_t DW_FORM_ref4 = 0x13;
+constexpr uint64_t DW_FORM_ref8 = 0x14;
+constexpr uint64_t DW_FORM_ref_udata = 0x15;
+constexpr uint64_t DW_FORM_indirect = 0x16;
+constexpr uint64_t DW_FORM_sec_offset = 0x17;
+constexpr uint64_t DW_FORM_exprloc = 0x18;
+constexpr uint64_t DW_FORM_flag_present = 0x19;
+constexpr uint64_t DW_FORM_strx = 0x1a;
+constexpr uint64_t DW_FORM_addrx = 0x1b;
+constexpr uint64_t DW_FORM_ref_sup4 = 0x1c;
+constexpr uint64_t DW_FORM_strp_sup = 0x1d;
+constexpr uint64_t DW_FORM_data16 = 0x1e;
+constexpr uint64_t DW_FORM_line_strp = 0x1f;
+constexpr uint64_t DW_FORM_ref_sig8 = 0x20;
+constexpr uint64_t DW_FORM_implicit_const = 0x21;
+constexpr uint64_t DW_FORM_loclistx = 0x22;
+constexpr uint64_t DW_FORM_rnglistx = 0x23;
+constexpr uint64_t DW_FORM_ref_sup8 = 0x24;
+constexpr uint64_t DW_FORM_strx1 = 0x25;
+constexpr uint64_t DW_FORM_strx2 = 0x26;
+constexpr uint64_t DW_FORM_strx3 = 0x27;
+constexpr uint64_t DW_FORM_strx4 = 0x28;
+constexpr uint64_t DW_FORM_addrx1 = 0x29;
+constexpr uint64_t DW_FORM_addrx2 = 0x2a;
+constexpr uint64_t DW_FORM_addrx3 = 0x2b;
+constexpr uint64_t DW_FORM_addrx4 = 0x2c;
+constexpr uint64_t DW_FORM_GNU_addr_index = 0x1f01;
+constexpr uint64_t DW_FORM_GNU_str_index = 0x1f02;
+constexpr uint64_t DW_FORM_GNU_ref_alt = 0x1f20;
+constexpr uint64_t DW_FORM_GNU_strp_alt = 0x1f21;
+
+constexpr uint8_t DW_OP_constu = 0x10;
+constexpr uint8_t DW_OP_plus_uconst = 0x23;
+
+constexpr uint64_t DW_IDX_compile_unit = 1;
+constexpr uint64_t DW_IDX_type_unit = 2;
+constexpr uint64_t DW_IDX_die_offset = 3;
+constexpr uint64_t DW_IDX_parent = 4;
+
+constexpr uint8_t DW_UT_type = 0x02;
+constexpr uint8_t DW_UT_skeleton = 0x04;
+constexpr uint8_t DW_UT_split_compile = 0x05;
+constexpr uint8_t DW_UT_split_type = 0x06;
+
+// .gdb_index symbol kind of types, in bits 28-30 of a CU vector entry.
+constexpr uint32_t GDB_INDEX_SYMBOL_KIND_TYPE = 1;
+
+// Nesting followed through namespaces, classes, bases and typedefs, malformed input can loop.
+constexpr int MAX_DWARF_DEPTH = 64;
+
+// Abbreviation codes are small and dense, larger ones are taken as corruption.
+constexpr uint64_t MAX_ABBREV_CODE = 1 << 20;
+
+constexpr std::string_view ANONYMOUS_NAMESPACE{"(anonymous namespace)"};
+
+// Bounds-checked little-endian reads from a section. Once a read runs past the end, every later one returns 0.
+class DwarfCursor
+{
+public:
+    DwarfCursor(std::span<const unsigned char> data, uint64_t offset) : m_data{data}, m_offset{offset}, m_failed{offset > data.size()} {}
+
+    uint64_t offset() const { return m_offset; }
+    bool failed() const { return m_failed; }
+    bool atEnd() const { return m_failed || m_offset == m_data.size(); }
+
+    uint64_t fixed(std::size_t size)
+    {
+        if (m_failed || m_data.size() - m_offset < size)
+        {
+            m_failed = true;
+            return 0;
+        }
+
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            value |= static_cast<uint64_t>(m_data[m_offset + i]) << (8 * i);
+        }
+
+        m_offset += size;
+        return value;
+    }
+
+    uint64_t uleb()
+    {
+        uint64_t value = 0;
+        for (unsigned int shift = 0;; shift += 7)
+        {
+            auto byte = fixed(1);
+            if (shift < 64)
+            {
+                value |= (byte & 0x7f) << shift;
+            }
+
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+    }
+
+    int64_t sleb()
+    {
+        uint64_t value = 0;
+        unsigned int shift = 0;
+        uint64_t byte = 0;
+        do
+        {
+            byte = fixed(1);
+            if (shift < 64)
+            {
+                value |= (byte & 0x7f) << shift;
+            }
+            shift += 7;
+        } while (byte & 0x80);
+
+        if (shift < 64 && (byte & 0x40))
+        {
+            value |= ~uint64_t{0} << shift;
+        }
+
+        return static_cast<int64_t>(value);
+    }
+
+    std::span<const unsigned char> bytes(uint64_t size)
+    {
+        if (m_failed || m_data.size() - m_offset < size)
+        {
+            m_failed = true;
+            return {};
+        }
+
+        auto result = m_data.subspan(m_offset, size);
+        m_offset += size;
+        return result;
+    }
+
+    std::string_view string()
+    {
+        if (m_failed)
+        {
+            return {};
+        }
+
+        auto start = reinterpret_cast<const char *>(m_data.data() + m_offset);
+        auto end = static_cast<const char *>(std::memchr(start, 0, m_data.size() - m_offset));
+        if (!end)
+        {
+            m_failed = true;
+            return {};
+        }
+
+        m_offset += static_cast<uint64_t>(end - start) + 1;
+        return {start, static_cast<std::size_t>(end - start)};
+    }
+
+private:
+    std::span<const unsigned char> m_data;
+    uint64_t m_offset;
+    bool m_failed;
+};
+
+static std::string_view sectionString(std::span<const unsigned char> section, uint64_t offset)
+{
+    DwarfCursor cursor(section, offset);
+    return cursor.string();
+}
+
+// The name of a class without its scope, "Inner<ns::T>" for "ns::Outer::Inner<ns::T>".
+static std::string_view unqualifiedName(std::string_view name)
+{
+    int templateDepth = 0;
+    std::size_t start = 0;
+    for (std::size_t i = 0; i + 1 < name.size(); ++i)
+    {
+        if (name[i] == '<')
+        {
+            templateDepth++;
+        }
+        else if (name[i] == '>')
+        {
+            templateDepth--;
+        }
+        else if (templateDepth == 0 && name[i] == ':' && name[i + 1] == ':')
+        {
+            start = i + 2;
+        }
+    }
+
+    return name.substr(start);
+}
+
+static bool isClassTag(uint64_t tag)
+{
+    return tag == DW_TAG_class_type || tag == DW_TAG_structure_type || tag == DW_TAG_union_type;
+}
+
+DwarfSections findDwarfSections(const char *image, std::size_t size, const std::vector<ElfSection> &sections, std::vector<std::string> &errors)
+{
+    DwarfSections dwarf;
+    const std::pair<std::string_view, std::span<const unsigned char> *> targets[] = {
+        {".debug_info", &dwarf.info},
+        {".debug_abbrev", &dwarf.abbrev},
+        {".debug_str", &dwarf.str},
+        {".debug_str_offsets", &dwarf.strOffsets},
+        {".debug_line_str", &dwarf.lineStr},
+        {".debug_names", &dwarf.names},
+        {".gdb_index", &dwarf.gdbIndex},
+    };
+
+    for (const auto& section : sections)
+    {
+        auto target = std::ranges::find(targets, section.name, &std::pair<std::string_view, std::span<const unsigned char> *>::first);
+        if (target == std::end(targets) || section.type == SHT_NOBITS)
+        {
+            continue;
+        }
+
+        if (section.flags & SHF_COMPRESSED)
+        {
+            errors.push_back(fmt::format("Warning: compressed debug section {} is not supported", section.name));
+            continue;
+        }
+
+        if (section.offset > size || section.size > size - section.offset)
+        {
+            errors.push_back(fmt::format("Warning: debug section {} is outside of the file", section.name));
+            continue;
+        }
+
+        *target->second = {reinterpret_cast<const unsigned char *>(image) + section.offset, static_cast<std::size_t>(section.size)};
+    }
+
+    return dwarf;
+}
+
+void addDwarfMemberOffsets(const char *image, std::size_t size, const std::vector<ElfSection> &sections, MemberOffsetIndex &memberOffsets)
+{
+    std::vector<std::string> errors;
+    auto dwarfSections = findDwarfSections(image, size, sections, errors);
+
+    for (const auto& error : errors)
+    {
+        std::cerr << error << std::endl;
+    }
+
+    if (!dwarfSections.info.empty() && !dwarfSections.abbrev.empty())
+    {
+        memberOffsets.setFallback(std::make_shared<DwarfMemberOffsets>(dwarfSections));
+    }
+}
+
+struct DwarfAttributeSpec
+{
+    uint64_t name;
+    uint64_t form;
+    int64_t implicitConst;
+};
+
+struct DwarfAbbrev
+{
+    uint64_t tag{0}; // 0 for codes the table doesn't define
+    bool hasChildren{false};
+    std::vector<DwarfAttributeSpec> attributes;
+};
+
+struct DwarfUnit
+{
+    uint64_t offset; // Of the header, references are relative to it
+    uint64_t end;
+    uint64_t firstDie;
+    uint64_t abbrevOffset;
+    uint64_t strOffsetsBase;
+    uint16_t version;
+    uint8_t addressSize;
+    uint8_t offsetSize;
+    bool prepared{false}; // DW_AT_str_offsets_base was read from the unit DIE
+    bool indexed{false};
+    const std::vector<DwarfAbbrev> *abbrevs{};
+};
+
+// An attribute value, as far as the attributes read here need it.
+struct DwarfValue
+{
+    enum class Kind
+    {
+        Other,
+        Constant, // Also flags and section offsets
+        Reference, // Offset into .debug_info
+        String,
+        Block, // Expressions and blocks
+    };
+
+    Kind kind{Kind::Other};
+    uint64_t number{0};
+    std::string_view string;
+    std::span<const unsigned char> block;
+};
+
+// The attributes of a DIE the lookups need.
+struct DwarfDie
+{
+    uint64_t offset{0};
+    uint64_t next{0}; // After the attributes: the first child, or the next sibling
+    uint64_t code{0}; // 0 for the null entry ending a list of children
+    uint64_t tag{0};
+    bool hasChildren{false};
+    std::string_view name;
+    bool declaration{false};
+    bool external{false};
+    bool hasLocation{false};
+    std::optional<uint64_t> location; // Nothing if it is an expression other than a constant offset
+    std::optional<uint64_t> bitOffset;
+    std::optional<uint64_t> type;
+    std::optional<uint64_t> sibling;
+    std::optional<uint64_t> strOffsetsBase;
+};
+
+struct DwarfMemberOffsets::Reader
+{
+    DwarfSections sections;
+
+    std::mutex mutex;
+    bool unitsRead{false};
+    std::vector<DwarfUnit> units;
+    std::unordered_map<uint64_t, std::vector<DwarfAbbrev>> abbrevTables;
+    std::size_t nextUnit{0}; // Without an accelerator table units are indexed in order, up to the one defining a class
+    std::unordered_map<std::string, uint64_t> classes; // Qualified name to definition DIE, of the units indexed so far
+    std::unordered_map<std::string, std::optional<uint64_t>> locatedClasses;
+
+    void readUnits();
+    DwarfUnit *unitAt(uint64_t dieOffset);
+    std::optional<std::size_t> unitIndex(uint64_t unitOffset) const;
+    const std::vector<DwarfAbbrev> &abbrevs(DwarfUnit &unit);
+
+    DwarfValue readValue(DwarfCursor &cursor, const DwarfUnit &unit, uint64_t form, int64_t implicitConst) const;
+    std::string_view indexedString(const DwarfUnit &unit, uint64_t index) const;
+    bool readDie(DwarfUnit &unit, uint64_t offset, DwarfDie &die);
+    uint64_t subtreeEnd(DwarfUnit &unit, const DwarfDie &die);
+
+    void indexUnit(std::size_t index);
+    uint64_t indexChildren(DwarfUnit &unit, uint64_t offset, const std::string &scope, int depth);
+
+    std::optional<uint64_t> lookupDebugNames(std::string_view name, std::vector<std::size_t> &candidateUnits);
+    void lookupGdbIndex(std::string_view name, std::vector<std::size_t> &candidateUnits);
+
+    std::optional<uint64_t> locateClass(std::string_view name);
+    std::optional<uint64_t> resolveType(uint64_t offset);
+    std::optional<uint64_t> findMember(uint64_t classOffset, std::string_view memberName, int depth);
+};
+
+void DwarfMemberOffsets::Reader::readUnits()
+{
+    if (unitsRead)
+    {
+        return;
+    }
+    unitsRead = true;
+
+    uint64_t offset = 0;
+    while (offset < sections.info.size())
+    {
+        DwarfCursor cursor(sections.info, offset);
+
+        DwarfUnit unit{};
+        unit.offset = offset;
+        unit.offsetSize = 4;
+
+        uint64_t length = cursor.fixed(4);
+        if (length == 0xffffffff)
+        {
+            unit.offsetSize = 8;
+            length = cursor.fixed(8);
+        }
+        else if (length >= 0xfffffff0)
+        {
+            break;
+        }
+
+        if (cursor.failed() || length > sections.info.size() - cursor.offset())
+        {
+            std::cerr << fmt::format("Warning: truncated DWARF unit at offset {:#x}", offset) << std::endl;
+            break;
+        }
+
+        unit.end = cursor.offset() + length;
+        unit.version = static_cast<uint16_t>(cursor.fixed(2));
+
+        if (unit.version >= 5)
+        {
+            auto unitType = static_cast<uint8_t>(cursor.fixed(1));
+            unit.addressSize = static_cast<uint8_t>(cursor.fixed(1));
+            unit.abbrevOffset = cursor.fixed(unit.offsetSize);
+
+            if (unitType == DW_UT_skeleton || unitType == DW_UT_split_compile)
+            {
+                cursor.fixed(8);
+            }
+            else if (unitType == DW_UT_type || unitType == DW_UT_split_type)
+            {
+                cursor.fixed(8);
+                cursor.fixed(unit.offsetSize);
+            }
+
+            // The first offsets come after the .debug_str_offsets header, if the unit DIE doesn't say.
+            unit.strOffsetsBase = unit.offsetSize == 8 ? 16 : 8;
+        }
+        else
+        {
+            unit.abbrevOffset = cursor.fixed(unit.offsetSize);
+            unit.addressSize = static_cast<uint8_t>(cursor.fixed(1));
+        }
+
+        unit.firstDie = cursor.offset();
+
+        if (unit.version >= 2 && unit.version <= 5 && !cursor.failed() && unit.firstDie <= unit.end)
+        {
+            units.push_back(unit);
+        }
+
+        offset = unit.end;
+    }
+}
+
+DwarfUnit *DwarfMemberOffsets::Reader::unitAt(uint64_t dieOffset)
+{
+    readUnits();
+
+    auto unit = std::ranges::upper_bound(units, dieOffset, {}, &DwarfUnit::offset);
+    if (unit == units.begin() || dieOffset >= std::prev(unit)->end)
+    {
+        return nullptr;
+    }
+
+    --unit;
+    if (!unit->prepared)
+    {
+        unit->prepared = true;
+
+        DwarfDie die;
+        if (readDie(*unit, unit->firstDie, die) && die.strOffsetsBase)
+        {
+            unit->strOffsetsBase = *die.strOffsetsBase;
+        }
+    }
+
+    return &*unit;
+}
+
+std::optional<std::size_t> DwarfMemberOffsets::Reader::unitIndex(uint64_t unitOffset) const
+{
+    auto unit = std::ranges::lower_bound(units, unitOffset, {}, &DwarfUnit::offset);
+    if (unit == units.end() || unit->offset != unitOffset)
+    {
+        return std::nullopt;
+    }
+
+    return static_cast<std::size_t>(unit - units.begin());
+}
+
+const std::vector<DwarfAbbrev> &DwarfMemberOffsets::Reader::abbrevs(DwarfUnit &unit)
+{
+    if (unit.abbrevs)
+    {
+        return *unit.abbrevs;
+    }
+
+    auto [table, inserted] = abbrevTables.try_emplace(unit.abbrevOffset);
+    unit.abbrevs = &table->second;
+    if (!inserted)
+    {
+        return table->second;
+    }
+
+    DwarfCursor cursor(sections.abbrev, unit.abbrevOffset);
+    while (true)
+    {
+        auto code = cursor.uleb();
+        if (code == 0 || cursor.failed())
+        {
+            break;
+        }
+
+        DwarfAbbrev abbrev;
+        abbrev.tag = cursor.uleb();
+        abbrev.hasChildren = cursor.fixed(1) != 0;
+
+        while (!cursor.failed())
+        {
+            DwarfAttributeSpec spec{};
+            spec.name = cursor.uleb();
+            spec.form = cursor.uleb();
+            if (spec.name == 0 && spec.form == 0)
+            {
+                break;
+            }
+
+            if (spec.form == DW_FORM_implicit_const)
+            {
+                spec.implicitConst = cursor.sleb();
+            }
+
+            abbrev.attributes.push_back(spec);
+        }
+
+        if (code >= MAX_ABBREV_CODE)
+        {
+            break;
+        }
+
+        if (code >= table->second.size())
+        {
+            table->second.resize(code + 1);
+        }
+        table->second[code] = std::move(abbrev);
+    }
+
+    return table->second;
+}
+
+std::string_view DwarfMemberOffsets::Reader::indexedString(const DwarfUnit &unit, uint64_t index) const
+{
+    DwarfCursor cursor(sections.strOffsets, unit.strOffsetsBase + index * unit.offsetSize);
+    auto offset = cursor.fixed(unit.offsetSize);
+    return cursor.failed() ? std::string_view{} : sectionString(sections.str, offset);
+}
+
+DwarfValue DwarfMemberOffsets::Reader::readValue(DwarfCursor &cursor, const DwarfUnit &unit, uint64_t form, int64_t implicitConst) const
+{
+    DwarfValue value;
+
+    auto constant = [&](uint64_t number)
+    {
+        value.kind = DwarfValue::Kind::Constant;
+        value.number = number;
+    };
+
+    auto reference = [&](uint64_t offset)
+    {
+        value.kind = DwarfValue::Kind::Reference;
+        value.number = offset;
+    };
+
+    auto string = [&](std::string_view text)
+    {
+        value.kind = DwarfValue::Kind::String;
+        value.string = text;
+    };
+
+    auto block = [&](uint64_t size)
+    {
+        value.kind = DwarfValue::Kind::Block;
+        value.block = cursor.bytes(size);
+    };
+
+    switch (form)
+    {
+    case DW_FORM_addr:
+        cursor.fixed(unit.addressSize);
+        break;
+    case DW_FORM_block1:
+        block(cursor.fixed(1));
+        break;
+    case DW_FORM_block2:
+        block(cursor.fixed(2));
+        break;
+    case DW_FORM_block4:
+        block(cursor.fixed(4));
+        break;
+    case DW_FORM_block:
+    case DW_FORM_exprloc:
+        block(cursor.uleb());
+        break;
+    case DW_FORM_data1:
+    case DW_FORM_flag:
+        constant(cursor.fixed(1));
+        break;
+    case DW_FORM_data2:
+        constant(cursor.fixed(2));
+        break;
+    case DW_FORM_data4:
+        constant(cursor.fixed(4));
+        break;
+    case DW_FORM_data8:
+        constant(cursor.fixed(8));
+        break;
+    case DW_FORM_data16:
+        cursor.bytes(16);
+        break;
+    case DW_FORM_sdata:
+        constant(static_cast<uint64_t>(cursor.sleb()));
+        break;
+    case DW_FORM_udata:
+        constant(cursor.uleb());
+        break;
+    case DW_FORM_implicit_const:
+        constant(static_cast<uint64_t>(implicitConst));
+        break;
+    case DW_FORM_flag_present:
+        constant(1);
+        break;
+    case DW_FORM_sec_offset:
+        constant(cursor.fixed(unit.offsetSize));
+        break;
+    case DW_FORM_string:
+        string(cursor.string());
+        break;
+    case DW_FORM_strp:
+        string(sectionString(sections.str, cursor.fixed(unit.offsetSize)));
+        break;
+    case DW_FORM_line_strp:
+        string(sectionString(sections.lineStr, cursor.fixed(unit.offsetSize)));
+        break;
+    case DW_FORM_strx:
+    case DW_FORM_GNU_str_index:
+        string(indexedString(unit, cursor.uleb()));
+        break;
+    case DW_FORM_strx1:
+        string(indexedString(unit, cursor.fixed(1)));
+        break;
+    case DW_FORM_strx2:
+        string(indexedString(unit, cursor.fixed(2)));
+        break;
+    case DW_FORM_strx3:
+        string(indexedString(unit, cursor.fixed(3)));
+        break;
+    case DW_FORM_strx4:
+        string(indexedString(unit, cursor.fixed(4)));
+        break;
+    case DW_FORM_ref1:
+        reference(unit.offset + cursor.fixed(1));
+        break;
+    case DW_FORM_ref2:
+        reference(unit.offset + cursor.fixed(2));
+        break;
+    case DW_FORM_ref4:
+        reference(unit.offset + cursor.fixed(4));
+        break;
+    case DW_FORM_ref8:
+        reference(unit.offset + cursor.fixed(8));
+        break;
+    case DW_FORM_ref_udata:
+        reference(unit.offset + cursor.uleb());
+        break;
+    case DW_FORM_ref_addr:
+        reference(cursor.fixed(unit.version == 2 ? unit.addressSize : unit.offsetSize));
+        break;
+    case DW_FORM_strp_sup:
+    case DW_FORM_GNU_ref_alt:
+    case DW_FORM_GNU_strp_alt:
+        // Point into a supplementary file, which isn't read.
+        cursor.fixed(unit.offsetSize);
+        break;
+    case DW_FORM_ref_sig8:
+    case DW_FORM_ref_sup8:
+        cursor.fixed(8);
+        break;
+    case DW_FORM_ref_sup4:
+        cursor.fixed(4);
+        break;
+    case DW_FORM_addrx:
+    case DW_FORM_loclistx:
+    case DW_FORM_rnglistx:
+    case DW_FORM_GNU_addr_index:
+        cursor.uleb();
+        break;
+    case DW_FORM_addrx1:
+        cursor.fixed(1);
+        break;
+    case DW_FORM_addrx2:
+        cursor.fixed(2);
+        break;
+    case DW_FORM_addrx3:
+        cursor.fixed(3);
+        break;
+    case DW_FORM_addrx4:
+        cursor.fixed(4);
+        break;
+    default:
+        // Its size is unknown, so nothing after it can be read.
+        cursor.bytes(sections.info.size() + 1);
+        break;
+    }
+
+    return value;
+}
+
+bool DwarfMemberOffsets::Reader::readDie(DwarfUnit &unit, uint64_t offset, DwarfDie &die)
+{
+    die = {};
+    die.offset = offset;
+
+    if (offset < unit.firstDie || offset >= unit.end)
+    {
+        return false;
+    }
+
+    DwarfCursor cursor(sections.info.first(unit.end), offset);
+    die.code = cursor.uleb();
+    if (cursor.failed())
+    {
+        return false;
+    }
+
+    if (die.code == 0)
+    {
+        die.next = cursor.offset();
+        return true;
+    }
+
+    const auto& table = abbrevs(unit);
+    if (die.code >= table.size() || table[die.code].tag == 0)
+    {
+        return false;
+    }
+
+    const auto& abbrev = table[die.code];
+    die.tag = abbrev.tag;
+    die.hasChildren = abbrev.hasChildren;
+
+    for (const auto& spec : abbrev.attributes)
+    {
+        auto form = spec.form;
+        if (form == DW_FORM_indirect)
+        {
+            form = cursor.uleb();
+        }
+
+        auto value = readValue(cursor, unit, form, spec.implicitConst);
+        switch (spec.name)
+        {
+        case DW_AT_name:
+            die.name = value.string;
+            break;
+        case DW_AT_declaration:
+            die.declaration = value.kind == DwarfValue::Kind::Constant && value.number != 0;
+            break;
+        case DW_AT_external:
+            die.external = value.kind == DwarfValue::Kind::Constant && value.number != 0;
+            break;
+        case DW_AT_data_member_location:
+            die.hasLocation = true;
+            if (value.kind == DwarfValue::Kind::Constant)
+            {
+                die.location = value.number;
+            }
+            else if (value.kind == DwarfValue::Kind::Block)
+            {
+                // DWARF 2 style offsets are a one-operation expression.
+                DwarfCursor expression(value.block, 0);
+                auto operation = expression.fixed(1);
+                auto operand = expression.uleb();
+                if ((operation == DW_OP_plus_uconst || operation == DW_OP_constu) && expression.atEnd() && !expression.failed())
+                {
+                    die.location = operand;
+                }
+            }
+            break;
+        case DW_AT_data_bit_offset:
+            if (value.kind == DwarfValue::Kind::Constant)
+            {
+                die.bitOffset = value.number;
+            }
+            break;
+        case DW_AT_type:
+            if (value.kind == DwarfValue::Kind::Reference)
+            {
+                die.type = value.number;
+            }
+            break;
+        case DW_AT_sibling:
+            if (value.kind == DwarfValue::Kind::Reference && value.number > offset && value.number <= unit.end)
+            {
+                die.sibling = value.number;
+            }
+            break;
+        case DW_AT_str_offsets_base:
+            if (value.kind == DwarfValue::Kind::Constant)
+            {
+                die.strOffsetsBase = value.number;
+            }
+            break;
+        }
+    }
+
+    if (cursor.failed())
+    {
+        return false;
+    }
+
+    die.next = cursor.offset();
+    return true;
+}
+
+uint64_t DwarfMemberOffsets::Reader::subtreeEnd(DwarfUnit &unit, const DwarfDie &die)
+{
+    if (!die.hasChildren)
+    {
+        return die.next;
+    }
+
+    if (die.sibling)
+    {
+        return *die.sibling;
+    }
+
+    // Without DW_AT_sibling the children are decoded to find their end, nothing is kept.
+    std::size_t depth = 1;
+    auto offset = die.next;
+    DwarfDie child;
+    while (depth > 0)
+    {
+        if (!readDie(unit, offset, child))
+        {
+            return unit.end;
+        }
+
+        if (child.code == 0)
+        {
+            depth--;
+            offset = child.next;
+        }
+        else if (child.hasChildren && !child.sibling)
+        {
+            depth++;
+            offset = child.next;
+        }
+        else
+        {
+            offset = child.sibling.value_or(child.next);
+        }
+    }
+
+    return offset;
+}
+
+void DwarfMemberOffsets::Reader::indexUnit(std::size_t index)
+{
+    auto& unit = units[index];
+    if (unit.indexed)
+    {
+        return;
+    }
+    unit.indexed = true;
+
+    TRACE_SCOPE("index DWARF unit");
+
+    DwarfDie root;
+    if (unitAt(unit.offset) && readDie(unit, unit.firstDie, root) && root.hasChildren)
+    {
+        indexChildren(unit, root.next, {}, 0);
+    }
+}
+
+uint64_t DwarfMemberOffsets::Reader::indexChildren(DwarfUnit &unit, uint64_t offset, const std::string &scope, int depth)
+{
+    DwarfDie die;
+    while (true)
+    {
+        if (!readDie(unit, offset, die))
+        {
+            return unit.end;
+        }
+
+        if (die.code == 0)
+        {
+            return die.next;
+        }
+
+        // Classes nest in namespaces and in other classes, everything else is skipped whole.
+        bool isNamespace = die.tag == DW_TAG_namespace;
+        if ((isNamespace || isClassTag(die.tag)) && (isNamespace || !die.name.empty()))
+        {
+            auto name = scope + std::string(die.name.empty() ? ANONYMOUS_NAMESPACE : die.name);
+            if (!isNamespace && !die.declaration)
+            {
+                classes.emplace(name, die.offset);
+            }
+
+            if (die.hasChildren && depth < MAX_DWARF_DEPTH)
+            {
+                offset = indexChildren(unit, die.next, name + "::", depth + 1);
+                continue;
+            }
+        }
+
+        offset = subtreeEnd(unit, die);
+    }
+}
+
+// DWARF 5 name index: the hash table leads to the entries of a name, each with its DIE offset and, when the
+// producer emits DW_IDX_parent, the entry of its parent, which makes the qualified name without reading the unit.
+std::optional<uint64_t> DwarfMemberOffsets::Reader::lookupDebugNames(std::string_view name, std::vector<std::size_t> &candidateUnits)
+{
+    auto unqualified = unqualifiedName(name);
+
+    uint32_t hash = 5381;
+    for (auto c : unqualified)
+    {
+        hash = hash * 33 + static_cast<unsigned char>(c);
+    }
+
+    struct NameAbbrev
+    {
+        uint64_t tag;
+        std::vector<std::pair<uint64_t, uint64_t>> attributes; // (DW_IDX_*, form)
+    };
+
+    uint64_t indexOffset = 0;
+    while (indexOffset < sections.names.size())
+    {
+        DwarfCursor cursor(sections.names, indexOffset);
+
+        std::size_t offsetSize = 4;
+        uint64_t length = cursor.fixed(4);
+        if (length == 0xffffffff)
+        {
+            offsetSize = 8;
+            length = cursor.fixed(8);
+        }
+
+        if (cursor.failed() || length > sections.names.size() - cursor.offset())
+        {
+            break;
+        }
+
+        auto indexEnd = cursor.offset() + length;
+        indexOffset = indexEnd;
+
+        auto version = cursor.fixed(2);
+        cursor.fixed(2);
+        auto compUnitCount = cursor.fixed(4);
+        auto localTypeUnitCount = cursor.fixed(4);
+        auto foreignTypeUnitCount = cursor.fixed(4);
+        auto bucketCount = cursor.fixed(4);
+        auto nameCount = cursor.fixed(4);
+        auto abbrevTableSize = cursor.fixed(4);
+        auto augmentationSize = cursor.fixed(4);
+        cursor.bytes(augmentationSize);
+
+        if (version != 5 || cursor.failed())
+        {
+            continue;
+        }
+
+        auto compUnits = cursor.offset();
+        cursor.bytes((compUnitCount + localTypeUnitCount) * offsetSize + foreignTypeUnitCount * 8);
+        auto buckets = cursor.offset();
+        cursor.bytes(bucketCount * 4);
+        auto hashes = cursor.offset();
+        cursor.bytes(bucketCount != 0 ? nameCount * 4 : 0);
+        auto stringOffsets = cursor.offset();
+        cursor.bytes(nameCount * offsetSize);
+        auto entryOffsets = cursor.offset();
+        cursor.bytes(nameCount * offsetSize);
+        auto abbrevTable = cursor.bytes(abbrevTableSize);
+        auto entryPool = cursor.offset();
+
+        if (cursor.failed() || entryPool > indexEnd)
+        {
+            continue;
+        }
+
+        std::unordered_map<uint64_t, NameAbbrev> nameAbbrevs;
+        DwarfCursor abbrevCursor(abbrevTable, 0);
+        while (!abbrevCursor.failed())
+        {
+            auto code = abbrevCursor.uleb();
+            if (code == 0)
+            {
+                break;
+            }
+
+            auto& abbrev = nameAbbrevs[code];
+            abbrev.tag = abbrevCursor.uleb();
+            while (!abbrevCursor.failed())
+            {
+                auto index = abbrevCursor.uleb();
+                auto form = abbrevCursor.uleb();
+                if (index == 0 && form == 0)
+                {
+                    break;
+                }
+                abbrev.attributes.emplace_back(index, form);
+            }
+        }
+
+        auto section = sections.names.first(indexEnd);
+        auto at = [&](uint64_t offset, std::size_t size)
+        {
+            DwarfCursor field(section, offset);
+            return field.fixed(size);
+        };
+
+        struct NameEntry
+        {
+            uint64_t tag{0};
+            std::optional<uint64_t> unitOffset;
+            std::optional<uint64_t> dieOffset;
+            bool hasParent{false}; // Whether the producer says, not whether there is one
+            std::optional<uint64_t> parentEntry;
+        };
+
+        auto readEntry = [&](DwarfCursor &entryCursor, NameEntry &entry)
+        {
+            entry = {};
+            auto code = entryCursor.uleb();
+            auto abbrev = nameAbbrevs.find(code);
+            if (code == 0 || abbrev == nameAbbrevs.end())
+            {
+                return false;
+            }
+
+            entry.tag = abbrev->second.tag;
+            uint64_t compUnit = 0;
+            bool typeUnit = false;
+
+            for (auto [index, form] : abbrev->second.attributes)
+            {
+                DwarfUnit formUnit{};
+                formUnit.offsetSize = static_cast<uint8_t>(offsetSize);
+                formUnit.version = 5;
+
+                auto value = readValue(entryCursor, formUnit, form, 0);
+                switch (index)
+                {
+                case DW_IDX_compile_unit:
+                    compUnit = value.number;
+                    break;
+                case DW_IDX_type_unit:
+                    typeUnit = true;
+                    break;
+                case DW_IDX_die_offset:
+                    entry.dieOffset = value.number;
+                    break;
+                case DW_IDX_parent:
+                    // LLVM refers to the parent entry by its offset in the pool, and flags entries without one.
+                    if (form == DW_FORM_flag_present)
+                    {
+                        entry.hasParent = true;
+                    }
+                    else if (value.kind == DwarfValue::Kind::Reference || value.kind == DwarfValue::Kind::Constant)
+                    {
+                        entry.hasParent = true;
+                        entry.parentEntry = value.number;
+                    }
+                    break;
+                }
+            }
+
+            if (!typeUnit && compUnit < compUnitCount && entry.dieOffset)
+            {
+                entry.unitOffset = at(compUnits + compUnit * offsetSize, offsetSize);
+                *entry.dieOffset += *entry.unitOffset;
+            }
+
+            return !entryCursor.failed();
+        };
+
+        auto processName = [&](uint64_t nameIndex) -> std::optional<uint64_t>
+        {
+            DwarfCursor entryCursor(section, entryPool + at(entryOffsets + nameIndex * offsetSize, offsetSize));
+            NameEntry entry;
+            while (readEntry(entryCursor, entry))
+            {
+                if (!isClassTag(entry.tag) || !entry.unitOffset)
+                {
+                    continue;
+                }
+
+                auto unit = unitAt(*entry.dieOffset);
+                if (!unit)
+                {
+                    continue;
+                }
+
+                if (!entry.hasParent)
+                {
+                    if (auto candidate = unitIndex(unit->offset))
+                    {
+                        candidateUnits.push_back(*candidate);
+                    }
+                    continue;
+                }
+
+                // The qualified name, from the names of the parent DIEs.
+                std::string qualifiedName(unqualified);
+                auto parent = entry.parentEntry;
+                bool complete = true;
+                for (int depth = 0; parent && depth < MAX_DWARF_DEPTH; ++depth)
+                {
+                    DwarfCursor parentCursor(section, entryPool + *parent);
+                    NameEntry parentEntry;
+                    DwarfDie parentDie;
+                    DwarfUnit *parentUnit = nullptr;
+                    if (!readEntry(parentCursor, parentEntry) || !parentEntry.dieOffset || !(parentUnit = unitAt(*parentEntry.dieOffset)) || !readDie(*parentUnit, *parentEntry.dieOffset, parentDie))
+                    {
+                        complete = false;
+                        break;
+                    }
+
+                    auto parentName = parentDie.name.empty() && parentDie.tag == DW_TAG_namespace ? ANONYMOUS_NAMESPACE : parentDie.name;
+                    qualifiedName = fmt::format("{}::{}", parentName, qualifiedName);
+                    parent = parentEntry.parentEntry;
+                }
+
+                DwarfDie die;
+                if (complete && qualifiedName == name && readDie(*unit, *entry.dieOffset, die) && !die.declaration)
+                {
+                    return die.offset;
+                }
+            }
+
+            return std::nullopt;
+        };
+
+        if (bucketCount != 0)
+        {
+            auto bucket = hash % bucketCount;
+            auto nameIndex = at(buckets + bucket * 4, 4);
+            for (; nameIndex != 0 && nameIndex <= nameCount; ++nameIndex)
+            {
+                auto nameHash = static_cast<uint32_t>(at(hashes + (nameIndex - 1) * 4, 4));
+                if (nameHash % bucketCount != bucket)
+                {
+                    break;
+                }
+
+                if (nameHash == hash && sectionString(sections.str, at(stringOffsets + (nameIndex - 1) * offsetSize, offsetSize)) == unqualified)
+                {
+                    if (auto found = processName(nameIndex - 1))
+                    {
+                        return found;
+                    }
+                }
+            }
+        }
+        else
+        {
+            for (uint64_t nameIndex = 0; nameIndex < nameCount; ++nameIndex)
+            {
+                if (sectionString(sections.str, at(stringOffsets + nameIndex * offsetSize, offsetSize)) == unqualified)
+                {
+                    if (auto found = processName(nameIndex))
+                    {
+                        return found;
+                    }
+                }
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+// GDB index: an open addressing table from qualified names to the units that define them.
+void DwarfMemberOffsets::Reader::lookupGdbIndex(std::string_view name, std::vector<std::size_t> &candidateUnits)
+{
+    DwarfCursor cursor(sections.gdbIndex, 0);
+    auto version = cursor.fixed(4);
+    if (version < 5 || version > 9)
+    {
+        return;
+    }
+
+    auto compUnitList = cursor.fixed(4);
+    auto typeUnitList = cursor.fixed(4);
+    cursor.fixed(4);
+    auto symbolTable = cursor.fixed(4);
+    auto symbolTableEnd = cursor.fixed(4);
+    auto constantPool = symbolTableEnd;
+    if (version >= 9)
+    {
+        constantPool = cursor.fixed(4);
+    }
+
+    auto compUnitCount = (typeUnitList - compUnitList) / 16;
+    auto slotCount = (symbolTableEnd - symbolTable) / 8;
+    if (cursor.failed() || typeUnitList < compUnitList || symbolTableEnd < symbolTable || slotCount == 0 || (slotCount & (slotCount - 1)) != 0)
+    {
+        return;
+    }
+
+    auto at = [&](uint64_t offset, std::size_t size)
+    {
+        DwarfCursor field(sections.gdbIndex, offset);
+        return field.fixed(size);
+    };
+
+    // Case-insensitive since version 5.
+    uint32_t hash = 0;
+    for (auto c : name)
+    {
+        auto byte = static_cast<unsigned char>(c);
+        if (byte >= 'A' && byte <= 'Z')
+        {
+            byte = static_cast<unsigned char>(byte - 'A' + 'a');
+        }
+        hash = hash * 67 + byte - 113;
+    }
+
+    auto mask = slotCount - 1;
+    auto step = ((hash * 17) & mask) | 1;
+    for (uint64_t slot = hash & mask, probes = 0; probes < slotCount; slot = (slot + step) & mask, ++probes)
+    {
+        auto nameOffset = at(symbolTable + slot * 8, 4);
+        auto vectorOffset = at(symbolTable + slot * 8 + 4, 4);
+        if (nameOffset == 0 && vectorOffset == 0)
+        {
+            return;
+        }
+
+        if (sectionString(sections.gdbIndex, constantPool + nameOffset) != name)
+        {
+            continue;
+        }
+
+        auto count = at(constantPool + vectorOffset, 4);
+        for (uint64_t i = 0; i < count && i < compUnitCount; ++i)
+        {
+            auto entry = static_cast<uint32_t>(at(constantPool + vectorOffset + 4 + i * 4, 4));
+            auto unit = entry & 0xffffff;
+            auto kind = (entry >> 28) & 7;
+            if ((version >= 7 && kind != GDB_INDEX_SYMBOL_KIND_TYPE) || unit >= compUnitCount)
+            {
+                continue;
+            }
+
+            if (auto candidate = unitIndex(at(compUnitList + unit * 16, 8)))
+            {
+                candidateUnits.push_back(*candidate);
+            }
+        }
+
+        return;
+    }
+}
+
+std::optional<uint64_t> DwarfMemberOffsets::Reader::locateClass(std::string_view name)
+{
+    if (auto located = locatedClasses.find(std::string(name)); located != locatedClasses.end())
+    {
+        return located->second;
+    }
+
+    TRACE_SCOPE("locate DWARF class");
+
+    readUnits();
+
+    auto findIndexed = [&]() -> std::optional<uint64_t>
+    {
+        auto indexed = classes.find(std::string(name));
+        return indexed != classes.end() ? std::optional<uint64_t>{indexed->second} : std::nullopt;
+    };
+
+    std::optional<uint64_t> found = findIndexed();
+    if (!found && (!sections.names.empty() || !sections.gdbIndex.empty()))
+    {
+        // An accelerator table lists every class, what it doesn't have isn't there.
+        std::vector<std::size_t> candidateUnits;
+        found = !sections.names.empty() ? lookupDebugNames(name, candidateUnits) : std::nullopt;
+        if (!found && sections.names.empty())
+        {
+            lookupGdbIndex(name, candidateUnits);
+        }
+
+        for (auto index : candidateUnits)
+        {
+            if (found)
+            {
+                break;
+            }
+
+            indexUnit(index);
+            found = findIndexed();
+        }
+    }
+    else
+    {
+        while (!found && nextUnit < units.size())
+        {
+            indexUnit(nextUnit++);
+            found = findIndexed();
+        }
+    }
+
+    locatedClasses.emplace(name, found);
+    return found;
+}
+
+// The class a type refers to, through typedefs and qualifiers.
+std::optional<uint64_t> DwarfMemberOffsets::Reader::resolveType(uint64_t offset)
+{
+    for (int depth = 0; depth < MAX_DWARF_DEPTH; ++depth)
+    {
+        auto unit = unitAt(offset);
+        DwarfDie die;
+        if (!unit || !readDie(*unit, offset, die))
+        {
+            return std::nullopt;
+        }
+
+        if (isClassTag(die.tag))
+        {
+            return offset;
+        }
+
+        if ((die.tag != DW_TAG_typedef && die.tag != DW_TAG_const_type && die.tag != DW_TAG_volatile_type) || !die.type)
+        {
+            return std::nullopt;
+        }
+
+        offset = *die.type;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<uint64_t> DwarfMemberOffsets::Reader::findMember(uint64_t classOffset, std::string_view memberName, int depth)
+{
+    auto unit = unitAt(classOffset);
+    DwarfDie die;
+    if (depth > MAX_DWARF_DEPTH || !unit || !readDie(*unit, classOffset, die))
+    {
+        return std::nullopt;
+    }
+
+    // Bases can be declared in the unit and defined in another one.
+    if (die.declaration)
+    {
+        auto definition = die.name.empty() ? std::nullopt : locateClass(die.name);
+        return definition && *definition != classOffset ? findMember(*definition, memberName, depth + 1) : std::nullopt;
+    }
+
+    if (!die.hasChildren)
+    {
+        return std::nullopt;
+    }
+
+    // (type, offset) of the members the name can be in: anonymous structs and unions first, then bases.
+    std::vector<std::pair<uint64_t, uint64_t>> nested;
+    std::vector<std::pair<uint64_t, uint64_t>> bases;
+
+    auto offset = die.next;
+    DwarfDie child;
+    while (readDie(*unit, offset, child) && child.code != 0)
+    {
+        if (child.tag == DW_TAG_member && !child.declaration && !child.external && (!child.hasLocation || child.location))
+        {
+            // Union members have no location.
+            auto memberOffset = child.location.value_or(child.bitOffset.value_or(0) / 8);
+            if (child.name == memberName)
+            {
+                return memberOffset;
+            }
+
+            if (child.name.empty() && child.type)
+            {
+                nested.emplace_back(*child.type, memberOffset);
+            }
+        }
+        else if (child.tag == DW_TAG_inheritance && child.type && child.location)
+        {
+            // Virtual bases have an expression as location and are skipped.
+            bases.emplace_back(*child.type, *child.location);
+        }
+
+        offset = subtreeEnd(*unit, child);
+    }
+
+    nested.insert(nested.end(), bases.begin(), bases.end());
+    for (auto [type, baseOffset] : nested)
+    {
+        auto typeClass = resolveType(type);
+        if (!typeClass)
+        {
+            continue;
+        }
+
+        if (auto memberOffset = findMember(*typeClass, memberName, depth + 1))
+        {
+            return baseOffset + *memberOffset;
+        }
+    }
+
+    return std::nullopt;
+}
+
+DwarfMemberOffsets::DwarfMemberOffsets(const DwarfSections& sections) : m_reader{std::make_unique<Reader>()}
+{
+    m_reader->sections = sections;
+}
+
+DwarfMemberOffsets::~DwarfMemberOffsets() = default;
+
+std::optional<uint64_t> DwarfMemberOffsets::find(std::string_view className, std::string_view memberName) const
+{
+    std::scoped_lock lock(m_reader->mutex);
+
+    auto classOffset = m_reader->locateClass(className);
+    if (!classOffset)
+    {
+        return std::nullopt;
+    }
+
+    return m_reader->findMember(*classOffset, memberName, 0);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "elf.hpp"
+#include "memberoffsets.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Debug sections of an image, empty when missing.
+struct DwarfSections
+{
+    std::span<const unsigned char> info;
+    std::span<const unsigned char> abbrev;
+    std::span<const unsigned char> str;
+    std::span<const unsigned char> strOffsets;
+    std::span<const unsigned char> lineStr;
+    std::span<const unsigned char> names; // .debug_names
+    std::span<const unsigned char> gdbIndex;
+};
+
+// Compressed sections are left out, with a warning in `errors`.
+DwarfSections findDwarfSections(const char *image, std::size_t size, const std::vector<ElfSection> &sections, std::vector<std::string> &errors);
+
+// Makes member offsets the image doesn't have fall back to its debug info, if it has some. Warnings go to stderr.
+void addDwarfMemberOffsets(const char *image, std::size_t size, const std::vector<ElfSection> &sections, MemberOffsetIndex &memberOffsets);
+
+// Member offsets of the classes described in .debug_info, for builds without .member_offsets.
+// Nothing is decoded up front. A class is found through .debug_names or .gdb_index when the image has one, otherwise
+// the units are indexed one by one on first use until one defines it. Then only the class DIE and its children are read,
+// along with the bases and anonymous members the member can be in. Classes are looked up by qualified name (ns::Class).
+// Can be called from several threads.
+class DwarfMemberOffsets
+{
+public:
+    explicit DwarfMemberOffsets(const DwarfSections& sections);
+    ~DwarfMemberOffsets();
+
+    DwarfMemberOffsets(const DwarfMemberOffsets&) = delete;
+    DwarfMemberOffsets& operator=(const DwarfMemberOffsets&) = delete;
+
+    std::optional<uint64_t> find(std::string_view className, std::string_view memberName) const;
+
+private:
+    struct Reader;
+
+    std::unique_ptr<Reader> m_reader;
+};
@@ -0,0 +1,646 @@
+#include "elf.hpp"
+#include "dwarf.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+
+struct Elf32Types
+{
+    using Ehdr = Elf32_Ehdr;
+    using Shdr = Elf32_Shdr;
+    using Sym = Elf32_Sym;
+    using Rel = Elf32_Rel;
+    using Dyn = Elf32_Dyn;
+
+    static uint32_t relocationType(Elf32_Word info) { return ELF32_R_TYPE(info); }
+    static uint32_t relocationSymbol(Elf32_Word info) { return ELF32_R_SYM(info); }
+};
+
+struct Elf64Types
+{
+    using Ehdr = Elf64_Ehdr;
+    using Shdr = Elf64_Shdr;
+    using Sym = Elf64_Sym;
+    using Rel = Elf64_Rel;
+    using Dyn = Elf64_Dyn;
+
+    static uint32_t relocationType(Elf64_Xword info) { return ELF64_R_TYPE(info); }
+    static uint32_t relocationSymbol(Elf64_Xword info) { return ELF64_R_SYM(info); }
+};
+
+bool isInside(std::size_t size, uint64_t offset, uint64_t length)
+{
+    return offset <= size && length <= size - offset;
+}
+
+template <typename T>
+T readStruct(const char *image, uint64_t offset)
+{
+    T value;
+    std::memcpy(&value, image + offset, sizeof(T));
+    return value;
+}
+
+}
+
+ElfImage::ElfImage(const char *image, std::size_t size) : m_image{image}, m_size{size}
+{
+    if (size < EI_NIDENT || std::memcmp(image, ELFMAG, SELFMAG) != 0)
+    {
+        m_error = "Input is not an ELF object.";
+        return;
+    }
+
+    if (image[EI_DATA] != ELFDATA2LSB)
+    {
+        m_error = "Unsupported ELF byte order. (" + std::to_string(image[EI_DATA]) + ")";
+        return;
+    }
+
+    switch (image[EI_CLASS])
+    {
+    case ELFCLASS32:
+        readSections<Elf32_Ehdr, Elf32_Shdr>();
+        break;
+    case ELFCLASS64:
+        m_is64Bit = true;
+        readSections<Elf64_Ehdr, Elf64_Shdr>();
+        break;
+    default:
+        m_error = "Unsupported ELF class. (" + std::to_string(image[EI_CLASS]) + ")";
+        break;
+    }
+}
+
+template <typename Ehdr, typename Shdr>
+bool ElfImage::readSections()
+{
+    if (m_size < sizeof(Ehdr))
+    {
+        m_error = "Failed to get ELF header. (file is truncated)";
+        return false;
+    }
+
+    auto elfHeader = readStruct<Ehdr>(m_image, 0);
+
+    switch (elfHeader.e_machine)
+    {
+    case EM_386:
+        m_addressSize = 4;
+        break;
+    case EM_X86_64:
+        m_addressSize = 8;
+        break;
+    default:
+        m_error = "Unsupported architecture. (" + std::to_string(elfHeader.e_machine) + ")";
+        return false;
+    }
+
+    if (elfHeader.e_shoff == 0)
+    {
+        m_error = "Failed to get number of ELF sections. (no section header table)";
+        return false;
+    }
+
+    if (elfHeader.e_shentsize != sizeof(Shdr) || !isInside(m_size, elfHeader.e_shoff, sizeof(Shdr)))
+    {
+        m_error = "Failed to get number of ELF sections. (invalid section header table)";
+        return false;
+    }
+
+    // Extended numbering keeps the real values in the first section header.
+    auto firstSectionHeader = readStruct<Shdr>(m_image, elfHeader.e_shoff);
+
+    uint64_t numberOfSections = elfHeader.e_shnum;
+    if (numberOfSections == 0)
+    {
+        numberOfSections = firstSectionHeader.sh_size;
+    }
+
+    uint64_t sectionNameStringTableIndex = elfHeader.e_shstrndx;
+    if (sectionNameStringTableIndex == SHN_XINDEX)
+    {
+        sectionNameStringTableIndex = firstSectionHeader.sh_link;
+    }
+
+    if (numberOfSections > (m_size - elfHeader.e_shoff) / sizeof(Shdr))
+    {
+        m_error = "Failed to get number of ELF sections. (section header table is outside of the file)";
+        return false;
+    }
+
+    m_sections.reserve(numberOfSections);
+
+    std::vector<uint32_t> sectionNameOffsets;
+    sectionNameOffsets.reserve(numberOfSections);
+
+    const uint64_t tableAlignment = m_is64Bit ? 8 : 4;
+
+    for (uint64_t elfSectionIndex = 0; elfSectionIndex < numberOfSections; ++elfSectionIndex)
+    {
+        auto elfSectionHeader = readStruct<Shdr>(m_image, elfHeader.e_shoff + elfSectionIndex * sizeof(Shdr));
+
+        auto& section = m_sections.emplace_back();
+        section.index = static_cast<unsigned int>(elfSectionIndex);
+        section.type = elfSectionHeader.sh_type;
+        section.flags = elfSectionHeader.sh_flags;
+        section.address = elfSectionHeader.sh_addr;
+        section.offset = elfSectionHeader.sh_offset;
+        section.size = elfSectionHeader.sh_type == SHT_NOBITS ? 0 : elfSectionHeader.sh_size;
+        section.entrySize = elfSectionHeader.sh_entsize;
+        section.link = elfSectionHeader.sh_link;
+        sectionNameOffsets.push_back(elfSectionHeader.sh_name);
+
+        if (!isInside(m_size, section.offset, section.size))
+        {
+            m_error = "Section " + std::to_string(elfSectionIndex) + " is outside of the file.";
+            return false;
+        }
+
+        switch (section.type)
+        {
+        case SHT_SYMTAB:
+        case SHT_DYNSYM:
+        case SHT_REL:
+        case SHT_RELA:
+            if (section.offset % tableAlignment != 0)
+            {
+                m_error = "Section " + std::to_string(elfSectionIndex) + " is misaligned.";
+                return false;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (sectionNameStringTableIndex >= m_sections.size())
+    {
+        m_error = "Failed to get ELF section names. (invalid string table index)";
+        return false;
+    }
+
+    const auto& sectionNameStringTable = m_sections[sectionNameStringTableIndex];
+    for (auto& section : m_sections)
+    {
+        section.name = string(sectionNameStringTable, sectionNameOffsets[section.index]);
+    }
+
+    return true;
+}
+
+const ElfSection *ElfImage::findSection(std::string_view name, uint32_t type) const
+{
+    for (const auto& section : m_sections)
+    {
+        if (section.type == type && section.name == name)
+        {
+            return &section;
+        }
+    }
+
+    return nullptr;
+}
+
+const ElfSection *ElfImage::section(std::size_t index) const
+{
+    return index < m_sections.size() ? &m_sections[index] : nullptr;
+}
+
+std::span<const unsigned char> ElfImage::sectionBytes(const ElfSection &section) const
+{
+    return {reinterpret_cast<const unsigned char *>(m_image) + section.offset, section.size};
+}
+
+std::string_view ElfImage::string(const ElfSection &stringTable, uint64_t offset) const
+{
+    if (offset >= stringTable.size)
+    {
+        return {};
+    }
+
+    auto start = m_image + stringTable.offset + offset;
+    auto end = static_cast<const char *>(std::memchr(start, '\0', stringTable.size - offset));
+    if (!end)
+    {
+        return {};
+    }
+
+    return {start, static_cast<std::size_t>(end - start)};
+}
+
+MemberOffsetIndex readMemberOffsets(const char *image, const std::vector<ElfSection> &sections, std::span<const unsigned char> data, std::vector<std::string> &errors)
+{
+    auto readString = [image, &sections](uint64_t address) -> std::string_view
+    {
+        for (const auto& section : sections)
+        {
+            if (!(section.flags & SHF_ALLOC) || address < section.address || address - section.address >= section.size)
+            {
+                continue;
+            }
+
+            auto start = image + section.offset + (address - section.address);
+            auto end = static_cast<const char *>(std::memchr(start, '\0', section.size - (address - section.address)));
+            if (!end)
+            {
+                return {};
+            }
+
+            return {start, static_cast<std::size_t>(end - start)};
+        }
+
+        return {};
+    };
+
+    std::vector<MemberOffset> entries;
+
+    size_t entry_count = data.size() / sizeof(VTableFieldOffsetDataRaw);
+    entries.reserve(entry_count);
+
+    for (size_t i = 0; i < entry_count; ++i)
+    {
+        VTableFieldOffsetDataRaw entry;
+        std::memcpy(&entry, data.data() + i * sizeof(entry), sizeof(entry));
+
+        auto className = readString(entry.class_name_ptr);
+        auto memberName = readString(entry.member_name_ptr);
+        if (className.empty() || memberName.empty())
+        {
+            errors.push_back(fmt::format("Member offset entry {} has an invalid name pointer", i));
+            continue;
+        }
+
+        entries.push_back({className, memberName, entry.offset});
+    }
+
+    return MemberOffsetIndex(std::move(entries));
+}
+
+// String table a section links to, e.g. .dynstr for .dynsym and .dynamic.
+static const ElfSection *linkedStringTable(const ElfImage &elfImage, const ElfSection *section)
+{
+    auto stringTable = section ? elfImage.section(section->link) : nullptr;
+    return stringTable && stringTable->type == SHT_STRTAB ? stringTable : nullptr;
+}
+
+template <typename Types>
+static std::vector<std::string_view> readNeededLibraries(const ElfImage &elfImage)
+{
+    std::vector<std::string_view> neededLibraries;
+
+    const ElfSection *dynamic = elfImage.findSection(".dynamic", SHT_DYNAMIC);
+    const ElfSection *stringTable = linkedStringTable(elfImage, dynamic);
+    if (!stringTable)
+    {
+        return neededLibraries;
+    }
+
+    for (const auto& entry : elfImage.sectionData<typename Types::Dyn>(*dynamic))
+    {
+        if (entry.d_tag == DT_NULL)
+        {
+            break;
+        }
+
+        if (entry.d_tag == DT_NEEDED)
+        {
+            auto name = elfImage.string(*stringTable, entry.d_un.d_val);
+            if (!name.empty())
+            {
+                neededLibraries.push_back(name);
+            }
+        }
+    }
+
+    return neededLibraries;
+}
+
+template <typename Types>
+static std::vector<SymbolInfo> readExportedSymbols(const ElfImage &elfImage)
+{
+    std::vector<SymbolInfo> exportedSymbols;
+
+    const ElfSection *dynamicSymbolTable = elfImage.findSection(".dynsym", SHT_DYNSYM);
+    const ElfSection *stringTable = linkedStringTable(elfImage, dynamicSymbolTable);
+    if (!stringTable)
+    {
+        return exportedSymbols;
+    }
+
+    for (const auto& symbol : elfImage.sectionData<typename Types::Sym>(*dynamicSymbolTable))
+    {
+        auto binding = ELF32_ST_BIND(symbol.st_info);
+        if (symbol.st_shndx == SHN_UNDEF || symbol.st_value == 0 || (binding != STB_GLOBAL && binding != STB_WEAK))
+        {
+            continue;
+        }
+
+        auto name = elfImage.string(*stringTable, symbol.st_name);
+        if (name.empty())
+        {
+            continue;
+        }
+
+        SymbolInfo symbolInfo;
+        symbolInfo.section = symbol.st_shndx;
+        symbolInfo.address = symbol.st_value;
+        symbolInfo.size = symbol.st_size;
+        symbolInfo.name = name;
+        exportedSymbols.push_back(std::move(symbolInfo));
+    }
+
+    return exportedSymbols;
+}
+
+std::vector<std::string_view> readNeededLibraries(const ElfImage &elfImage)
+{
+    return elfImage.is64Bit() ? readNeededLibraries<Elf64Types>(elfImage) : readNeededLibraries<Elf32Types>(elfImage);
+}
+
+std::vector<SymbolInfo> readExportedSymbols(const ElfImage &elfImage)
+{
+    return elfImage.is64Bit() ? readExportedSymbols<Elf64Types>(elfImage) : readExportedSymbols<Elf32Types>(elfImage);
+}
+
+std::span<const unsigned char> readBuildId(const ElfImage &elfImage)
+{
+    for (const auto& section : elfImage.sections())
+    {
+        if (section.type != SHT_NOTE)
+        {
+            continue;
+        }
+
+        // Notes are a 12 byte header, then the name and descriptor, each padded to 4 bytes.
+        auto notes = elfImage.sectionBytes(section);
+        uint64_t offset = 0;
+        while (notes.size() - offset >= 12)
+        {
+            auto header = readStruct<Elf32_Nhdr>(reinterpret_cast<const char *>(notes.data()), offset);
+            auto nameOffset = offset + 12;
+            auto descriptorOffset = nameOffset + ((header.n_namesz + 3ull) & ~3ull);
+            auto end = descriptorOffset + ((header.n_descsz + 3ull) & ~3ull);
+            if (!isInside(notes.size(), descriptorOffset, header.n_descsz))
+            {
+                break;
+            }
+
+            if (header.n_type == NT_GNU_BUILD_ID && header.n_namesz == 4 && std::memcmp(notes.data() + nameOffset, "GNU", 4) == 0)
+            {
+                return notes.subspan(descriptorOffset, header.n_descsz);
+            }
+
+            offset = std::min<uint64_t>(end, notes.size());
+        }
+    }
+
+    return {};
+}
+
+std::optional<DebugLink> readDebugLink(const ElfImage &elfImage)
+{
+    const ElfSection *debugLink = elfImage.findSection(".gnu_debuglink", SHT_PROGBITS);
+    if (!debugLink)
+    {
+        return std::nullopt;
+    }
+
+    // The name, padded to 4 bytes, then the CRC.
+    auto fileName = elfImage.string(*debugLink, 0);
+    auto crcOffset = (fileName.size() + 4) & ~std::size_t{3};
+    if (fileName.empty() || !isInside(debugLink->size, crcOffset, 4))
+    {
+        return std::nullopt;
+    }
+
+    DebugLink link;
+    link.fileName = fileName;
+    std::memcpy(&link.crc, elfImage.sectionBytes(*debugLink).data() + crcOffset, sizeof(link.crc));
+    return link;
+}
+
+template <typename Types>
+static void readTables(std::shared_ptr<const ElfImage> elfImage, std::shared_ptr<const ElfImage> debugElfImage, std::span<char> image, std::span<char> debugImage, const ReaderOptions &options, ProgramInfo &programInfo)
+{
+    using Sym = typename Types::Sym;
+    using Rel = typename Types::Rel;
+
+    const ElfSection *relocationTable = elfImage->findSection(".rel.dyn", SHT_REL);
+    const ElfSection *dynamicSymbolTable = elfImage->findSection(".dynsym", SHT_DYNSYM);
+    const ElfSection *symbolTable = elfImage->findSection(".symtab", SHT_SYMTAB);
+    const ElfSection *rodata = elfImage->findSection(".rodata", SHT_PROGBITS);
+    const ElfSection *relRodata = elfImage->findSection(".data.rel.ro", SHT_PROGBITS);
+    const ElfSection *memberOffsets = elfImage->findSection(".member_offsets", SHT_PROGBITS);
+
+    // A stripped image has its symbol table in the debug file, which keeps the section numbering of the image.
+    auto symbolImage = elfImage;
+    if (!symbolTable && debugElfImage)
+    {
+        symbolImage = debugElfImage;
+        symbolTable = debugElfImage->findSection(".symtab", SHT_SYMTAB);
+    }
+
+    const ElfSection *stringTable = symbolTable ? symbolImage->section(symbolTable->link) : nullptr;
+    if (stringTable && stringTable->type != SHT_STRTAB)
+    {
+        stringTable = nullptr;
+    }
+
+    if (!symbolTable || !stringTable || !rodata)
+    {
+        programInfo.error = "Failed to find all required ELF sections.";
+        return;
+    }
+
+    // The sections below are decoded on first access. The decoders hold on to the parsed headers, the images are
+    // the caller's.
+    programInfo.memberOffsets = LazySection<MemberOffsetIndex>([elfImage, debugElfImage, memberOffsets, image, debugImage]()
+    {
+        TRACE_SCOPE("read member offsets");
+
+        MemberOffsetIndex memberOffsetIndex;
+        if (memberOffsets)
+        {
+            std::vector<std::string> memberOffsetErrors;
+            memberOffsetIndex = readMemberOffsets(image.data(), elfImage->sections(), elfImage->sectionBytes(*memberOffsets), memberOffsetErrors);
+
+            for (const auto& error : memberOffsetErrors)
+            {
+                std::cerr << error << std::endl;
+            }
+        }
+
+        if (debugElfImage)
+        {
+            addDwarfMemberOffsets(debugImage.data(), debugImage.size(), debugElfImage->sections(), memberOffsetIndex);
+        }
+        else
+        {
+            addDwarfMemberOffsets(image.data(), image.size(), elfImage->sections(), memberOffsetIndex);
+        }
+
+        return memberOffsetIndex;
+    });
+
+    programInfo.relocations = LazySection<std::vector<RelocationInfo>>([elfImage, relocationTable, dynamicSymbolTable]()
+    {
+        TRACE_SCOPE("read relocations");
+
+        std::vector<RelocationInfo> relocationInfos;
+        if (!relocationTable || !dynamicSymbolTable)
+        {
+            return relocationInfos;
+        }
+
+        auto relocations = elfImage->sectionData<Rel>(*relocationTable);
+        auto dynamicSymbols = elfImage->sectionData<Sym>(*dynamicSymbolTable);
+        auto dynamicStringTable = linkedStringTable(*elfImage, dynamicSymbolTable);
+
+        relocationInfos.reserve(relocations.size());
+
+        for (const auto& relocation : relocations)
+        {
+            if (Types::relocationType(relocation.r_info) != R_386_32)
+            {
+                continue;
+            }
+
+            auto symbolIndex = Types::relocationSymbol(relocation.r_info);
+            if (symbolIndex >= dynamicSymbols.size())
+            {
+                continue;
+            }
+
+            RelocationInfo relocationInfo;
+            relocationInfo.address = relocation.r_offset;
+            relocationInfo.target = dynamicSymbols[symbolIndex].st_value;
+
+            if (dynamicSymbols[symbolIndex].st_shndx == SHN_UNDEF && dynamicStringTable)
+            {
+                relocationInfo.importName = elfImage->string(*dynamicStringTable, dynamicSymbols[symbolIndex].st_name);
+            }
+
+            relocationInfos.push_back(std::move(relocationInfo));
+        }
+
+        return relocationInfos;
+    });
+
+    programInfo.symbols = LazySection<std::vector<SymbolInfo>>([symbolImage, symbolTable, stringTable, options]()
+    {
+        // The symbol table is by far the largest section, so it is split into ranges that are merged back in order.
+        auto symbols = symbolImage->sectionData<Sym>(*symbolTable);
+        auto symbolRanges = splitRange(symbols.size(), resolveJobCount(options.jobs), SYMBOLS_PER_TASK);
+
+        std::vector<std::vector<SymbolInfo>> symbolParts(symbolRanges.size());
+        std::vector<std::vector<std::string>> symbolErrors(symbolRanges.size());
+        std::vector<std::function<void()>> tasks;
+
+        for (std::size_t part = 0; part < symbolRanges.size(); ++part)
+        {
+            tasks.emplace_back([&symbolImage, stringTable, symbols, skipUnusedSymbols = options.skipUnusedSymbols, range = symbolRanges[part], &symbolPart = symbolParts[part], &errors = symbolErrors[part]]()
+            {
+                TRACE_SCOPE("read symbols");
+
+                symbolPart.reserve(range.end - range.begin);
+
+                for (std::size_t symbolIndex = range.begin; symbolIndex < range.end; ++symbolIndex)
+                {
+                    const auto& symbol = symbols[symbolIndex];
+
+                    auto name = symbolImage->string(*stringTable, symbol.st_name);
+                    if (name.data() == nullptr)
+                    {
+                        errors.push_back("Failed to read the symbol name for " + std::to_string(symbolIndex + 1) + ". (invalid string offset)");
+                        continue;
+                    }
+
+                    if (skipUnusedSymbols && (symbol.st_value == 0 || symbol.st_size == 0 || name.empty()))
+                    {
+                        continue;
+                    }
+
+                    SymbolInfo symbolInfo;
+                    symbolInfo.section = symbol.st_shndx;
+                    symbolInfo.address = symbol.st_value;
+                    symbolInfo.size = symbol.st_size;
+                    symbolInfo.name = name;
+                    symbolPart.push_back(std::move(symbolInfo));
+                }
+            });
+        }
+
+        runConcurrently(tasks, options.jobs);
+
+        return mergeSymbolParts(symbolParts, symbolErrors);
+    });
+
+    programInfo.rodataStart = rodata->address;
+    programInfo.rodataIndex = rodata->index;
+
+    RodataChunk rodataChunk;
+    rodataChunk.offset = 0;
+    rodataChunk.data = elfImage->sectionBytes(*rodata);
+    programInfo.rodataChunks.push_back(std::move(rodataChunk));
+
+    if (relRodata)
+    {
+        programInfo.relRodataStart = relRodata->address;
+        programInfo.relRodataIndex = relRodata->index;
+
+        RodataChunk relRodataChunk;
+        relRodataChunk.offset = 0;
+        relRodataChunk.data = elfImage->sectionBytes(*relRodata);
+        programInfo.relRodataChunks.push_back(std::move(relRodataChunk));
+    }
+
+    programInfo.neededLibraries = readNeededLibraries<Types>(*elfImage);
+}
+
+ProgramInfo processNative(char *image, std::size_t size, const ReaderOptions &options, std::span<char> debugImage)
+{
+    TRACE_SCOPE("process (native)");
+
+    ProgramInfo programInfo = {};
+
+    auto elfImage = std::make_shared<const ElfImage>(image, size);
+    if (!elfImage->error().empty())
+    {
+        programInfo.error = elfImage->error();
+        return programInfo;
+    }
+
+    programInfo.addressSize = elfImage->addressSize();
+
+    std::shared_ptr<const ElfImage> debugElfImage;
+    if (!debugImage.empty())
+    {
+        debugElfImage = std::make_shared<const ElfImage>(debugImage.data(), debugImage.size());
+        if (!debugElfImage->error().empty() || debugElfImage->is64Bit() != elfImage->is64Bit())
+        {
+            programInfo.warnings.push_back(fmt::format("debug file is ignored - {}", debugElfImage->error().empty() ? "ELF class differs from the library" : debugElfImage->error()));
+            debugElfImage.reset();
+            debugImage = {};
+        }
+    }
+
+    if (elfImage->is64Bit())
+    {
+        readTables<Elf64Types>(elfImage, debugElfImage, {image, size}, debugImage, options, programInfo);
+    }
+    else
+    {
+        readTables<Elf32Types>(elfImage, debugElfImage, {image, size}, debugImage, options, programInfo);
+    }
+
+    return programInfo;
+}
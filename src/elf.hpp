@@ -0,0 +1,91 @@
+#pragma once
+
+#include "reader.hpp"
+
+#include <elf.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ElfSection
+{
+    std::string_view name;
+    unsigned int index;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t address;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t entrySize;
+    uint32_t link;
+};
+
+// Read-only view over an ELF file that is already in memory.
+// Headers and section bounds are validated once, section contents are handed out as spans over the image.
+class ElfImage
+{
+public:
+    ElfImage(const char *image, std::size_t size);
+
+    const std::string& error() const { return m_error; }
+    bool is64Bit() const { return m_is64Bit; }
+    int addressSize() const { return m_addressSize; }
+
+    const std::vector<ElfSection>& sections() const { return m_sections; }
+    const ElfSection *findSection(std::string_view name, uint32_t type) const;
+    const ElfSection *section(std::size_t index) const;
+
+    std::span<const unsigned char> sectionBytes(const ElfSection &section) const;
+
+    template <typename T>
+    std::span<const T> sectionData(const ElfSection &section) const
+    {
+        auto bytes = sectionBytes(section);
+        return {reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    // Returns an empty view if the offset is outside of the string table.
+    std::string_view string(const ElfSection &stringTable, uint64_t offset) const;
+
+private:
+    template <typename Ehdr, typename Shdr>
+    bool readSections();
+
+    const char *m_image;
+    std::size_t m_size;
+    std::string m_error;
+    bool m_is64Bit{false};
+    int m_addressSize{0};
+    std::vector<ElfSection> m_sections;
+};
+
+// Resolves the name pointers of .member_offsets entries through the section headers, skipping entries that point outside of the file.
+MemberOffsetIndex readMemberOffsets(const char *image, const std::vector<ElfSection> &sections, std::span<const unsigned char> data, std::vector<std::string> &errors);
+
+// Sections process() reads, the rest of the file is never touched.
+constexpr std::array<std::string_view, 10> READER_SECTION_NAMES{".shstrtab", ".rel.dyn", ".dynsym", ".dynstr", ".dynamic", ".symtab", ".strtab", ".rodata", ".data.rel.ro", ".member_offsets"};
+
+// DT_NEEDED entries of .dynamic, in order.
+std::vector<std::string_view> readNeededLibraries(const ElfImage &elfImage);
+
+// Defined global and weak symbols of .dynsym, what the library exports to the ones that need it.
+std::vector<SymbolInfo> readExportedSymbols(const ElfImage &elfImage);
+
+// Descriptor of the NT_GNU_BUILD_ID note, empty if the image has none.
+std::span<const unsigned char> readBuildId(const ElfImage &elfImage);
+
+struct DebugLink
+{
+    std::string_view fileName;
+    uint32_t crc;
+};
+
+// Contents of .gnu_debuglink, the name and CRC32 of the separate debug file of a stripped image.
+std::optional<DebugLink> readDebugLink(const ElfImage &elfImage);
+
+ProgramInfo processNative(char *image, std::size_t size, const ReaderOptions &options, std::span<char> debugImage);
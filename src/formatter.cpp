@@ -1,45 +1,120 @@
 #include "formatter.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
 
 #include <algorithm>
+#include <numeric>
+#include <string_view>
 
-bool shouldSkipWindowsFunction(const ClassInfo &classInfo, std::size_t vtableIndex, std::size_t functionIndex, const FunctionInfo &functionInfo)
+// Primary vtable functions without a Windows index: the second of a destructor pair, and the functions a secondary
+// vtable has a thunk for. The thunks are collected once instead of scanned per function.
+static std::vector<bool> getSkippedWindowsFunctions(const FunctionTable &table, const ClassInfo &classInfo)
 {
-    if (functionInfo.name.starts_with('~'))
+    std::vector<uint32_t> thunkNameIds;
+    for (std::size_t n = 1; n < classInfo.vtables.size(); n++)
     {
-        return functionIndex > 0 && functionInfo.name == classInfo.vtables.at(vtableIndex).functions.at(functionIndex - 1)->name;
+        for (const auto function : classInfo.vtables[n].functionIds)
+        {
+            if (table.has(function, FunctionTable::THUNK))
+            {
+                thunkNameIds.push_back(table.nameIds[function]);
+            }
+        }
+    }
+
+    std::ranges::sort(thunkNameIds);
+
+    const auto& functions = classInfo.vtables.at(0).functionIds;
+
+    std::vector<bool> skipped(functions.size());
+    for (std::size_t functionIndex = 0; functionIndex < functions.size(); ++functionIndex)
+    {
+        const auto function = functions[functionIndex];
+        const auto nameId = table.nameIds[function];
+        if (table.has(function, FunctionTable::DESTRUCTOR))
+        {
+            skipped[functionIndex] = functionIndex > 0 && nameId == table.nameIds[functions[functionIndex - 1]];
+        }
+        else
+        {
+            skipped[functionIndex] = !thunkNameIds.empty() && std::ranges::binary_search(thunkNameIds, nameId);
+        }
     }
 
-    for (std::size_t n = 0; n < classInfo.vtables.size(); n++)
+    return skipped;
+}
+
+// Computes Windows indices for the primary vtable from `start` on; `windowsIndices` already holds the ones before it.
+static void computeWindowsIndices(const FunctionTable &table, const ClassInfo &classInfo, const std::vector<bool> &skipped, std::size_t start, std::vector<std::optional<int>> &windowsIndices)
+{
+    const auto& functions = classInfo.vtables.at(0).functionIds;
+
+    int windowsIndex = static_cast<int>(std::count(skipped.begin(), skipped.begin() + start, false));
+
+    windowsIndices.resize(functions.size());
+
+    for (int linuxIndex = static_cast<int>(start); linuxIndex < static_cast<int>(functions.size()); ++linuxIndex)
     {
-        if (n > vtableIndex)
+        auto function = functions[linuxIndex];
+
+        auto displayWindowsIndex = windowsIndex;
+        if (skipped[linuxIndex])
+        {
+            windowsIndices[linuxIndex] = std::nullopt;
+            continue;
+        }
+
+        if ((table.flags[function] & (FunctionTable::HAS_SYMBOL | FunctionTable::MULTI)) == FunctionTable::HAS_SYMBOL)
         {
-            auto functions = classInfo.vtables.at(n).functions;
-            auto it = std::find_if(functions.begin(), functions.end(), [&functionInfo](const FunctionInfo *d)
+            const auto shortNameId = table.shortNameIds[function];
+
+            int previousOverloads = 0;
+            int remainingOverloads = 0;
+
+            while ((linuxIndex - (1 + previousOverloads)) >= 0)
             {
-                return d->isThunk && d->name == functionInfo.name;
-            });
+                const auto previousFunctionIndex = linuxIndex - (1 + previousOverloads);
+
+                if (skipped[previousFunctionIndex] || shortNameId != table.shortNameIds[functions[previousFunctionIndex]])
+                {
+                    break;
+                }
+
+                previousOverloads++;
+            }
 
-            if (it != functions.end())
+            while ((linuxIndex + 1 + remainingOverloads) < static_cast<int>(functions.size()))
             {
-                return true;
+                const auto nextFunctionIndex = linuxIndex + 1 + remainingOverloads;
+
+                if (skipped[nextFunctionIndex] || shortNameId != table.shortNameIds[functions[nextFunctionIndex]])
+                {
+                    break;
+                }
+
+                remainingOverloads++;
             }
+
+            displayWindowsIndex -= previousOverloads;
+            displayWindowsIndex += remainingOverloads;
         }
-    }
 
-    return false;
+        windowsIndex++;
+
+        windowsIndices[linuxIndex] = displayWindowsIndex;
+    }
 }
 
-std::vector<Out2> formatVTable(const ClassInfo &classInfo)
+static std::vector<Out2> makeVTable(const ClassInfo &classInfo, const std::vector<std::optional<int>> &windowsIndices)
 {
-    std::vector<Out2> vtable;
+    const auto& functions = classInfo.vtables.at(0).functions;
 
-    std::size_t vtableIndex = 0;
-    auto vtableInfo = classInfo.vtables.at(vtableIndex);
+    std::vector<Out2> vtable;
+    vtable.reserve(functions.size());
 
-    int windowsIndex = 0;
-    for (int linuxIndex = 0; linuxIndex < static_cast<int>(vtableInfo.functions.size()); ++linuxIndex)
+    for (int linuxIndex = 0; linuxIndex < static_cast<int>(functions.size()); ++linuxIndex)
     {
-        auto functionInfo = vtableInfo.functions.at(linuxIndex);
+        auto functionInfo = functions[linuxIndex];
 
         Out2 function;
         function.id = functionInfo->id;
@@ -48,67 +123,192 @@ std::vector<Out2> formatVTable(const ClassInfo &classInfo)
         function.shortName = functionInfo->shortName;
         function.nameSpace = functionInfo->nameSpace;
         function.isMulti = functionInfo->isMulti;
+        function.linuxIndex = linuxIndex;
+        function.windowsIndex = windowsIndices[linuxIndex];
+        vtable.push_back(std::move(function));
+    }
 
-        auto displayWindowsIndex = windowsIndex;
-        if (shouldSkipWindowsFunction(classInfo, vtableIndex, linuxIndex, *functionInfo))
-        {
-            function.windowsIndex = std::nullopt;
-        }
-        else
+    return vtable;
+}
+
+std::vector<Out2> formatVTable(const FunctionTable &table, const ClassInfo &classInfo)
+{
+    TRACE_SCOPE("formatVTable", classInfo.name);
+
+    auto skipped = getSkippedWindowsFunctions(table, classInfo);
+
+    std::vector<std::optional<int>> windowsIndices;
+    computeWindowsIndices(table, classInfo, skipped, 0, windowsIndices);
+
+    return makeVTable(classInfo, windowsIndices);
+}
+
+// Trie over primary vtables, one level per function.
+struct VTableFormatter::Node
+{
+    struct Result
+    {
+        std::vector<bool> skipped;
+        std::vector<std::optional<int>> windowsIndices;
+    };
+
+    std::vector<std::pair<FunctionId, std::unique_ptr<Node>>> children;
+    std::unique_ptr<Result> result; // Class whose primary vtable ends here
+    const Result *firstResult{}; // First class whose primary vtable goes through here
+
+    Node *child(FunctionId function)
+    {
+        for (auto& [childFunction, node] : children)
         {
-            if (!functionInfo->symbol.name.empty() && !functionInfo->isMulti)
+            if (childFunction == function)
             {
-                int previousOverloads = 0;
-                int remainingOverloads = 0;
+                return node.get();
+            }
+        }
 
-                while ((linuxIndex - (1 + previousOverloads)) >= 0)
-                {
-                    const auto previousFunctionIndex = linuxIndex - (1 + previousOverloads);
-                    const auto previousFunctionInfo = vtableInfo.functions.at(previousFunctionIndex);
+        return children.emplace_back(function, std::make_unique<Node>()).second.get();
+    }
+};
 
-                    if (functionInfo->symbol.name.empty() || shouldSkipWindowsFunction(classInfo, vtableIndex, previousFunctionIndex, *previousFunctionInfo))
-                    {
-                        break;
-                    }
+VTableFormatter::VTableFormatter(const FunctionTable &table) : m_table{table}, m_root{std::make_unique<Node>()}
+{
 
-                    if (functionInfo->shortName != previousFunctionInfo->shortName)
-                    {
-                        break;
-                    }
+}
 
-                    previousOverloads++;
-                }
+VTableFormatter::~VTableFormatter() = default;
 
-                while ((linuxIndex + 1 + remainingOverloads) < static_cast<int>(vtableInfo.functions.size()))
-                {
-                    const auto nextFunctionIndex = linuxIndex + 1 + remainingOverloads;
-                    const auto nextFunctionInfo = vtableInfo.functions.at(nextFunctionIndex);
+std::vector<Out2> VTableFormatter::format(const ClassInfo &classInfo)
+{
+    TRACE_SCOPE("formatVTable", classInfo.name);
 
-                    if (functionInfo->symbol.name.empty() || shouldSkipWindowsFunction(classInfo, vtableIndex, nextFunctionIndex, *nextFunctionInfo))
-                    {
-                        break;
-                    }
+    const auto& functions = classInfo.vtables.at(0).functionIds;
 
-                    if (functionInfo->shortName != nextFunctionInfo->shortName)
-                    {
-                        break;
-                    }
+    auto skipped = getSkippedWindowsFunctions(m_table, classInfo);
 
-                    remainingOverloads++;
-                }
+    // Identical vtables share their storage, so a slice seen before doesn't need the trie walk.
+    auto sliceNode = functions.empty() ? m_nodesBySlice.end() : m_nodesBySlice.find(functions.data());
+    if (sliceNode != m_nodesBySlice.end() && sliceNode->second->result && sliceNode->second->result->skipped == skipped)
+    {
+        return makeVTable(classInfo, sliceNode->second->result->windowsIndices);
+    }
+
+    std::vector<Node*> path;
+    path.reserve(functions.size());
+
+    auto node = m_root.get();
+    for (const auto function : functions)
+    {
+        node = node->child(function);
+        path.push_back(node);
+    }
+
+    if (!functions.empty())
+    {
+        m_nodesBySlice.emplace(functions.data(), node);
+    }
+
+    if (node->result && node->result->skipped == skipped)
+    {
+        return makeVTable(classInfo, node->result->windowsIndices);
+    }
+
+    // Any class sharing the first `length` functions and their skip flags has the same Windows indices there,
+    // except for the overload run that reaches the end of the shared part, it may continue differently after it.
+    std::vector<std::optional<int>> windowsIndices;
+    std::size_t start = 0;
+
+    const Node::Result *checked = nullptr;
+    for (auto length = path.size(); length > 0; --length)
+    {
+        auto result = path[length - 1]->firstResult;
+        if (!result || result == checked)
+        {
+            continue;
+        }
+
+        checked = result;
+
+        if (!std::equal(skipped.begin(), skipped.begin() + length, result->skipped.begin()))
+        {
+            continue;
+        }
 
-                displayWindowsIndex -= previousOverloads;
-                displayWindowsIndex += remainingOverloads;
+        start = length - 1;
+        while (start > 0 && !skipped[start] && m_table.shortNameIds[functions[start - 1]] == m_table.shortNameIds[functions[start]])
+        {
+            start--;
+        }
+
+        windowsIndices.assign(result->windowsIndices.begin(), result->windowsIndices.begin() + start);
+        break;
+    }
+
+    computeWindowsIndices(m_table, classInfo, skipped, start, windowsIndices);
+
+    if (!node->result && !path.empty())
+    {
+        node->result = std::make_unique<Node::Result>(Node::Result{std::move(skipped), windowsIndices});
+        for (auto pathNode : path)
+        {
+            if (!pathNode->firstResult)
+            {
+                pathNode->firstResult = node->result.get();
             }
+        }
+    }
+
+    return makeVTable(classInfo, windowsIndices);
+}
+
+ParallelFormatter::ParallelFormatter(const FunctionTable &table, const ClassHierarchy &hierarchy, unsigned int jobs) :
+    m_table{table}, m_hierarchy{hierarchy}, m_jobs{jobs}
+{
 
-            windowsIndex++;
+}
 
-            function.windowsIndex = displayWindowsIndex;
+void ParallelFormatter::format(std::span<const ClassInfo* const> classes, const std::function<void(VTableFormatter&, std::size_t)> &format)
+{
+    // The hierarchy is filled in when the parse starts, which may be after construction for streamed classes.
+    const auto& order = m_hierarchy.topologicalOrder();
+    if (m_rank.size() != m_hierarchy.types().size())
+    {
+        m_rank.assign(m_hierarchy.types().size(), ClassHierarchy::NONE);
+        for (std::size_t position = 0; position < order.size(); ++position)
+        {
+            m_rank[order[position]] = static_cast<uint32_t>(position);
         }
+    }
 
-        function.linuxIndex = linuxIndex;
-        vtable.push_back(function);
+    auto rank = [&](const ClassInfo *classInfo)
+    {
+        return classInfo->type == ClassHierarchy::NONE ? ClassHierarchy::NONE : m_rank[classInfo->type];
+    };
+
+    std::vector<std::size_t> ordered(classes.size());
+    std::iota(ordered.begin(), ordered.end(), std::size_t{0});
+    std::stable_sort(ordered.begin(), ordered.end(), [&](std::size_t a, std::size_t b)
+    {
+        return rank(classes[a]) < rank(classes[b]);
+    });
+
+    auto ranges = splitRange(classes.size(), resolveJobCount(m_jobs), CLASSES_PER_TASK);
+    while (m_formatters.size() < ranges.size())
+    {
+        m_formatters.push_back(std::make_unique<VTableFormatter>(m_table));
     }
 
-    return vtable;
+    // One run per formatter: it reuses what it computed for the bases formatted before in the same run.
+    std::vector<std::function<void()>> tasks;
+    for (std::size_t rangeIndex = 0; rangeIndex < ranges.size(); ++rangeIndex)
+    {
+        tasks.emplace_back([&format, &ordered, &formatter = *m_formatters[rangeIndex], range = ranges[rangeIndex]]
+        {
+            for (auto index = range.begin; index < range.end; ++index)
+            {
+                format(formatter, ordered[index]);
+            }
+        });
+    }
+
+    runConcurrently(tasks, m_jobs);
 }
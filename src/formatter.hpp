@@ -1,11 +1,15 @@
+#pragma once
+
 #include "parser.hpp"
 
+#include <functional>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
-bool shouldSkipWindowsFunction(const ClassInfo &classInfo, std::size_t vtableIndex, std::size_t functionIndex, const FunctionInfo &functionInfo);
-
 // TODO rename
 struct Out2
 {
@@ -19,4 +23,45 @@ struct Out2
     std::optional<int> windowsIndex;
 };
 
-std::vector<Out2> formatVTable(const ClassInfo &classInfo);
\ No newline at end of file
+std::vector<Out2> formatVTable(const FunctionTable &table, const ClassInfo &classInfo);
+
+// Formats many classes, reusing the Windows indices computed for an earlier class whose primary vtable is a prefix of
+// the current one (a base class, as long as the derived class doesn't add thunks that change the base part).
+// Only the tail, and the overload run touching the boundary, is computed again. Results match formatVTable().
+class VTableFormatter
+{
+public:
+    explicit VTableFormatter(const FunctionTable &table);
+    ~VTableFormatter();
+
+    std::vector<Out2> format(const ClassInfo &classInfo);
+
+private:
+    struct Node;
+
+    const FunctionTable &m_table;
+    std::unique_ptr<Node> m_root;
+    std::unordered_map<const FunctionId*, Node*> m_nodesBySlice;
+};
+
+// Fewest classes formatted by a single task.
+constexpr std::size_t CLASSES_PER_TASK = 64;
+
+// Formats classes on up to `jobs` threads (0 = one per core). Each thread formats a contiguous run of classes with its
+// own VTableFormatter, kept between calls so that classes formatted in batches still reuse the earlier batches.
+// Classes are formatted in the hierarchy's topological order, so a base comes before its derived classes in a run.
+class ParallelFormatter
+{
+public:
+    ParallelFormatter(const FunctionTable &table, const ClassHierarchy &hierarchy, unsigned int jobs);
+
+    // Calls `format(formatter, index)` for every class; callers store results by index to keep the class order.
+    void format(std::span<const ClassInfo* const> classes, const std::function<void(VTableFormatter&, std::size_t)> &format);
+
+private:
+    const FunctionTable &m_table;
+    const ClassHierarchy &m_hierarchy;
+    unsigned int m_jobs;
+    std::vector<uint32_t> m_rank; // Position of each type in the topological order
+    std::vector<std::unique_ptr<VTableFormatter>> m_formatters;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// Values produced by a coroutine one at a time, for range-for loops; a minimal C++23 std::generator.
+// The coroutine runs up to its next co_yield each time the iterator is incremented, and a value yielded by reference
+// stays valid until then. Exceptions thrown by the coroutine come out of begin() or operator++.
+template<typename T>
+class Generator
+{
+public:
+    using value_type = std::remove_cvref_t<T>;
+    using reference = std::conditional_t<std::is_reference_v<T>, T, const value_type&>;
+
+    struct promise_type
+    {
+        std::add_pointer_t<reference> value{};
+        std::exception_ptr exception;
+
+        Generator get_return_object() { return Generator{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        std::suspend_always yield_value(reference yielded) noexcept
+        {
+            value = std::addressof(yielded);
+            return {};
+        }
+
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+
+        // Nothing to await, only co_yield.
+        template<typename U>
+        std::suspend_never await_transform(U&&) = delete;
+    };
+
+    class Iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = Generator::value_type;
+
+        Iterator() = default;
+        explicit Iterator(std::coroutine_handle<promise_type> coroutine) : m_coroutine{coroutine} {}
+
+        reference operator*() const { return static_cast<reference>(*m_coroutine.promise().value); }
+
+        Iterator& operator++()
+        {
+            resume(m_coroutine);
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return !m_coroutine || m_coroutine.done(); }
+
+    private:
+        std::coroutine_handle<promise_type> m_coroutine;
+    };
+
+    Generator(Generator&& other) noexcept : m_coroutine{std::exchange(other.m_coroutine, {})} {}
+
+    Generator& operator=(Generator&& other) noexcept
+    {
+        std::swap(m_coroutine, other.m_coroutine);
+        return *this;
+    }
+
+    ~Generator()
+    {
+        if (m_coroutine)
+        {
+            m_coroutine.destroy();
+        }
+    }
+
+    // Runs the coroutine up to its first co_yield, call it once.
+    Iterator begin()
+    {
+        resume(m_coroutine);
+        return Iterator{m_coroutine};
+    }
+
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    explicit Generator(std::coroutine_handle<promise_type> coroutine) : m_coroutine{coroutine} {}
+
+    static void resume(std::coroutine_handle<promise_type> coroutine)
+    {
+        coroutine.resume();
+
+        if (coroutine.done() && coroutine.promise().exception)
+        {
+            std::rethrow_exception(std::exchange(coroutine.promise().exception, {}));
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_coroutine;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a, stable across runs and platforms so it can be stored in files.
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t hashBytes(const void *data, std::size_t size, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+inline uint64_t hashString(std::string_view text, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    return hashBytes(text.data(), text.size(), hash);
+}
+
+// Mixes the bits of an FNV hash so that the low bits can be used directly as a table index.
+inline uint64_t finalizeHash(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
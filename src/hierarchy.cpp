@@ -0,0 +1,142 @@
+#include "hierarchy.hpp"
+
+#include <algorithm>
+
+// Turns (from, to) pairs into a start array and a flat array, keeping the input order per row.
+template <typename T, typename GetRow, typename GetValue>
+static void buildAdjacency(std::size_t rows, const std::vector<T> &pairs, GetRow getRow, GetValue getValue, std::vector<uint32_t> &start, auto &values)
+{
+    start.assign(rows + 1, 0);
+    for (const auto& pair : pairs)
+    {
+        start[getRow(pair) + 1]++;
+    }
+
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        start[row + 1] += start[row];
+    }
+
+    values.resize(pairs.size());
+
+    std::vector<uint32_t> next(start.begin(), start.end() - 1);
+    for (const auto& pair : pairs)
+    {
+        values[next[getRow(pair)]++] = getValue(pair);
+    }
+}
+
+ClassHierarchy::ClassHierarchy(std::vector<TypeInfo> types, const std::vector<std::pair<uint32_t, BaseClass>> &edges) : m_types{std::move(types)}
+{
+    auto count = m_types.size();
+
+    buildAdjacency(count, edges, [](const auto& edge) { return edge.first; }, [](const auto& edge) { return edge.second; }, m_baseStart, m_bases);
+    buildAdjacency(count, edges, [](const auto& edge) { return edge.second.type; }, [](const auto& edge) { return edge.first; }, m_derivedStart, m_derived);
+
+    // Kahn's algorithm, a class is ready once all of its bases are.
+    std::vector<uint32_t> pendingBases(count);
+    for (uint32_t type = 0; type < count; ++type)
+    {
+        pendingBases[type] = m_baseStart[type + 1] - m_baseStart[type];
+        if (pendingBases[type] == 0)
+        {
+            m_order.push_back(type);
+        }
+    }
+
+    for (std::size_t orderIndex = 0; orderIndex < m_order.size(); ++orderIndex)
+    {
+        for (auto derivedType : derived(m_order[orderIndex]))
+        {
+            if (--pendingBases[derivedType] == 0)
+            {
+                m_order.push_back(derivedType);
+            }
+        }
+    }
+
+    std::vector<bool> ordered(count);
+    for (auto type : m_order)
+    {
+        ordered[type] = true;
+    }
+
+    auto acyclic = m_order.size();
+    for (uint32_t type = 0; type < count; ++type)
+    {
+        if (!ordered[type])
+        {
+            m_order.push_back(type);
+        }
+    }
+
+    // Ancestors of a class are its bases and their ancestors, which are complete by the time it is reached.
+    std::vector<std::vector<uint32_t>> ancestorSets(count);
+    for (std::size_t orderIndex = 0; orderIndex < acyclic; ++orderIndex)
+    {
+        auto type = m_order[orderIndex];
+        auto& ancestorSet = ancestorSets[type];
+
+        for (const auto& base : bases(type))
+        {
+            ancestorSet.push_back(base.type);
+            ancestorSet.insert(ancestorSet.end(), ancestorSets[base.type].begin(), ancestorSets[base.type].end());
+        }
+
+        std::ranges::sort(ancestorSet);
+        ancestorSet.erase(std::unique(ancestorSet.begin(), ancestorSet.end()), ancestorSet.end());
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> ancestry;
+    for (uint32_t type = 0; type < count; ++type)
+    {
+        for (auto ancestor : ancestorSets[type])
+        {
+            ancestry.emplace_back(type, ancestor);
+        }
+    }
+
+    buildAdjacency(count, ancestry, [](const auto& pair) { return pair.first; }, [](const auto& pair) { return pair.second; }, m_ancestorStart, m_ancestors);
+    buildAdjacency(count, ancestry, [](const auto& pair) { return pair.second; }, [](const auto& pair) { return pair.first; }, m_descendantStart, m_descendants);
+}
+
+uint32_t ClassHierarchy::find(LargeNumber id) const
+{
+    auto it = std::ranges::lower_bound(m_types, static_cast<unsigned long long>(id), {}, [](const TypeInfo &type) { return static_cast<unsigned long long>(type.id); });
+    if (it == m_types.end() || static_cast<unsigned long long>(it->id) != static_cast<unsigned long long>(id))
+    {
+        return NONE;
+    }
+
+    return static_cast<uint32_t>(it - m_types.begin());
+}
+
+void ClassHierarchy::attach(uint32_t type, ClassInfo *classInfo)
+{
+    m_types.at(type).classInfo = classInfo;
+}
+
+std::span<const BaseClass> ClassHierarchy::bases(uint32_t type) const
+{
+    return std::span(m_bases).subspan(m_baseStart[type], m_baseStart[type + 1] - m_baseStart[type]);
+}
+
+std::span<const uint32_t> ClassHierarchy::derived(uint32_t type) const
+{
+    return std::span(m_derived).subspan(m_derivedStart[type], m_derivedStart[type + 1] - m_derivedStart[type]);
+}
+
+std::span<const uint32_t> ClassHierarchy::ancestors(uint32_t type) const
+{
+    return std::span(m_ancestors).subspan(m_ancestorStart[type], m_ancestorStart[type + 1] - m_ancestorStart[type]);
+}
+
+std::span<const uint32_t> ClassHierarchy::descendants(uint32_t type) const
+{
+    return std::span(m_descendants).subspan(m_descendantStart[type], m_descendantStart[type + 1] - m_descendantStart[type]);
+}
+
+bool ClassHierarchy::isAncestor(uint32_t ancestor, uint32_t type) const
+{
+    return std::ranges::binary_search(ancestors(type), ancestor);
+}
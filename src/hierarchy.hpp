@@ -0,0 +1,63 @@
+#pragma once
+
+#include "reader.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+struct ClassInfo;
+
+struct TypeInfo
+{
+    LargeNumber id; // Address of the typeinfo object
+    std::string_view symbol; // _ZTI..., points into the input image
+    ClassInfo *classInfo; // Null if the vtable isn't in this binary
+};
+
+struct BaseClass
+{
+    uint32_t type;
+    int64_t offset; // Offset of the base subobject, for virtual bases the offset of its vbase offset from the address point
+    bool isVirtual;
+    bool isPublic;
+};
+
+// Class graph decoded from __si_class_type_info/__vmi_class_type_info, stored as adjacency arrays indexed by type.
+class ClassHierarchy
+{
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    ClassHierarchy() = default;
+    ClassHierarchy(std::vector<TypeInfo> types, const std::vector<std::pair<uint32_t, BaseClass>> &edges);
+
+    const std::vector<TypeInfo>& types() const { return m_types; }
+    uint32_t find(LargeNumber id) const;
+    void attach(uint32_t type, ClassInfo *classInfo);
+
+    std::span<const BaseClass> bases(uint32_t type) const;
+    std::span<const uint32_t> derived(uint32_t type) const;
+
+    // Transitive, sorted by type index.
+    std::span<const uint32_t> ancestors(uint32_t type) const;
+    std::span<const uint32_t> descendants(uint32_t type) const;
+    bool isAncestor(uint32_t ancestor, uint32_t type) const;
+
+    // Bases before derived classes; types on a cycle (broken input) come last.
+    const std::vector<uint32_t>& topologicalOrder() const { return m_order; }
+
+private:
+    std::vector<TypeInfo> m_types; // Sorted by id
+    std::vector<uint32_t> m_baseStart;
+    std::vector<BaseClass> m_bases;
+    std::vector<uint32_t> m_derivedStart;
+    std::vector<uint32_t> m_derived;
+    std::vector<uint32_t> m_ancestorStart;
+    std::vector<uint32_t> m_ancestors;
+    std::vector<uint32_t> m_descendantStart;
+    std::vector<uint32_t> m_descendants;
+    std::vector<uint32_t> m_order;
+};
@@ -0,0 +1,416 @@
+#include "history.hpp"
+#include "hash.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+// Both files start with a magic, integers are stored in host byte order.
+constexpr std::string_view BUILDS_MAGIC{"GDBUILD1"};
+constexpr std::string_view TABLES_MAGIC{"GDTABLE1"};
+
+// A build record is its payload size, the FNV hash of the payload, then the payload:
+//   name, time, entry count, entries of (class name, table hash, table offset, table size)
+constexpr std::size_t RECORD_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t);
+
+template<typename T>
+static void put(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void putString(std::string& out, std::string_view text)
+{
+    put(out, static_cast<uint32_t>(text.size()));
+    out.append(text);
+}
+
+// Reads what put() wrote, every read fails once one ran past the end.
+class RecordReader
+{
+public:
+    explicit RecordReader(std::string_view data) : m_data{data} {}
+
+    template<typename T>
+    T get()
+    {
+        T value{};
+        if (m_data.size() < sizeof(value))
+        {
+            m_failed = true;
+            m_data = {};
+            return value;
+        }
+
+        std::memcpy(&value, m_data.data(), sizeof(value));
+        m_data.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    std::string_view getString()
+    {
+        auto size = get<uint32_t>();
+        if (m_data.size() < size)
+        {
+            m_failed = true;
+            m_data = {};
+            return {};
+        }
+
+        auto text = m_data.substr(0, size);
+        m_data.remove_prefix(size);
+        return text;
+    }
+
+    bool failed() const { return m_failed; }
+
+private:
+    std::string_view m_data;
+    bool m_failed{false};
+};
+
+// A table is its entry count, a directory of entries sorted by key, then the keys. A key is the namespace and function
+// name separated by a NUL, so a lookup binary-searches the directory instead of going through every function.
+struct TableEntry
+{
+    uint32_t keyOffset; // Into the keys
+    uint32_t keySize;
+    int32_t linuxIndex;
+    int32_t windowsIndex;
+};
+
+static std::string tableKey(std::string_view namespaceName, std::string_view functionName)
+{
+    std::string key;
+    key.reserve(namespaceName.size() + 1 + functionName.size());
+    key.append(namespaceName);
+    key += '\0';
+    key.append(functionName);
+    return key;
+}
+
+static std::string encodeTable(const ClassVTables& classVTables)
+{
+    // The maps iterate by namespace, then function, which is the order of the keys as well.
+    std::string directory;
+    std::string keys;
+    uint32_t entryCount = 0;
+    for (const auto& [namespaceName, classNamespace] : classVTables)
+    {
+        for (const auto& [functionName, offsets] : classNamespace)
+        {
+            auto key = tableKey(namespaceName, functionName);
+            put(directory, TableEntry{static_cast<uint32_t>(keys.size()), static_cast<uint32_t>(key.size()), offsets.linuxIndex, offsets.windowsIndex});
+            keys += key;
+            entryCount++;
+        }
+    }
+
+    std::string table;
+    put(table, entryCount);
+    table += directory;
+    table += keys;
+    return table;
+}
+
+static std::optional<FunctionOffsets> findInTable(std::string_view table, std::string_view namespaceName, std::string_view functionName)
+{
+    RecordReader reader(table);
+    auto entryCount = reader.get<uint32_t>();
+    if (reader.failed() || entryCount > (table.size() - sizeof(uint32_t)) / sizeof(TableEntry))
+    {
+        return std::nullopt;
+    }
+
+    auto directory = table.substr(sizeof(uint32_t), entryCount * sizeof(TableEntry));
+    auto keys = table.substr(sizeof(uint32_t) + directory.size());
+    auto key = tableKey(namespaceName, functionName);
+
+    uint32_t low = 0;
+    uint32_t high = entryCount;
+    while (low < high)
+    {
+        auto middle = low + (high - low) / 2;
+
+        TableEntry entry;
+        std::memcpy(&entry, directory.data() + middle * sizeof(TableEntry), sizeof(entry));
+        if (entry.keyOffset > keys.size() || entry.keySize > keys.size() - entry.keyOffset)
+        {
+            return std::nullopt;
+        }
+
+        auto order = keys.substr(entry.keyOffset, entry.keySize).compare(key);
+        if (order == 0)
+        {
+            return FunctionOffsets{entry.linuxIndex, entry.windowsIndex};
+        }
+
+        if (order < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return std::nullopt;
+}
+
+static void appendFile(const std::filesystem::path& path, std::string_view contents)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    file.flush();
+
+    if (!file)
+    {
+        throw std::runtime_error(fmt::format("Failed to write history file \"{}\": {} (errno={})", path.string(), strerror(errno), errno));
+    }
+}
+
+HistoryStore::HistoryStore(std::filesystem::path path) : m_buildsPath{path / "builds"}, m_tablesPath{path / "tables"}
+{
+    std::error_code error;
+    std::filesystem::create_directories(path, error);
+    if (error)
+    {
+        throw std::runtime_error(fmt::format("Failed to create history store \"{}\": {}", path.string(), error.message()));
+    }
+
+    if (std::filesystem::exists(m_buildsPath) && std::filesystem::file_size(m_buildsPath) != 0)
+    {
+        readBuilds();
+    }
+
+    if (std::filesystem::exists(m_tablesPath))
+    {
+        std::string magic(TABLES_MAGIC.size(), '\0');
+        std::ifstream file(m_tablesPath, std::ios::binary);
+        file.read(magic.data(), static_cast<std::streamsize>(magic.size()));
+        if (!file || magic != TABLES_MAGIC)
+        {
+            throw std::runtime_error(fmt::format("\"{}\" is not a gamedata-gen history file", m_tablesPath.string()));
+        }
+    }
+}
+
+void HistoryStore::readBuilds()
+{
+    std::ifstream file(m_buildsPath, std::ios::binary);
+    m_buildsData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    const auto& data = m_buildsData;
+    if (file.bad())
+    {
+        throw std::runtime_error(fmt::format("Failed to read history file \"{}\": {} (errno={})", m_buildsPath.string(), strerror(errno), errno));
+    }
+
+    if (!data.starts_with(BUILDS_MAGIC))
+    {
+        throw std::runtime_error(fmt::format("\"{}\" is not a gamedata-gen history file", m_buildsPath.string()));
+    }
+
+    std::string_view records{data};
+    records.remove_prefix(BUILDS_MAGIC.size());
+    m_buildsSize = BUILDS_MAGIC.size();
+
+    while (!records.empty())
+    {
+        RecordReader header(records);
+        auto payloadSize = header.get<uint32_t>();
+        auto payloadHash = header.get<uint64_t>();
+        auto payload = records.substr(std::min(RECORD_HEADER_SIZE, records.size())).substr(0, payloadSize);
+
+        // Only the last record can be incomplete, when a write was interrupted. It is overwritten by the next one.
+        if (header.failed() || payload.size() != payloadSize || hashString(payload) != payloadHash)
+        {
+            std::cerr << fmt::format("Warning: ignoring a damaged build record at offset {} of history file {}", m_buildsSize, m_buildsPath.string()) << std::endl;
+            break;
+        }
+
+        RecordReader reader(payload);
+        auto build = m_builds.size();
+        auto& buildInfo = m_builds.emplace_back();
+        buildInfo.name = reader.getString();
+        buildInfo.time = reader.get<int64_t>();
+
+        auto entryCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < entryCount && !reader.failed(); i++)
+        {
+            auto className = reader.getString();
+            TableRef table;
+            table.hash = reader.get<uint64_t>();
+            table.offset = reader.get<uint64_t>();
+            table.size = reader.get<uint32_t>();
+
+            m_classes[className].push_back({build, table});
+
+            if (table.size != 0)
+            {
+                m_tables.emplace(table.hash, table);
+            }
+        }
+
+        records.remove_prefix(RECORD_HEADER_SIZE + payloadSize);
+        m_buildsSize += RECORD_HEADER_SIZE + payloadSize;
+    }
+}
+
+std::size_t HistoryStore::record(std::string_view buildName, const Offsets& offsets)
+{
+    if (!std::filesystem::exists(m_tablesPath))
+    {
+        appendFile(m_tablesPath, TABLES_MAGIC);
+    }
+
+    auto tablesSize = std::filesystem::file_size(m_tablesPath);
+    auto build = m_builds.size();
+
+    // Nothing changes in memory before both files are written.
+    std::string newTables;
+    std::unordered_map<uint64_t, TableRef> addedTables;
+    std::vector<std::pair<std::string_view, TableRef>> entries;
+
+    for (const auto& [className, classVTables] : offsets)
+    {
+        auto table = encodeTable(classVTables);
+        auto hash = hashString(table);
+
+        auto changes = m_classes.find(className);
+        if (changes != m_classes.end() && changes->second.back().table.size != 0 && changes->second.back().table.hash == hash)
+        {
+            continue;
+        }
+
+        auto stored = m_tables.find(hash);
+        if (stored != m_tables.end())
+        {
+            entries.emplace_back(className, stored->second);
+            continue;
+        }
+
+        auto added = addedTables.find(hash);
+        if (added == addedTables.end())
+        {
+            added = addedTables.emplace(hash, TableRef{hash, tablesSize + newTables.size(), static_cast<uint32_t>(table.size())}).first;
+            newTables += table;
+        }
+        entries.emplace_back(className, added->second);
+    }
+
+    for (const auto& [className, changes] : m_classes)
+    {
+        if (changes.back().table.size != 0 && !offsets.contains(className))
+        {
+            entries.emplace_back(className, TableRef{});
+        }
+    }
+
+    std::string payload;
+    putString(payload, buildName);
+    auto time = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    put(payload, static_cast<int64_t>(time));
+    put(payload, static_cast<uint32_t>(entries.size()));
+    for (const auto& [className, table] : entries)
+    {
+        putString(payload, className);
+        put(payload, table.hash);
+        put(payload, table.offset);
+        put(payload, table.size);
+    }
+
+    std::string buildRecord;
+    if (m_buildsSize == 0)
+    {
+        buildRecord += BUILDS_MAGIC;
+    }
+    put(buildRecord, static_cast<uint32_t>(payload.size()));
+    put(buildRecord, hashString(payload));
+    buildRecord += payload;
+
+    // Tables first, a build record is only ever written after the tables it refers to.
+    appendFile(m_tablesPath, newTables);
+
+    if (std::filesystem::exists(m_buildsPath) && std::filesystem::file_size(m_buildsPath) != m_buildsSize)
+    {
+        std::filesystem::resize_file(m_buildsPath, m_buildsSize);
+    }
+    appendFile(m_buildsPath, buildRecord);
+
+    m_buildsSize += buildRecord.size();
+    m_builds.push_back({std::string(buildName), static_cast<int64_t>(time)});
+    for (const auto& [className, table] : entries)
+    {
+        auto changes = m_classes.find(className);
+        if (changes == m_classes.end())
+        {
+            changes = m_classes.emplace(m_recordedNames.emplace_back(className), std::vector<ClassChange>{}).first;
+        }
+        changes->second.push_back({build, table});
+    }
+
+    auto addedCount = addedTables.size();
+    m_tables.merge(addedTables);
+    return addedCount;
+}
+
+std::string HistoryStore::readTable(const TableRef& table) const
+{
+    std::string data(table.size, '\0');
+
+    std::ifstream file(m_tablesPath, std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(table.offset));
+    file.read(data.data(), static_cast<std::streamsize>(data.size()));
+
+    if (!file || hashString(data) != table.hash)
+    {
+        throw std::runtime_error(fmt::format("Damaged table at offset {} of history file \"{}\"", table.offset, m_tablesPath.string()));
+    }
+
+    return data;
+}
+
+std::vector<HistoryStore::FunctionChange> HistoryStore::functionHistory(std::string_view className, std::string_view namespaceName, std::string_view functionName) const
+{
+    std::vector<FunctionChange> history;
+
+    auto changes = m_classes.find(className);
+    if (changes == m_classes.end())
+    {
+        return history;
+    }
+
+    auto sameOffsets = [](const std::optional<FunctionOffsets>& a, const std::optional<FunctionOffsets>& b)
+    {
+        return a.has_value() == b.has_value() && (!a || (a->linuxIndex == b->linuxIndex && a->windowsIndex == b->windowsIndex));
+    };
+
+    // A class usually goes back and forth between few tables.
+    std::unordered_map<uint64_t, std::optional<FunctionOffsets>> offsetsByTable;
+    for (const auto& change : changes->second)
+    {
+        std::optional<FunctionOffsets> offsets;
+        if (change.table.size != 0)
+        {
+            auto cached = offsetsByTable.find(change.table.hash);
+            if (cached == offsetsByTable.end())
+            {
+                cached = offsetsByTable.emplace(change.table.hash, findInTable(readTable(change.table), namespaceName, functionName)).first;
+            }
+            offsets = cached->second;
+        }
+
+        if (history.empty() ? offsets.has_value() : !sameOffsets(history.back().offsets, offsets))
+        {
+            history.push_back({change.build, offsets});
+        }
+    }
+
+    return history;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Vtable offsets of many builds of a library, recorded one build at a time and queried without the libraries.
+// The store is a directory of two append-only files:
+//   builds - one record per build, with the classes whose offsets changed since the build before it
+//   tables - the offsets of a class, each distinct table once, found by its content hash (the class fingerprint)
+// Opening it reads only the build records and indexes them by class. Tables are read on query, and looked up in by
+// namespace and function through a sorted directory.
+class HistoryStore
+{
+public:
+    // Creates the directory if needed. Throws std::runtime_error if it isn't a history store or can't be read.
+    explicit HistoryStore(std::filesystem::path path);
+
+    // Appends a build, returns the number of class tables the store didn't have yet. Throws std::runtime_error on failure.
+    std::size_t record(std::string_view buildName, const Offsets& offsets);
+
+    std::size_t buildCount() const { return m_builds.size(); }
+    const std::string& buildName(std::size_t build) const { return m_builds[build].name; }
+    int64_t buildTime(std::size_t build) const { return m_builds[build].time; }
+
+    // Tables stored, shared by every build they didn't change in.
+    std::size_t tableCount() const { return m_tables.size(); }
+
+    struct FunctionChange
+    {
+        std::size_t build;
+        std::optional<FunctionOffsets> offsets; // Nothing when the build doesn't have the function
+    };
+
+    // The offsets of a function in the first build that has it, then in every build they changed in, or it went missing.
+    std::vector<FunctionChange> functionHistory(std::string_view className, std::string_view namespaceName, std::string_view functionName) const;
+
+private:
+    struct TableRef
+    {
+        uint64_t hash{};
+        uint64_t offset{};
+        uint32_t size{}; // 0 for a class the build doesn't have
+    };
+
+    struct ClassChange
+    {
+        std::size_t build;
+        TableRef table;
+    };
+
+    struct Build
+    {
+        std::string name;
+        int64_t time;
+    };
+
+    void readBuilds();
+    std::string readTable(const TableRef& table) const;
+
+    std::filesystem::path m_buildsPath;
+    std::filesystem::path m_tablesPath;
+    uint64_t m_buildsSize{0}; // End of the last complete build record, anything after it is a torn write
+
+    std::string m_buildsData; // Class names of the index point into it
+    std::list<std::string> m_recordedNames; // and into these, for classes added by record()
+
+    std::vector<Build> m_builds;
+    std::unordered_map<std::string_view, std::vector<ClassChange>> m_classes;
+    std::unordered_map<uint64_t, TableRef> m_tables;
+};
@@ -0,0 +1,220 @@
+#include "input.hpp"
+
+#include <fmt/format.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+const char *ioStrategyName(IoStrategy strategy)
+{
+    switch (strategy)
+    {
+    case IoStrategy::Mmap:
+        return "mmap";
+    case IoStrategy::Populate:
+        return "populate";
+    case IoStrategy::WillNeed:
+        return "willneed";
+    case IoStrategy::Pread:
+        return "pread";
+    }
+
+    return "unknown";
+}
+
+InputFile::InputFile(const std::string& path, const InputOptions& options) : m_options{options}
+{
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if(fd == -1)
+    {
+        throw std::runtime_error(fmt::format("Failed to open file \"{}\": {} (errno={}) ", path, strerror(errno), errno));
+    }
+
+    m_fd = fd;
+
+    // The destructor doesn't run when the constructor throws.
+    try
+    {
+        load(path);
+    }
+    catch(...)
+    {
+        close();
+        throw;
+    }
+}
+
+void InputFile::load(const std::string& path)
+{
+    struct stat sb {};
+    if(fstat(m_fd, &sb) == -1)
+    {
+        throw std::runtime_error(fmt::format("stat failed for file \"{}\": {} (errno={}) ", path, strerror(errno), errno));
+    }
+
+    auto file_size = static_cast<std::size_t>(sb.st_size);
+
+    auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t remainder = file_size % page_size;
+
+    auto mem_size = file_size;
+    if(remainder != 0)
+    {
+        mem_size += page_size - remainder;
+    }
+
+    m_file_size = file_size;
+    m_mem_size = mem_size;
+    m_page_size = page_size;
+
+    if(file_size == 0)
+    {
+        return;
+    }
+
+    if(m_options.strategy == IoStrategy::Pread)
+    {
+        read(path);
+        return;
+    }
+
+    auto flags = MAP_PRIVATE;
+    if(m_options.strategy == IoStrategy::Populate)
+    {
+        flags |= MAP_POPULATE;
+    }
+
+    auto data = mmap(nullptr, mem_size, PROT_READ, flags, m_fd, 0);
+    if(data == MAP_FAILED)
+    {
+        throw std::runtime_error(fmt::format("mmap failed for file \"{}\": {} (errno={}) ", path, strerror(errno), errno));
+    }
+
+    m_data = static_cast<char*>(data);
+    m_mapped = true;
+
+    if(m_options.hugePages)
+    {
+        // Only honoured for file mappings when the kernel supports read-only THP for filesystems.
+        advise(MADV_HUGEPAGE);
+    }
+}
+
+void InputFile::read(const std::string& path)
+{
+    auto data = std::aligned_alloc(m_page_size, m_mem_size);
+    if(!data)
+    {
+        throw std::runtime_error(fmt::format("Failed to allocate {} bytes for file \"{}\"", m_mem_size, path));
+    }
+
+    m_data = static_cast<char*>(data);
+
+    if(m_options.hugePages && madvise(data, m_mem_size, MADV_HUGEPAGE) == -1)
+    {
+        std::cerr << fmt::format("madvise failed: {} (errno={}) ", strerror(errno), errno) << std::endl;
+    }
+
+    posix_fadvise(m_fd, 0, static_cast<off_t>(m_file_size), POSIX_FADV_SEQUENTIAL);
+
+    std::size_t offset = 0;
+    while(offset < m_file_size)
+    {
+        auto res = pread(m_fd, m_data + offset, m_file_size - offset, static_cast<off_t>(offset));
+        if(res == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(res <= 0)
+        {
+            throw std::runtime_error(fmt::format("pread failed for file \"{}\" at offset {}: {} (errno={}) ", path, offset, res == 0 ? "unexpected end of file" : strerror(errno), errno));
+        }
+
+        offset += static_cast<std::size_t>(res);
+    }
+}
+
+InputFile::~InputFile()
+{
+    close();
+}
+
+void InputFile::advise(int advice)
+{
+    if(!m_mapped)
+    {
+        return;
+    }
+
+    if(madvise(reinterpret_cast<void*>(m_data), m_mem_size, advice) == -1)
+    {
+        std::cerr << fmt::format("madvise failed: {} (errno={}) ", strerror(errno), errno) << std::endl;
+    }
+}
+
+void InputFile::prefetch(uint64_t offset, uint64_t length)
+{
+    if(!m_mapped || length == 0 || offset >= m_file_size)
+    {
+        return;
+    }
+
+    auto start = offset - offset % m_page_size;
+    auto end = std::min<uint64_t>(offset + length, m_mem_size);
+
+    if(madvise(reinterpret_cast<void*>(m_data + start), end - start, MADV_WILLNEED) == -1)
+    {
+        std::cerr << fmt::format("madvise failed: {} (errno={}) ", strerror(errno), errno) << std::endl;
+    }
+}
+
+void InputFile::close()
+{
+    if(m_fd == -1)
+    {
+        return;
+    }
+
+    if(m_mapped)
+    {
+        auto res = munmap(reinterpret_cast<void*>(m_data), m_mem_size);
+        if(res != 0)
+        {
+            std::cout << fmt::format("munmap failed with result {}: {} (errno={}) ", res, strerror(errno), errno);
+        }
+    }
+    else
+    {
+        std::free(m_data);
+    }
+
+    m_data = nullptr;
+    m_mapped = false;
+
+    if(!m_options.keepPageCache)
+    {
+        auto res = posix_fadvise(m_fd, 0, static_cast<off_t>(m_file_size), POSIX_FADV_DONTNEED);
+        if(res != 0)
+        {
+            std::cout << fmt::format("posix_fadvise failed: {} (errno={}) ", strerror(res), res);
+        }
+    }
+
+    auto res = ::close(m_fd);
+    if(res == -1)
+    {
+        std::cout << fmt::format("Failed to close file descriptor {}: {} (errno={}) ", m_fd, strerror(errno), errno);
+    }
+
+    m_fd = -1;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum class IoStrategy
+{
+    Mmap, // Plain private mapping, pages are faulted in on first access
+    Populate, // Mapping with MAP_POPULATE, the whole file is read ahead of time
+    WillNeed, // Plain mapping, prefetch() is called for the ranges that will be read
+    Pread, // File is read into an anonymous buffer, for filesystems where faults are expensive (NFS)
+};
+
+struct InputOptions
+{
+    IoStrategy strategy{IoStrategy::Mmap};
+    bool hugePages{false};
+    bool keepPageCache{false}; // Otherwise the file is dropped from the page cache on close
+};
+
+const char *ioStrategyName(IoStrategy strategy);
+
+class InputFile
+{
+public:
+    InputFile(const std::string& path, const InputOptions& options = {});
+    ~InputFile();
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    char *data()
+    {
+        return m_data;
+    }
+
+    std::size_t size()
+    {
+        return m_file_size;
+    }
+
+    // Applies to mapped files only, a read buffer can't be dropped and re-read.
+    void advise(int advice);
+
+    void prefetch(uint64_t offset, uint64_t length);
+
+    void close();
+
+private:
+    void load(const std::string& path);
+    void read(const std::string& path);
+
+    InputOptions m_options;
+    int m_fd{-1};
+    char *m_data{};
+    bool m_mapped{false};
+    std::size_t m_file_size{0};
+    std::size_t m_mem_size{0};
+    std::size_t m_page_size{0};
+};
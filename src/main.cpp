@@ -1,112 +1,153 @@
-#include "reader.hpp"
-#include "parser.hpp"
-#include "formatter.hpp"
-#include "writer.hpp"
+#include "core.hpp"
+#include "demangler.hpp"
+#include "depfile.hpp"
+#include "history.hpp"
+#include "search.hpp"
+#include "trace.hpp"
 
 #include "CLI/CLI.hpp"
 #include <fmt/core.h>
 
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
-
-#include <cassert>
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+
+// Classes --dump_offsets formats at a time while the library is parsed.
+constexpr std::size_t CLASSES_PER_BATCH = 1024;
 
-class mmapReader
+static void printSearchResult(const SearchIndex& searchIndex, std::string_view query)
 {
-public:
-    explicit mmapReader(const std::string& path)
+    auto result = searchIndex.find(query);
+    for (const auto& entry : result.entries)
     {
-        auto fd = ::open(path.c_str(), O_RDONLY);
-        if(fd == -1)
-        {
-            throw std::runtime_error(fmt::format("Failed to open file \"{}\": {} (errno={}) ", path, strerror(errno), errno));
-        }
-
-        struct stat sb {};
-        if(fstat(fd, &sb) == -1)
+        switch (entry.kind)
         {
-            throw std::runtime_error(fmt::format("stat failed for file \"{}\": {} (errno={}) ", path, strerror(errno), errno));
+        case SearchEntryKind::VTableMethod:
+            std::cout << fmt::format("#VTableMethod.{}.linux# {}", entry.text, entry.values[0]) << '\n';
+            std::cout << fmt::format("#VTableMethod.{}.windows# {}", entry.text, entry.values[1]) << '\n';
+            break;
+        case SearchEntryKind::VTableField:
+            std::cout << fmt::format("#VTableField.{}# {}", entry.text, entry.values[0]) << '\n';
+            break;
+        case SearchEntryKind::Symbol:
+            std::cout << fmt::format("{} {}", entry.text, entry.mangledName) << '\n';
+            break;
         }
+    }
 
-        auto file_size = static_cast<std::size_t>(sb.st_size);
+    std::cout << std::flush;
+    std::cerr << fmt::format("Find: {} {} of {} entries, {} shown", result.matchCount, result.fuzzy ? "close matches" : "matches", searchIndex.size(), result.entries.size()) << std::endl;
+}
 
-        auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
-        std::size_t remainder = file_size % page_size;
+// Counts the entries of a table that differ between the backends, and prints the first one.
+template <typename T, typename Equal, typename Describe>
+static std::size_t compareTable(std::string_view table, std::span<const T> native, std::span<const T> libelf, Equal equal, Describe describe)
+{
+    if (native.size() != libelf.size())
+    {
+        std::cerr << fmt::format("Error: {} {} with the native backend, {} with libelf", table, native.size(), libelf.size()) << std::endl;
+        return 1;
+    }
 
-        auto mem_size = file_size;
-        if(remainder != 0)
+    std::size_t differences = 0;
+    for (std::size_t index = 0; index < native.size(); ++index)
+    {
+        if (equal(native[index], libelf[index]))
         {
-            mem_size += page_size - remainder;
+            continue;
         }
 
-        auto data = mmap(nullptr, mem_size, PROT_READ, MAP_PRIVATE, fd, 0);
-
-        if(file_size != 0)
+        if (differences++ == 0)
         {
-            if(data == MAP_FAILED)
-            {
-                throw std::runtime_error(fmt::format("mmap failed for file \"{}\": {} (errno={}) ", path, strerror(errno), errno));
-            }
+            std::cerr << fmt::format("Error: {} {} is {} with the native backend, {} with libelf", table, index, describe(native[index]), describe(libelf[index])) << std::endl;
         }
-
-        m_data = static_cast<char*>(data);
-        m_fd = fd;
-        m_file_size = file_size;
-        m_mem_size = mem_size;
     }
 
-    ~mmapReader()
+    if (differences > 1)
     {
-        assert(m_fd != -1);
-        assert(m_data);
+        std::cerr << fmt::format("Error: {} {} differ in total", differences, table) << std::endl;
+    }
 
-        if(m_mem_size != 0)
-        {
-            auto res = madvise(reinterpret_cast<void*>(m_data), m_mem_size, MADV_DONTNEED | MADV_FREE);
-            if(res == -1)
-            {
-                std::cout << fmt::format("madvise failed: {} (errno={}) ", strerror(errno), errno);
-            }
+    return differences;
+}
 
-            res = munmap(reinterpret_cast<void*>(m_data), m_mem_size);
-            if(res != 0)
-            {
-                std::cout << fmt::format("munmap failed with result {}: {} (errno={}) ", res, strerror(errno), errno);
-            }
-        }
+// Decodes the library with both ELF backends and compares everything parse() and the writer read.
+static std::size_t compareElfBackends(const std::string& libraryPath, const std::optional<std::filesystem::path>& debugFilePath, const InputOptions& inputOptions, ReaderOptions readerOptions)
+{
+    InputFile input(libraryPath, inputOptions);
+    std::optional<InputFile> debugInput;
+    std::span<char> debugImage;
+    if (debugFilePath)
+    {
+        debugInput.emplace(debugFilePath->string());
+        debugImage = {debugInput->data(), debugInput->size()};
+    }
 
-        auto res = posix_fadvise(m_fd, 0, static_cast<off_t>(m_file_size), POSIX_FADV_DONTNEED); //POSIX_FADV_NOREUSE
-        if(res != 0)
-        {
-            std::cout << fmt::format("posix_fadvise failed: {} (errno={}) ", strerror(errno), errno);
-        }
+    readerOptions.backend = ElfBackend::Native;
+    auto native = process(input.data(), input.size(), readerOptions, debugImage);
+    readerOptions.backend = ElfBackend::Libelf;
+    auto libelf = process(input.data(), input.size(), readerOptions, debugImage);
 
-        res = ::close(m_fd);
-        if(res == -1)
-        {
-            std::cout << fmt::format("Failed to close file descriptor {}: {} (errno={}) ", m_fd, strerror(errno), errno);
-        }
+    if (native.error != libelf.error)
+    {
+        std::cerr << fmt::format("Error: '{}' with the native backend, '{}' with libelf", native.error, libelf.error) << std::endl;
+        return 1;
     }
 
-    char *data()
+    if (!native.error.empty())
     {
-        return m_data;
+        return 0;
     }
 
-    std::size_t size()
+    std::size_t differences = 0;
+
+    auto header = [](const ProgramInfo& info)
+    {
+        return fmt::format("address size {}, .rodata {} at {}, .data.rel.ro {} at {}", info.addressSize, info.rodataIndex, info.rodataStart, info.relRodataIndex, info.relRodataStart);
+    };
+
+    if (header(native) != header(libelf))
     {
-        return m_file_size;
+        std::cerr << fmt::format("Error: {} with the native backend, {} with libelf", header(native), header(libelf)) << std::endl;
+        differences++;
     }
 
-private:
-    int m_fd{-1};
-    char *m_data{};
-    std::size_t m_file_size{0};
-    std::size_t m_mem_size{0};
-};
+    auto chunkEqual = [](const RodataChunk& a, const RodataChunk& b)
+    {
+        return static_cast<unsigned long long>(a.offset) == static_cast<unsigned long long>(b.offset) && std::ranges::equal(a.data, b.data);
+    };
+    auto chunkDescribe = [](const RodataChunk& chunk) { return fmt::format("{} bytes at {}", chunk.data.size(), chunk.offset); };
+
+    differences += compareTable<RodataChunk>(".rodata chunks", native.rodataChunks, libelf.rodataChunks, chunkEqual, chunkDescribe);
+    differences += compareTable<RodataChunk>(".data.rel.ro chunks", native.relRodataChunks, libelf.relRodataChunks, chunkEqual, chunkDescribe);
+
+    differences += compareTable<std::string_view>("needed libraries", native.neededLibraries, libelf.neededLibraries, std::equal_to<>{},
+        [](std::string_view name) { return std::string(name); });
+
+    differences += compareTable<SymbolInfo>("symbols", native.symbols.get(), libelf.symbols.get(),
+        [](const SymbolInfo& a, const SymbolInfo& b)
+        {
+            return a.section == b.section && static_cast<unsigned long long>(a.address) == static_cast<unsigned long long>(b.address) &&
+                static_cast<unsigned long long>(a.size) == static_cast<unsigned long long>(b.size) && a.name == b.name;
+        },
+        [](const SymbolInfo& symbol) { return fmt::format("{} in section {} at {}, size {}", symbol.name, symbol.section, symbol.address, static_cast<unsigned long long>(symbol.size)); });
+
+    differences += compareTable<RelocationInfo>("relocations", native.relocations.get(), libelf.relocations.get(),
+        [](const RelocationInfo& a, const RelocationInfo& b)
+        {
+            return static_cast<unsigned long long>(a.address) == static_cast<unsigned long long>(b.address) &&
+                static_cast<unsigned long long>(a.target) == static_cast<unsigned long long>(b.target) && a.importName == b.importName;
+        },
+        [](const RelocationInfo& relocation) { return fmt::format("{} -> {} {}", relocation.address, relocation.target, relocation.importName); });
+
+    differences += compareTable<MemberOffset>("member offsets", native.memberOffsets.get().entries(), libelf.memberOffsets.get().entries(),
+        [](const MemberOffset& a, const MemberOffset& b) { return a.className == b.className && a.memberName == b.memberName && a.offset == b.offset; },
+        [](const MemberOffset& member) { return fmt::format("{}::{} at {}", member.className, member.memberName, member.offset); });
+
+    return differences;
+}
 
 int main(int argc, char *argv[])
 {
@@ -114,18 +155,77 @@ int main(int argc, char *argv[])
 
     bool dumpOffsets = false;
     bool dumpSignatures = false;
+    bool checkDemangler = false;
+    bool checkElfBackend = false;
+    bool releaseTables = false;
+    bool showStats = false;
+    bool perfCounters = false;
+    bool record = false;
+
+    ReaderOptions readerOptions;
+    InputOptions inputOptions;
+    WriterOptions writerOptions;
 
     std::string libraryPath;
-    app.add_option("--library,-l", libraryPath, "Library path (.so)")->required()->check(CLI::ExistingFile);
+    app.add_option("--library,-l", libraryPath, "Library path (.so)")->check(CLI::ExistingFile);
+
+    std::vector<std::filesystem::path> depLibraryPaths;
+    app.add_option("--dep_library", depLibraryPaths, "Libraries vtable functions are imported from, found through DT_NEEDED (space-separated)")->check(CLI::ExistingFile);
+
+    std::vector<std::filesystem::path> debugDirectories;
+    app.add_option("--debug_dir", debugDirectories, "Directories searched for the debug file of a stripped library (default: /usr/lib/debug)")->check(CLI::ExistingDirectory);
 
     std::vector<std::filesystem::path> inputFilePaths;
     app.add_option("--input_files,-f", inputFilePaths, "Gamedata input file paths (space-separated, .txt.in)")->check(CLI::ExistingFile);
 
     std::vector<std::filesystem::path> outputDirectoryPaths;
     app.add_option("--output_dirs,-o", outputDirectoryPaths, "Gamedata output directory paths (space-separated)");
+    app.add_flag("--fan_out", writerOptions.fanOut, "Write every output file into every output directory");
+    app.add_flag("--hard_links", writerOptions.hardLinks, "With --fan_out, hard link the copies instead of copying");
+
+    std::filesystem::path offsetIndexPath;
+    app.add_option("--offset_index", offsetIndexPath, "Write a binary index of every vtable index and member offset, for runtime lookups (reader: src/offsetindex.hpp). Members only in the debug info are those of --input_files placeholders");
+
+    std::filesystem::path depfilePath;
+    app.add_option("--depfile", depfilePath, "Write a Make/Ninja depfile of the output files on the library, input files and every other file read");
+
+    std::map<std::string, ElfBackend> elfBackendNames{{"native", ElfBackend::Native}, {"libelf", ElfBackend::Libelf}};
+    app.add_option("--elf_backend", readerOptions.backend, "ELF reader (native, libelf)")->transform(CLI::CheckedTransformer(elfBackendNames, CLI::ignore_case));
+
+    app.add_option("--jobs,-j", readerOptions.jobs, "Worker threads (0 = one per core)");
+
+    std::map<std::string, IoStrategy> ioStrategyNames{{"mmap", IoStrategy::Mmap}, {"populate", IoStrategy::Populate}, {"willneed", IoStrategy::WillNeed}, {"pread", IoStrategy::Pread}};
+    app.add_option("--io_strategy", inputOptions.strategy, "Library read strategy (mmap, populate, willneed, pread)")->transform(CLI::CheckedTransformer(ioStrategyNames, CLI::ignore_case));
+    app.add_flag("--huge_pages", inputOptions.hugePages, "Ask for transparent huge pages for the library image");
+    app.add_flag("--keep_page_cache", inputOptions.keepPageCache, "Leave the library in the page cache for the next run");
+    app.add_flag("--stats", showStats, "Print a per-phase timing report to stderr");
+    app.add_flag("--perf_counters", perfCounters, "Print --stats with cycles, instructions, cache and branch misses per phase");
+
+    std::string tracePath;
+    app.add_option("--trace", tracePath, "Write a Chrome trace of the run (open in ui.perfetto.dev)");
+
+    std::filesystem::path historyPath;
+    app.add_option("--history_store", historyPath, "Directory of the vtable offsets of every recorded build");
+    app.add_flag("--record", record, "Append the library to --history_store as a new build");
+
+    std::string buildName;
+    app.add_option("--build_name", buildName, "Name of the recorded build (default: library path)");
+
+    std::string historyQuery;
+    app.add_option("--history", historyQuery, "Print the offsets of Class::Namespace::Function in every --history_store build they changed in");
+
+    std::string findQuery;
+    app.add_option("--find", findQuery, "Print the placeholders and symbols containing QUERY (case-insensitive), or the closest ones. Members only in the debug info are those of --input_files placeholders");
+
+    std::filesystem::path searchIndexPath;
+    app.add_option("--search_index", searchIndexPath, "Search index file for --find, rebuilt when the library or the --input_files fields change");
+
+    app.add_flag("--release_tables", releaseTables, "Release the decode tables and the library pages once the library is parsed");
 
     app.add_flag("--dump_offsets", dumpOffsets, "Print all vtable offsets");
     app.add_flag("--dump_signatures", dumpSignatures, "Print all signatures");
+    app.add_flag("--check_demangler", checkDemangler, "Compare the built-in demangler with __cxa_demangle on every symbol");
+    app.add_flag("--check_elf_backend", checkElfBackend, "Decode the library with both ELF backends and compare the symbols, relocations, rodata chunks and member offsets");
 
     std::string usage_msg = "Usage: gamedata-gen [options]";
     app.usage(usage_msg);
@@ -136,31 +236,192 @@ int main(int argc, char *argv[])
 
     CLI11_PARSE(app, argc, argv);
 
-    if (outputDirectoryPaths.empty() && !dumpOffsets && !dumpSignatures)
+    if ((record || !historyQuery.empty()) && historyPath.empty())
     {
-        std::cerr << fmt::format("Specify either --output or one of --dump_* options") << std::endl;
+        std::cerr << fmt::format("--record and --history need --history_store") << std::endl;
         return EXIT_FAILURE;
     }
 
-#if 0
-    std::ifstream file(libraryPath, std::ios::binary);
-    std::string image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    auto program = image.data();
-    auto size = image.size();
-#else
-    mmapReader reader(libraryPath);
-    auto program = reader.data();
-    auto size = reader.size();
-#endif
+    if (!depfilePath.empty() && outputDirectoryPaths.empty() && offsetIndexPath.empty())
+    {
+        std::cerr << fmt::format("--depfile needs --output_dirs or --offset_index") << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::optional<HistoryStore> history;
+    if (!historyPath.empty())
+    {
+        try
+        {
+            history.emplace(historyPath);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Answered from the store alone.
+    if (!historyQuery.empty())
+    {
+        auto functionNameStartPos = historyQuery.rfind("::");
+        auto namespaceStartPos = historyQuery.find("::");
+        if (functionNameStartPos == std::string::npos || namespaceStartPos == functionNameStartPos)
+        {
+            std::cerr << fmt::format("Error: incorrect format of function {} (expected Class::Namespace::Function)", historyQuery) << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        auto className = std::string_view(historyQuery).substr(0, namespaceStartPos);
+        auto namespaceName = std::string_view(historyQuery).substr(namespaceStartPos + 2, functionNameStartPos - namespaceStartPos - 2);
+        auto functionName = std::string_view(historyQuery).substr(functionNameStartPos + 2);
+
+        std::vector<HistoryStore::FunctionChange> changes;
+        try
+        {
+            changes = history->functionHistory(className, namespaceName, functionName);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout << "Build, Linux offset, Windows offset\n" << std::endl;
+        for (const auto& change : changes)
+        {
+            if (change.offsets)
+            {
+                std::cout << fmt::format("{} {} {}", history->buildName(change.build), change.offsets->linuxIndex, change.offsets->windowsIndex) << std::endl;
+            }
+            else
+            {
+                std::cout << fmt::format("{} -", history->buildName(change.build)) << std::endl;
+            }
+        }
+
+        std::cerr << fmt::format("History: {} builds, {} changes", history->buildCount(), changes.size()) << std::endl;
+
+        if (libraryPath.empty())
+        {
+            return changes.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+    }
+
+    if (libraryPath.empty())
+    {
+        std::cerr << fmt::format("--library is required") << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool analyse = !outputDirectoryPaths.empty() || dumpOffsets || dumpSignatures || checkDemangler || checkElfBackend || record || !offsetIndexPath.empty();
+    if (!analyse && findQuery.empty())
+    {
+        std::cerr << fmt::format("Specify either --output, --offset_index, --record, --find or one of --dump_* options") << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Fields only the debug info has can't be enumerated, the search and offset indices have those the templates use.
+    // The templates are read for them up front then, and handed to the writer afterwards.
+    std::optional<std::vector<GamedataTemplate>> readTemplates;
+    FieldNames referencedFields;
+    if (!findQuery.empty() || !offsetIndexPath.empty())
+    {
+        readTemplates.emplace();
+        for (const auto& inputFilePath : inputFilePaths)
+        {
+            auto gamedataTemplate = readGamedataTemplate(inputFilePath);
+            referencedFields.insert(gamedataTemplate.referencedFields.begin(), gamedataTemplate.referencedFields.end());
+            readTemplates->push_back(std::move(gamedataTemplate));
+        }
+    }
+
+    // A saved index answers without the library being analysed.
+    std::optional<SearchIndex> searchIndex;
+    if (!findQuery.empty() && !searchIndexPath.empty())
+    {
+        try
+        {
+            searchIndex = SearchIndex::load(searchIndexPath, SearchIndexKey::of(libraryPath, referencedFields));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << fmt::format("Warning: {}, rebuilding it", e.what()) << std::endl;
+        }
+
+        if (searchIndex)
+        {
+            printSearchResult(*searchIndex, findQuery);
+            if (!analyse)
+            {
+                return EXIT_SUCCESS;
+            }
+        }
+    }
+
+    if (!tracePath.empty())
+    {
+        Trace::start();
+    }
+
+    Stats stats;
+    auto statsPtr = showStats || perfCounters ? &stats : nullptr;
+
+    // Before any thread is started, the counters only follow threads started after them.
+    std::string perfCountersError;
+    if (perfCounters && !stats.enablePerfCounters(perfCountersError))
+    {
+        std::cerr << fmt::format("Warning: hardware counters unavailable, reporting timing only - {}", perfCountersError) << std::endl;
+    }
+
+    AnalysisOptions analysisOptions;
+    analysisOptions.input = inputOptions;
+    analysisOptions.reader = readerOptions;
+    analysisOptions.releaseTables = releaseTables;
+    analysisOptions.keepSymbols = dumpSignatures || checkDemangler || (!findQuery.empty() && !searchIndex);
+    analysisOptions.streamClasses = dumpOffsets;
+    if (!debugDirectories.empty())
+    {
+        analysisOptions.debugDirectories = debugDirectories;
+    }
 
-    auto programInfo = process(program, size);
+    std::optional<SymbolCache> symbolCache;
+    if (!depLibraryPaths.empty())
+    {
+        symbolCache.emplace(depLibraryPaths, inputOptions);
+        analysisOptions.symbolCache = &*symbolCache;
+    }
+
+    // Input files are read while the library is processed, unless they were read already.
+    std::optional<TemplateReader> templates;
+    if (!outputDirectoryPaths.empty() && readTemplates)
+    {
+        templates.emplace(std::move(*readTemplates));
+    }
+    else if (!outputDirectoryPaths.empty())
+    {
+        templates.emplace(inputFilePaths);
+    }
 
-    if (!programInfo.error.empty())
+    std::optional<Analysis> analysis;
+    try
     {
-        std::cerr << fmt::format("Failed to process input file '{}': {}", libraryPath, programInfo.error) << std::endl;
+        analysis.emplace(libraryPath, analysisOptions, statsPtr);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
 
+    for (const auto& warning : analysis->warnings())
+    {
+        std::cerr << fmt::format("Warning: {}", warning) << std::endl;
+    }
+
+    const auto& programInfo = analysis->programInfo();
+
 #if 0
     fprintf(stdout, "address size: %d\n", programInfo.addressSize);
     fprintf(stdout, "rodata start: %08llx\n", (unsigned long long)programInfo.rodataStart);
@@ -171,8 +432,8 @@ int main(int argc, char *argv[])
         fprintf(stdout, "    size: %zu\n", chunk.data.size());
     }
 
-    fprintf(stdout, "symbols: %zu\n", programInfo.symbols.size());
-    for (const auto &symbol : programInfo.symbols)
+    fprintf(stdout, "symbols: %zu\n", programInfo.symbols.get().size());
+    for (const auto &symbol : programInfo.symbols.get())
     {
         if (static_cast<unsigned long long>(symbol.address) == 0 || symbol.size == 0 || symbol.name.empty())
         {
@@ -180,14 +441,12 @@ int main(int argc, char *argv[])
         }
         fprintf(stdout, "  offset: %08llx\n", (unsigned long long)symbol.address);
         fprintf(stdout, "    size: %llu\n", (unsigned long long)symbol.size);
-        fprintf(stdout, "    name: %s\n", demangleSymbol(symbol.name.c_str()).get());
+        fprintf(stdout, "    name: %s\n", demangleSymbol(symbol.name.data()).get());
     }
 #endif
 
-    auto out = parse(programInfo);
-
 #if 0
-    for (const auto& outClass : out.classes)
+    for (const auto& outClass : analysis->classes())
     {
         std::cout << outClass.id << " " << outClass.name << std::endl;
 
@@ -206,45 +465,254 @@ int main(int argc, char *argv[])
 
     if (dumpOffsets)
     {
+        ScopedPhase phase(statsPtr, "parse + dump_offsets");
+
         std::cout << "Class name::Namespace::Function, Linux offset, Windows offset\n" << std::endl;
-        for (const auto& outClass : out.classes)
-        {
-            auto functions = formatVTable(outClass);
 
-            for (const auto& function : functions)
+        // Classes are formatted in batches while the library is parsed, each class into its own buffer.
+        // The buffers are written in class order.
+        std::vector<const ClassInfo*> classes;
+        std::vector<std::string> lines;
+        std::size_t slots = 0;
+
+        ParallelFormatter formatter(analysis->functionTable(), analysis->hierarchy(), readerOptions.jobs);
+        auto printClasses = [&]()
+        {
+            lines.assign(classes.size(), {});
+            formatter.format(classes, [&](VTableFormatter& classFormatter, std::size_t index)
             {
-                std::string linuxIndex = " ";
-                if (function.linuxIndex.has_value())
+                const auto& outClass = *classes[index];
+                for (const auto& function : classFormatter.format(outClass))
                 {
-                    linuxIndex = std::to_string(function.linuxIndex.value());
+                    std::string linuxIndex = " ";
+                    if (function.linuxIndex.has_value())
+                    {
+                        linuxIndex = std::to_string(function.linuxIndex.value());
+                    }
+
+                    std::string windowsIndex = " ";
+                    if (function.windowsIndex.has_value())
+                    {
+                        windowsIndex = std::to_string(function.windowsIndex.value());
+                    }
+
+                    lines[index] += fmt::format("{}::{} {} {} {}\n", outClass.name, function.name, (function.isMulti ? " [Multi]" : ""), linuxIndex, windowsIndex);
                 }
+            });
 
-                std::string windowsIndex = " ";
-                if (function.windowsIndex.has_value())
+            for (const auto& classLines : lines)
+            {
+                std::cout << classLines;
+            }
+
+            std::cout << std::flush;
+            classes.clear();
+        };
+
+        try
+        {
+            for (const auto& outClass : analysis->streamClasses())
+            {
+                classes.push_back(&outClass);
+                for (const auto& vtable : outClass.vtables)
                 {
-                    windowsIndex = std::to_string(function.windowsIndex.value());
+                    slots += vtable.functionIds.size();
                 }
 
-                std::cout << fmt::format("{}::{} {} {} {}", outClass.name, function.name, (function.isMulti ? " [Multi]" : ""), linuxIndex, windowsIndex) << std::endl;
+                if (classes.size() == CLASSES_PER_BATCH)
+                {
+                    printClasses();
+                }
             }
         }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        printClasses();
+        phase.setSlots(slots);
     }
 
     if (dumpSignatures)
     {
-        for (const auto& symbol : programInfo.symbols)
+        ScopedPhase phase(statsPtr, "dump_signatures");
+
+        Demangler demangler;
+        for (const auto& symbol : programInfo.symbols.get())
         {
             if (symbol.name.empty())
             {
                 continue;
             }
 
-            auto demangledSymbol = demangleSymbol(symbol.name.c_str());
-            auto demangledSymbolText = demangledSymbol ? &*demangledSymbol : symbol.name.c_str();
+            std::cout << fmt::format("{} {}", demangler.demangle(symbol.name.data()).text, symbol.name) << std::endl;
+        }
+    }
+
+    if (checkDemangler)
+    {
+        ScopedPhase phase(statsPtr, "check_demangler");
+
+        Demangler demangler;
+        std::size_t symbolCount = 0;
+        std::size_t mismatchCount = 0;
+        for (const auto& symbol : programInfo.symbols.get())
+        {
+            if (!symbol.name.starts_with("_Z"))
+            {
+                continue;
+            }
+
+            symbolCount++;
+
+            auto demangledSymbol = demangleSymbol(symbol.name.data());
+            std::string_view expected = demangledSymbol ? demangledSymbol.get() : symbol.name;
+
+            auto actual = demangler.demangle(symbol.name.data()).text;
+            if (actual != expected)
+            {
+                mismatchCount++;
+                std::cerr << fmt::format("Error: {} demangled as '{}' instead of '{}'", symbol.name, actual, expected) << std::endl;
+            }
+        }
+
+        std::cerr << fmt::format("Demangler: {} symbols, {} handled by __cxa_demangle, {} mismatches", symbolCount, demangler.fallbackCount(), mismatchCount) << std::endl;
+
+        if (mismatchCount != 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (checkElfBackend)
+    {
+        ScopedPhase phase(statsPtr, "check_elf_backend");
+
+        auto differences = compareElfBackends(libraryPath, analysis->debugFilePath(), inputOptions, readerOptions);
+        std::cerr << fmt::format("ELF backends: {} differences", differences) << std::endl;
 
-            std::cout << fmt::format("{} {}", demangledSymbolText, symbol.name) << std::endl;
+        if (differences != 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!findQuery.empty() && !searchIndex)
+    {
+        timePhase(statsPtr, "search index", [&] { searchIndex.emplace(analysis->offsets(), analysis->memberOffsets(), referencedFields, programInfo.symbols.get()); });
+
+        if (!searchIndexPath.empty())
+        {
+            try
+            {
+                searchIndex->save(searchIndexPath, SearchIndexKey::of(libraryPath, referencedFields));
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        printSearchResult(*searchIndex, findQuery);
+    }
+
+    if (record)
+    {
+        ScopedPhase phase(statsPtr, "record");
+
+        try
+        {
+            auto addedTables = history->record(buildName.empty() ? libraryPath : buildName, analysis->offsets());
+            std::cerr << fmt::format("History: build {} recorded, {} of {} class tables new", history->buildCount(), addedTables, analysis->offsets().size()) << std::endl;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<std::filesystem::path> writtenFiles;
+
+    if (!offsetIndexPath.empty())
+    {
+        ScopedPhase phase(statsPtr, "offset index");
+
+        try
+        {
+            writeOffsetIndex(offsetIndexPath, analysis->offsets(), analysis->memberOffsets(), referencedFields);
+            writtenFiles.push_back(offsetIndexPath);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    writerOptions.jobs = readerOptions.jobs;
+    writerOptions.writtenFiles = &writtenFiles;
+
+    int result = EXIT_FAILURE;
+    try
+    {
+        result = timePhase(statsPtr, "write", [&] { return templates ? analysis->writeGamedata(*templates, outputDirectoryPaths, writerOptions) : EXIT_SUCCESS; });
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+    }
+
+    templates.reset();
+
+    if (result == EXIT_SUCCESS && !depfilePath.empty())
+    {
+        std::vector<std::filesystem::path> dependencies{libraryPath};
+        dependencies.insert(dependencies.end(), inputFilePaths.begin(), inputFilePaths.end());
+
+        if (analysis->debugFilePath())
+        {
+            dependencies.push_back(*analysis->debugFilePath());
+        }
+
+        if (symbolCache)
+        {
+            auto openedPaths = symbolCache->openedPaths();
+            dependencies.insert(dependencies.end(), openedPaths.begin(), openedPaths.end());
+        }
+
+        try
+        {
+            writeDepfile(depfilePath, writtenFiles, dependencies);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    timePhase(statsPtr, "close", [&] { analysis->close(); });
+
+    if (statsPtr)
+    {
+        std::cerr << fmt::format("I/O strategy: {} (huge pages: {}, keep page cache: {})", ioStrategyName(inputOptions.strategy), inputOptions.hugePages, inputOptions.keepPageCache) << std::endl;
+        stats.print(std::cerr);
+    }
+
+    if (!tracePath.empty())
+    {
+        std::ofstream traceStream(tracePath);
+        Trace::write(traceStream);
+
+        if (!traceStream)
+        {
+            std::cerr << fmt::format("Error: trace file {} write failed - {}", tracePath, std::strerror(errno)) << std::endl;
         }
     }
 
-    return writeGamedataFile(out.classes, programInfo.vtableFieldDataEntries, inputFilePaths, outputDirectoryPaths);
+    return result;
 }
@@ -0,0 +1,67 @@
+#include "memberoffsets.hpp"
+#include "dwarf.hpp"
+#include "hash.hpp"
+
+#include <bit>
+
+uint64_t MemberOffsetIndex::hashKey(std::string_view className, std::string_view memberName)
+{
+    auto hash = hashString(className);
+    hash = hashString("::", hash);
+    return finalizeHash(hashString(memberName, hash));
+}
+
+MemberOffsetIndex::MemberOffsetIndex(std::vector<MemberOffset> entries) : m_entries{std::move(entries)}
+{
+    if (m_entries.empty())
+    {
+        return;
+    }
+
+    m_slots.resize(std::bit_ceil(m_entries.size() * 2));
+    auto mask = m_slots.size() - 1;
+
+    for (std::size_t entryIndex = 0; entryIndex < m_entries.size(); ++entryIndex)
+    {
+        const auto& entry = m_entries[entryIndex];
+        auto hash = hashKey(entry.className, entry.memberName);
+
+        for (auto slotIndex = hash & mask;; slotIndex = (slotIndex + 1) & mask)
+        {
+            auto& slot = m_slots[slotIndex];
+            if (slot.entry == 0)
+            {
+                slot.hash = static_cast<uint32_t>(hash >> 32);
+                slot.entry = static_cast<uint32_t>(entryIndex + 1);
+                break;
+            }
+
+            const auto& other = m_entries[slot.entry - 1];
+            if (slot.hash == static_cast<uint32_t>(hash >> 32) && other.className == entry.className && other.memberName == entry.memberName)
+            {
+                break;
+            }
+        }
+    }
+}
+
+std::optional<uint64_t> MemberOffsetIndex::find(std::string_view className, std::string_view memberName) const
+{
+    if (!m_slots.empty())
+    {
+        auto hash = hashKey(className, memberName);
+        auto mask = m_slots.size() - 1;
+
+        for (auto slotIndex = hash & mask; m_slots[slotIndex].entry != 0; slotIndex = (slotIndex + 1) & mask)
+        {
+            const auto& slot = m_slots[slotIndex];
+            const auto& entry = m_entries[slot.entry - 1];
+            if (slot.hash == static_cast<uint32_t>(hash >> 32) && entry.className == className && entry.memberName == memberName)
+            {
+                return entry.offset;
+            }
+        }
+    }
+
+    return m_fallback ? m_fallback->find(className, memberName) : std::nullopt;
+}
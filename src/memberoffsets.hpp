@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Entry layout of the custom .member_offsets section, the name pointers are virtual addresses.
+struct VTableFieldOffsetDataRaw
+{
+    uint64_t class_name_ptr;
+    uint64_t member_name_ptr;
+    uint64_t offset;
+};
+
+class DwarfMemberOffsets;
+
+struct MemberOffset
+{
+    std::string_view className; // Points into the input image
+    std::string_view memberName; // Points into the input image
+    uint64_t offset;
+};
+
+// Open addressing hash index over (class, member). The first entry wins for duplicated keys.
+// Keys it doesn't have are looked up in the fallback, when the image has debug info.
+class MemberOffsetIndex
+{
+public:
+    MemberOffsetIndex() = default;
+    explicit MemberOffsetIndex(std::vector<MemberOffset> entries);
+
+    std::optional<uint64_t> find(std::string_view className, std::string_view memberName) const;
+
+    const std::vector<MemberOffset>& entries() const { return m_entries; }
+    bool empty() const { return m_entries.empty(); }
+
+    void setFallback(std::shared_ptr<const DwarfMemberOffsets> fallback) { m_fallback = std::move(fallback); }
+
+private:
+    struct Slot
+    {
+        uint32_t hash; // Upper hash bits, to skip most string compares
+        uint32_t entry; // Entry index + 1, 0 marks an empty slot
+    };
+
+    static uint64_t hashKey(std::string_view className, std::string_view memberName);
+
+    std::vector<MemberOffset> m_entries;
+    std::vector<Slot> m_slots;
+    std::shared_ptr<const DwarfMemberOffsets> m_fallback;
+};
@@ -0,0 +1,236 @@
+#pragma once
+
+// Reader of the binary offset index written by --offset_index. Header-only and standalone (C++17, no other includes
+// from this project), to be copied into the code that consumes the index: map the file, hand it to OffsetIndex and
+// look up entries without parsing or allocating.
+//
+// File layout, little-endian, every array 8-byte aligned:
+//   OffsetIndexHeader
+//   uint32_t seeds[bucketCount]      - per bucket displacement of the minimal perfect hash
+//   OffsetIndexEntry entries[count]  - in slot order, each key once
+//   char keys[keysSize]              - key bytes, see offsetIndexKey
+// A key hashes to a bucket, the bucket's seed to the slot of its entry. Slots are a permutation of the entries, a key
+// that isn't in the index lands on some other entry and is told apart by comparing the key bytes.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+constexpr char OFFSET_INDEX_MAGIC[8] = {'G', 'D', 'O', 'F', 'F', 'I', 'D', 'X'};
+constexpr uint32_t OFFSET_INDEX_VERSION = 1;
+
+struct OffsetIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t bucketCount;
+    uint32_t keysSize;
+};
+
+enum class OffsetIndexKind : uint8_t
+{
+    Method = 'M', // values: Linux and Windows vtable index
+    Field = 'F', // values: member offset and 0
+};
+
+struct OffsetIndexEntry
+{
+    uint32_t keyOffset; // Into the keys
+    uint32_t keySize;
+    int64_t values[2];
+};
+
+// Keys are the kind, then the class, namespace (methods only) and function or member name, separated by NULs.
+// They are hashed and compared part by part, so a lookup never builds one.
+struct OffsetIndexKey
+{
+    OffsetIndexKind kind;
+    std::string_view parts[3];
+    std::size_t partCount;
+
+    std::size_t size() const
+    {
+        std::size_t size = partCount; // The kind and the separators
+        for (std::size_t i = 0; i < partCount; ++i)
+        {
+            size += parts[i].size();
+        }
+        return size;
+    }
+
+    // 64-bit FNV-1a over the key bytes.
+    uint64_t hash() const
+    {
+        uint64_t hash = 14695981039346656037ull;
+        auto add = [&hash](unsigned char byte)
+        {
+            hash ^= byte;
+            hash *= 1099511628211ull;
+        };
+
+        add(static_cast<unsigned char>(kind));
+        for (std::size_t i = 0; i < partCount; ++i)
+        {
+            if (i != 0)
+            {
+                add(0);
+            }
+
+            for (auto c : parts[i])
+            {
+                add(static_cast<unsigned char>(c));
+            }
+        }
+
+        return hash;
+    }
+
+    bool equals(const char *bytes, std::size_t size) const
+    {
+        if (size != this->size() || static_cast<unsigned char>(bytes[0]) != static_cast<unsigned char>(kind))
+        {
+            return false;
+        }
+
+        std::size_t offset = 1;
+        for (std::size_t i = 0; i < partCount; ++i)
+        {
+            if (i != 0 && bytes[offset++] != '\0')
+            {
+                return false;
+            }
+
+            if (!parts[i].empty() && std::memcmp(bytes + offset, parts[i].data(), parts[i].size()) != 0)
+            {
+                return false;
+            }
+            offset += parts[i].size();
+        }
+
+        return true;
+    }
+};
+
+inline OffsetIndexKey offsetIndexKey(std::string_view className, std::string_view namespaceName, std::string_view functionName)
+{
+    return {OffsetIndexKind::Method, {className, namespaceName, functionName}, 3};
+}
+
+inline OffsetIndexKey offsetIndexKey(std::string_view className, std::string_view memberName)
+{
+    return {OffsetIndexKind::Field, {className, memberName, {}}, 2};
+}
+
+inline uint32_t offsetIndexBucket(uint64_t hash, uint32_t bucketCount)
+{
+    return static_cast<uint32_t>(hash % bucketCount);
+}
+
+inline uint32_t offsetIndexSlot(uint64_t hash, uint32_t seed, uint32_t entryCount)
+{
+    auto mixed = (hash ^ (hash >> 29)) + seed * 0x9e3779b97f4a7c15ull;
+    mixed ^= mixed >> 33;
+    mixed *= 0xff51afd7ed558ccdull;
+    mixed ^= mixed >> 33;
+    return static_cast<uint32_t>(mixed % entryCount);
+}
+
+class OffsetIndex
+{
+public:
+    struct MethodOffsets
+    {
+        int linuxIndex;
+        int windowsIndex;
+    };
+
+    // The image has to stay mapped while the index is used. Returns false if it isn't a valid index of this version.
+    bool open(const void *image, std::size_t size)
+    {
+        *this = {};
+
+        auto bytes = static_cast<const char *>(image);
+        if (!bytes || size < sizeof(OffsetIndexHeader) || reinterpret_cast<std::uintptr_t>(bytes) % 8 != 0)
+        {
+            return false;
+        }
+
+        OffsetIndexHeader header;
+        std::memcpy(&header, bytes, sizeof(header));
+        if (std::memcmp(header.magic, OFFSET_INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version != OFFSET_INDEX_VERSION)
+        {
+            return false;
+        }
+
+        auto seedsOffset = sizeof(OffsetIndexHeader);
+        auto entriesOffset = align(seedsOffset + uint64_t{header.bucketCount} * sizeof(uint32_t));
+        auto keysOffset = entriesOffset + uint64_t{header.entryCount} * sizeof(OffsetIndexEntry);
+        if (keysOffset > size || header.keysSize > size - keysOffset || (header.entryCount != 0 && header.bucketCount == 0))
+        {
+            return false;
+        }
+
+        m_seeds = reinterpret_cast<const uint32_t *>(bytes + seedsOffset);
+        m_entries = reinterpret_cast<const OffsetIndexEntry *>(bytes + entriesOffset);
+        m_keys = bytes + keysOffset;
+        m_header = header;
+        return true;
+    }
+
+    std::size_t size() const { return m_header.entryCount; }
+
+    std::optional<MethodOffsets> method(std::string_view className, std::string_view namespaceName, std::string_view functionName) const
+    {
+        auto entry = find(offsetIndexKey(className, namespaceName, functionName));
+        if (!entry)
+        {
+            return std::nullopt;
+        }
+
+        return MethodOffsets{static_cast<int>(entry->values[0]), static_cast<int>(entry->values[1])};
+    }
+
+    std::optional<uint64_t> member(std::string_view className, std::string_view memberName) const
+    {
+        auto entry = find(offsetIndexKey(className, memberName));
+        if (!entry)
+        {
+            return std::nullopt;
+        }
+
+        return static_cast<uint64_t>(entry->values[0]);
+    }
+
+private:
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 7) & ~uint64_t{7};
+    }
+
+    const OffsetIndexEntry *find(const OffsetIndexKey& key) const
+    {
+        if (m_header.entryCount == 0)
+        {
+            return nullptr;
+        }
+
+        auto hash = key.hash();
+        auto seed = m_seeds[offsetIndexBucket(hash, m_header.bucketCount)];
+        const auto& entry = m_entries[offsetIndexSlot(hash, seed, m_header.entryCount)];
+
+        if (entry.keyOffset > m_header.keysSize || entry.keySize > m_header.keysSize - entry.keyOffset || entry.keySize == 0)
+        {
+            return nullptr;
+        }
+
+        return key.equals(m_keys + entry.keyOffset, entry.keySize) ? &entry : nullptr;
+    }
+
+    OffsetIndexHeader m_header{};
+    const uint32_t *m_seeds{};
+    const OffsetIndexEntry *m_entries{};
+    const char *m_keys{};
+};
@@ -0,0 +1,152 @@
+#include "output.hpp"
+#include "trace.hpp"
+
+#include <fmt/format.h>
+
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+const char *copyMethodName(CopyMethod method)
+{
+    switch (method)
+    {
+    case CopyMethod::HardLink:
+        return "hard link";
+    case CopyMethod::Reflink:
+        return "reflink";
+    case CopyMethod::CopyFileRange:
+        return "copy_file_range";
+    case CopyMethod::Write:
+        return "write";
+    }
+
+    return "unknown";
+}
+
+// Closes the descriptor when leaving scope.
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(int fd) : m_fd{fd} {}
+    ~FileDescriptor()
+    {
+        if (m_fd != -1)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+static void writeAll(int fd, const std::filesystem::path& path, std::string_view contents)
+{
+    std::size_t offset = 0;
+    while (offset < contents.size())
+    {
+        auto res = ::write(fd, contents.data() + offset, contents.size() - offset);
+        if (res == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (res <= 0)
+        {
+            throw std::runtime_error(fmt::format("write failed for file \"{}\": {} (errno={}) ", path.string(), strerror(errno), errno));
+        }
+
+        offset += static_cast<std::size_t>(res);
+    }
+}
+
+static int createFile(const std::filesystem::path& path)
+{
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+    {
+        throw std::runtime_error(fmt::format("Failed to create file \"{}\": {} (errno={}) ", path.string(), strerror(errno), errno));
+    }
+
+    return fd;
+}
+
+void writeOutputFile(const std::filesystem::path& path, std::string_view contents)
+{
+    TRACE_SCOPE("write file", path.native());
+
+    // A hard link left by an earlier run would otherwise be written through.
+    std::error_code error;
+    std::filesystem::remove(path, error);
+
+    FileDescriptor fd(createFile(path));
+    writeAll(fd.get(), path, contents);
+}
+
+CopyMethod copyOutputFile(const std::filesystem::path& source, const std::filesystem::path& target, std::string_view contents, bool hardLink)
+{
+    std::error_code error;
+    std::filesystem::remove(target, error);
+
+    if (hardLink)
+    {
+        std::filesystem::create_hard_link(source, target, error);
+        if (!error)
+        {
+            return CopyMethod::HardLink;
+        }
+    }
+
+    FileDescriptor targetFd(createFile(target));
+    FileDescriptor sourceFd(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+
+    if (sourceFd.get() != -1)
+    {
+        if (ioctl(targetFd.get(), FICLONE, sourceFd.get()) == 0)
+        {
+            return CopyMethod::Reflink;
+        }
+
+        std::size_t copied = 0;
+        while (copied < contents.size())
+        {
+            auto res = copy_file_range(sourceFd.get(), nullptr, targetFd.get(), nullptr, contents.size() - copied, 0);
+            if (res == -1 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (res <= 0)
+            {
+                break;
+            }
+
+            copied += static_cast<std::size_t>(res);
+        }
+
+        if (copied == contents.size())
+        {
+            return CopyMethod::CopyFileRange;
+        }
+
+        // Not supported across these filesystems, start over with a plain write.
+        if (ftruncate(targetFd.get(), 0) == -1 || lseek(targetFd.get(), 0, SEEK_SET) == -1)
+        {
+            throw std::runtime_error(fmt::format("Failed to truncate file \"{}\": {} (errno={}) ", target.string(), strerror(errno), errno));
+        }
+    }
+
+    writeAll(targetFd.get(), target, contents);
+    return CopyMethod::Write;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+
+enum class CopyMethod
+{
+    HardLink, // Same inode as the source, only when asked for
+    Reflink, // FICLONE, shares extents on btrfs/XFS
+    CopyFileRange, // In-kernel copy, server-side on NFS
+    Write, // Buffered write of the rendered contents
+};
+
+const char *copyMethodName(CopyMethod method);
+
+// Creates or replaces the file. Throws std::runtime_error on failure.
+void writeOutputFile(const std::filesystem::path& path, std::string_view contents);
+
+// Makes `target` a copy of `source`, using the cheapest method the filesystems allow.
+// `contents` has to match the source, it is written directly when nothing else works. Throws std::runtime_error on failure.
+// Not traced, the caller names the span after the method returned.
+CopyMethod copyOutputFile(const std::filesystem::path& source, const std::filesystem::path& target, std::string_view contents, bool hardLink);
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+struct IndexRange
+{
+    std::size_t begin;
+    std::size_t end;
+};
+
+// 0 means "use every core".
+inline unsigned int resolveJobCount(unsigned int jobs)
+{
+    if (jobs == 0)
+    {
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    return jobs;
+}
+
+// Splits [0, count) into at most `parts` contiguous ranges of at least `minimumSize` elements.
+inline std::vector<IndexRange> splitRange(std::size_t count, unsigned int parts, std::size_t minimumSize)
+{
+    std::size_t rangeCount = std::max<std::size_t>(1, std::min<std::size_t>(parts, count / std::max<std::size_t>(1, minimumSize)));
+
+    std::vector<IndexRange> ranges;
+    ranges.reserve(rangeCount);
+
+    for (std::size_t i = 0; i < rangeCount; ++i)
+    {
+        ranges.push_back({count * i / rangeCount, count * (i + 1) / rangeCount});
+    }
+
+    return ranges;
+}
+
+// Runs every task on up to `jobs` threads, including the calling one.
+// Tasks are picked up in order; the first exception is rethrown once all of them are done.
+inline void runConcurrently(const std::vector<std::function<void()>>& tasks, unsigned int jobs)
+{
+    std::atomic<std::size_t> nextTask{0};
+    std::exception_ptr firstException;
+    std::mutex exceptionMutex;
+
+    auto worker = [&]()
+    {
+        for (auto taskIndex = nextTask++; taskIndex < tasks.size(); taskIndex = nextTask++)
+        {
+            try
+            {
+                tasks[taskIndex]();
+            }
+            catch (...)
+            {
+                std::lock_guard lock(exceptionMutex);
+                if (!firstException)
+                {
+                    firstException = std::current_exception();
+                }
+            }
+        }
+    };
+
+    auto threadCount = std::min<std::size_t>(resolveJobCount(jobs), tasks.size());
+
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+    threads.clear();
+
+    if (firstException)
+    {
+        std::rethrow_exception(firstException);
+    }
+}
+
+// Hands items from one pipeline stage to the next. push() waits while the queue is full and pop() while it is empty.
+// After close(), push() drops its item and returns false, and pop() returns what is left, then nothing.
+template<typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t capacity) : m_capacity{std::max<std::size_t>(1, capacity)}
+    {
+
+    }
+
+    bool push(T item)
+    {
+        std::unique_lock lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+
+        if (m_closed)
+        {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop()
+    {
+        std::unique_lock lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+
+        if (m_items.empty())
+        {
+            return std::nullopt;
+        }
+
+        auto item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return item;
+    }
+
+    void close()
+    {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_notFull;
+    std::condition_variable m_notEmpty;
+    std::deque<T> m_items;
+    std::size_t m_capacity;
+    bool m_closed{false};
+};
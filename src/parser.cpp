@@ -1,9 +1,16 @@
 #include "parser.hpp"
+#include "demangler.hpp"
+#include "hash.hpp"
+#include "trace.hpp"
 
 #include <cxxabi.h>
 
+#include <algorithm>
 #include <map>
 #include <memory>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
 
 std::unique_ptr<char, DemangledSymbolDeallocator> demangleSymbol(const char *abiName)
 {
@@ -81,19 +88,156 @@ std::span<const unsigned char> getDataForSymbol(const ProgramInfo &programInfo,
     return {};
 }
 
-Out parse(ProgramInfo &programInfo)
+// Pointer-sized word of a symbol, with its relocation applied.
+struct Slot
+{
+    LargeNumber value;
+    bool relocated; // Only pointers get relocations, vcall/vbase offsets never do
+    std::span<const SymbolInfo* const> importSymbols; // Function imported from a dependency, see SymbolCache
+};
+
+static std::vector<Slot> readSlots(const ProgramInfo &programInfo, const std::vector<const RelocationInfo*> &relocationsByAddress, const SymbolInfo &symbol, std::span<const unsigned char> symbolData)
+{
+    using DataViewType = std::uint32_t;
+    const int BYTES_PER_ELEMENT = sizeof(DataViewType); // 4 from Uint32Array.BYTES_PER_ELEMENT
+    auto symbolDataView = std::span(reinterpret_cast<const DataViewType*>(symbolData.data()), symbolData.size() / BYTES_PER_ELEMENT);
+
+    std::vector<Slot> slots;
+    slots.reserve(symbolDataView.size() * BYTES_PER_ELEMENT / std::max(programInfo.addressSize, BYTES_PER_ELEMENT));
+
+    for (DataViewType index = 0; index < symbolDataView.size(); ++index)
+    {
+        Slot slot{};
+        slot.value.high = 0;
+        slot.value.low = symbolDataView[index];
+        slot.value.isUnsigned = true;
+
+        // Note: Relocations not supported for 64-bit bins
+        if (programInfo.addressSize > BYTES_PER_ELEMENT)
+        {
+            if (++index == symbolDataView.size())
+            {
+                break;
+            }
+
+            slot.value.high = symbolDataView[index];
+        }
+        else if (programInfo.addressSize == BYTES_PER_ELEMENT)
+        {
+            auto localAddress = static_cast<unsigned long long>(symbol.address.low + (index * BYTES_PER_ELEMENT));
+
+            auto relocations = std::ranges::equal_range(relocationsByAddress, localAddress, {}, [](const RelocationInfo *relocation) { return static_cast<unsigned long long>(relocation->address); });
+            if (!relocations.empty())
+            {
+                slot.relocated = true;
+
+                if (relocations.back()->target)
+                {
+                    slot.value = relocations.back()->target;
+                }
+
+                slot.importSymbols = relocations.back()->importSymbols;
+            }
+        }
+
+        slots.push_back(slot);
+    }
+
+    return slots;
+}
+
+static int64_t signedValue(const ProgramInfo &programInfo, LargeNumber value)
+{
+    if (programInfo.addressSize > 4)
+    {
+        return static_cast<int64_t>(static_cast<unsigned long long>(value));
+    }
+
+    return static_cast<int32_t>(value.low);
+}
+
+// Reads the base classes out of __si_class_type_info and __vmi_class_type_info objects, telling them apart by size.
+static std::vector<std::pair<uint32_t, BaseClass>> readBaseClasses(const ProgramInfo &programInfo, const std::vector<const RelocationInfo*> &relocationsByAddress, const std::vector<TypeInfo> &types, const std::vector<const SymbolInfo*> &typeInfoSymbols)
+{
+    auto findType = [&types](LargeNumber id)
+    {
+        auto it = std::ranges::lower_bound(types, static_cast<unsigned long long>(id), {}, [](const TypeInfo &type) { return static_cast<unsigned long long>(type.id); });
+        if (it == types.end() || static_cast<unsigned long long>(it->id) != static_cast<unsigned long long>(id))
+        {
+            return ClassHierarchy::NONE;
+        }
+
+        return static_cast<uint32_t>(it - types.begin());
+    };
+
+    std::vector<std::pair<uint32_t, BaseClass>> edges;
+
+    for (uint32_t type = 0; type < types.size(); ++type)
+    {
+        const auto& symbol = *typeInfoSymbols[type];
+
+        auto slots = readSlots(programInfo, relocationsByAddress, symbol, getDataForSymbol(programInfo, symbol));
+
+        // __class_type_info: vtable, name
+        if (slots.size() < 3)
+        {
+            continue;
+        }
+
+        // __si_class_type_info: vtable, name, base
+        if (slots.size() == 3)
+        {
+            auto baseType = findType(slots[2].value);
+            if (baseType != ClassHierarchy::NONE)
+            {
+                edges.emplace_back(type, BaseClass{baseType, 0, false, true});
+            }
+
+            continue;
+        }
+
+        // __vmi_class_type_info: vtable, name, 32-bit flags, 32-bit base count, (base, offset and flags) for each base
+        uint32_t baseCount = slots[3].value.low;
+        std::size_t firstBase = 4;
+        if (programInfo.addressSize > 4)
+        {
+            baseCount = slots[2].value.high;
+            firstBase = 3;
+        }
+
+        for (uint32_t baseIndex = 0; baseIndex < baseCount && firstBase + baseIndex * 2 + 1 < slots.size(); ++baseIndex)
+        {
+            auto baseType = findType(slots[firstBase + baseIndex * 2].value);
+            if (baseType == ClassHierarchy::NONE)
+            {
+                continue;
+            }
+
+            auto offsetFlags = signedValue(programInfo, slots[firstBase + baseIndex * 2 + 1].value);
+            edges.emplace_back(type, BaseClass{baseType, offsetFlags >> 8, (offsetFlags & 1) != 0, (offsetFlags & 2) != 0});
+        }
+    }
+
+    return edges;
+}
+
+Generator<const ClassInfo&> parseClasses(ProgramInfo &programInfo, Out &out)
 {
     if (!programInfo.error.empty())
     {
         std::cerr << programInfo.error << std::endl;
-        return {};
+        co_return;
     }
 
-    Out out{};
+    auto symbolAddress = [](const SymbolInfo *symbol) { return static_cast<unsigned long long>(symbol->address); };
+    auto relocationAddress = [](const RelocationInfo *relocation) { return static_cast<unsigned long long>(relocation->address); };
 
-    std::vector<SymbolInfo> listOfVirtualClasses;
-    std::map<LargeNumber, std::vector<SymbolInfo>> addressToSymbolMap;
-    for (const auto& symbol : programInfo.symbols)
+    // Sorted views instead of maps of copies; aliases and duplicate relocations keep their table order.
+    std::vector<const SymbolInfo*> listOfVirtualClasses;
+    std::vector<const SymbolInfo*> listOfTypeInfos;
+    std::vector<const SymbolInfo*> symbolsByAddress;
+    std::size_t slotCount = 0;
+    for (const auto& symbol : programInfo.symbols.get())
     {
         if (static_cast<unsigned long long>(symbol.address) == 0 || symbol.size == 0 || symbol.name.empty())
         {
@@ -102,23 +246,140 @@ Out parse(ProgramInfo &programInfo)
 
         if (symbol.name.starts_with("_ZTV"))
         {
-            listOfVirtualClasses.push_back(symbol);
+            listOfVirtualClasses.push_back(&symbol);
+            slotCount += static_cast<unsigned long long>(symbol.size) / std::max(programInfo.addressSize, 4);
+        }
+        else if (symbol.name.starts_with("_ZTI"))
+        {
+            listOfTypeInfos.push_back(&symbol);
         }
 
-        addressToSymbolMap[symbol.address].push_back(symbol);
+        symbolsByAddress.push_back(&symbol);
     }
 
-    std::map<LargeNumber, LargeNumber> relocationMap;
-    for (const auto& relocation : programInfo.relocations)
+    std::ranges::stable_sort(symbolsByAddress, {}, symbolAddress);
+
+    std::vector<const RelocationInfo*> relocationsByAddress;
+    relocationsByAddress.reserve(programInfo.relocations.get().size());
+    for (const auto& relocation : programInfo.relocations.get())
+    {
+        relocationsByAddress.push_back(&relocation);
+    }
+
+    std::ranges::stable_sort(relocationsByAddress, {}, relocationAddress);
+
+    // One type per typeinfo object, the first symbol naming it wins.
+    std::ranges::stable_sort(listOfTypeInfos, {}, symbolAddress);
+    auto duplicateTypeInfos = std::ranges::unique(listOfTypeInfos, {}, symbolAddress);
+    listOfTypeInfos.erase(duplicateTypeInfos.begin(), duplicateTypeInfos.end());
+
+    std::vector<TypeInfo> types;
+    types.reserve(listOfTypeInfos.size());
+
+    std::unordered_map<std::string_view, uint32_t> typesByName;
+    for (const auto typeInfoSymbol : listOfTypeInfos)
     {
-        relocationMap[relocation.address] = relocation.target;
+        typesByName.emplace(typeInfoSymbol->name.substr(4), static_cast<uint32_t>(types.size()));
+        types.push_back({typeInfoSymbol->address, typeInfoSymbol->name, nullptr});
+    }
+
+    {
+        TRACE_SCOPE("read typeinfo");
+
+        auto baseClasses = readBaseClasses(programInfo, relocationsByAddress, types, listOfTypeInfos);
+        out.hierarchy = ClassHierarchy(std::move(types), baseClasses);
     }
 
     std::map<LargeNumber, FunctionInfo*> addressToFunctionMap;
 
-    for (const auto& symbol : listOfVirtualClasses)
+    // Imported functions have no address in this library, they are told apart by their symbols in the dependency.
+    std::unordered_map<const SymbolInfo* const*, FunctionInfo*> importedFunctionMap;
+
+    // Packed copy of the fields the formatter compares, see FunctionTable, filled in as functions are found.
+    std::unordered_map<std::string_view, uint32_t> nameIds;
+    auto internName = [&nameIds](std::string_view name)
+    {
+        return nameIds.try_emplace(name, static_cast<uint32_t>(nameIds.size())).first->second;
+    };
+
+    auto addToFunctionTable = [&out, &internName](FunctionInfo &function)
+    {
+        auto& table = out.functionTable;
+
+        uint8_t flags = 0;
+        flags |= function.isThunk ? FunctionTable::THUNK : 0;
+        flags |= function.isMulti ? FunctionTable::MULTI : 0;
+        flags |= !function.symbol.name.empty() ? FunctionTable::HAS_SYMBOL : 0;
+        flags |= function.name.starts_with('~') ? FunctionTable::DESTRUCTOR : 0;
+
+        function.index = static_cast<FunctionId>(table.functions.size());
+        table.nameIds.push_back(internName(function.name));
+        table.shortNameIds.push_back(internName(function.shortName));
+        table.flags.push_back(flags);
+        table.functions.push_back(&function);
+    };
+
+    // Function sequences of all vtables, each distinct one is stored once in out.vtableFunctions.
+    // Room for every slot is reserved up front: classes are yielded with their slices, which must not move afterwards.
+    struct Slice
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    out.vtableFunctions.reserve(slotCount);
+    out.vtableFunctionIds.reserve(slotCount);
+
+    std::unordered_map<uint64_t, std::vector<Slice>> slicesByHash;
+    std::vector<FunctionInfo*> vtableFunctions;
+
+    auto addSlice = [&out, &slicesByHash](const std::vector<FunctionInfo*> &functions)
     {
-        auto symbolDemangledName = std::string(demangleSymbol(symbol.name.c_str()).get() + 11);
+        auto& slices = slicesByHash[hashBytes(functions.data(), functions.size() * sizeof(FunctionInfo*))];
+        for (const auto& slice : slices)
+        {
+            if (std::equal(functions.begin(), functions.end(), out.vtableFunctions.begin() + slice.offset, out.vtableFunctions.begin() + slice.offset + slice.size))
+            {
+                return slice;
+            }
+        }
+
+        if (out.vtableFunctions.size() + functions.size() > out.vtableFunctions.capacity())
+        {
+            throw std::runtime_error("vtable has more functions than slots");
+        }
+
+        Slice slice{out.vtableFunctions.size(), functions.size()};
+        out.vtableFunctions.insert(out.vtableFunctions.end(), functions.begin(), functions.end());
+        for (const auto function : functions)
+        {
+            out.vtableFunctionIds.push_back(function->index);
+        }
+
+        slices.push_back(slice);
+        return slice;
+    };
+
+    // Shared by every pure virtual and deleted slot, so that vtables differing only there are still identical.
+    FunctionInfo *pureVirtualFunction = nullptr;
+
+    Demangler demangler;
+
+    // One trace span per batch of vtables, a span per class would drown the trace.
+    constexpr std::size_t VTABLES_PER_TRACE_SPAN = 256;
+    std::optional<TraceScope> batchScope;
+
+    for (std::size_t classIndex = 0; classIndex < listOfVirtualClasses.size(); ++classIndex)
+    {
+        if (classIndex % VTABLES_PER_TRACE_SPAN == 0)
+        {
+            batchScope.reset();
+            batchScope.emplace("parse vtables");
+        }
+
+        const auto& symbol = *listOfVirtualClasses[classIndex];
+
+        auto symbolDemangledName = std::string(demangler.demangle(symbol.name.data()).entity);
 
         auto symbolData = getDataForSymbol(programInfo, symbol);
         if (symbolData.empty())
@@ -136,118 +397,104 @@ Out parse(ProgramInfo &programInfo)
         classInfo.name = symbolDemangledName;
         classInfo.hasMissingFunctions = false;
 
-        using DataViewType = std::uint32_t;
-        const int BYTES_PER_ELEMENT = sizeof(DataViewType); // 4 from Uint32Array.BYTES_PER_ELEMENT
-        auto symbolDataView = std::span(reinterpret_cast<const DataViewType*>(symbolData.data()), symbolData.size() / BYTES_PER_ELEMENT);
-
-        VTable *classVTable{};
-
-        for (DataViewType functionIndex = 0; functionIndex < symbolDataView.size(); ++functionIndex)
+        auto type = typesByName.find(symbol.name.substr(4));
+        if (type != typesByName.end())
         {
-            LargeNumber functionAddress;
-            functionAddress.high = 0;
-            functionAddress.low = symbolDataView[functionIndex];
-            functionAddress.isUnsigned = true;
+            classInfo.type = type->second;
 
-            // Note: Relocations not supported for 64-bit bins
-            if (programInfo.addressSize > BYTES_PER_ELEMENT)
+            if (!out.hierarchy.types()[classInfo.type].classInfo)
             {
-                functionAddress.high = symbolDataView[++functionIndex];
+                out.hierarchy.attach(classInfo.type, &classInfo);
             }
-            else if (programInfo.addressSize == BYTES_PER_ELEMENT)
-            {
-                LargeNumber localAddress;
-                localAddress.high = 0;
-                localAddress.low = symbol.address.low + (functionIndex * BYTES_PER_ELEMENT);
-                localAddress.isUnsigned = true;
+        }
 
-                auto targetAddress = relocationMap[localAddress];
-                if (targetAddress)
-                {
-                    functionAddress = targetAddress;
-                }
-            }
+        auto slots = readSlots(programInfo, relocationsByAddress, symbol, symbolData);
 
-            auto functionSymbolsIterator = addressToSymbolMap.find(functionAddress);
+        auto symbolsAt = [&symbolsByAddress, &symbolAddress](const LargeNumber &address)
+        {
+            auto symbols = std::ranges::equal_range(symbolsByAddress, static_cast<unsigned long long>(address), {}, symbolAddress);
+            return std::span<const SymbolInfo* const>(symbols.begin(), symbols.end());
+        };
 
-            auto addPureVirtualFunction = [&out, &classVTable, &classInfo]()
-            {
-                auto& pureVirtualFunction = out.functions.emplace_back();
-                classInfo.hasMissingFunctions = true;
-                pureVirtualFunction.name = "(pure virtual function)";
+        auto slotSymbols = [&symbolsAt](const Slot &slot)
+        {
+            return slot.importSymbols.empty() ? symbolsAt(slot.value) : slot.importSymbols;
+        };
 
-                classVTable->functions.push_back(&pureVirtualFunction);
-            };
+        // Subobject offset and slot of the first function, for every vtable of the class.
+        std::vector<std::pair<int64_t, std::size_t>> addressPoints;
 
-            // This could be the end of the vtable, or it could just be a pure/deleted func.
-            if (functionSymbolsIterator == addressToSymbolMap.end())
+        auto finishVTable = [&out, &classInfo, &vtableFunctions, &addSlice]()
+        {
+            if (!classInfo.vtables.empty())
             {
-                if (classInfo.vtables.empty() || static_cast<unsigned long long>(functionAddress) != 0)
-                {
-                    auto& newClassVTable = classInfo.vtables.emplace_back();
-                    classVTable = &newClassVTable;
-                    classVTable->offset = ~(functionAddress.low - 1);
-
-                    // Skip the RTTI pointer and thisptr adjuster,
-                    // We'll need to do more work here for virtual bases.
-                    auto skip = programInfo.addressSize / BYTES_PER_ELEMENT;
-                    functionIndex += skip;
-                }
-                else
-                {
-                    addPureVirtualFunction();
-                }
+                auto slice = addSlice(vtableFunctions);
+                classInfo.vtables.back().functions = std::span(out.vtableFunctions).subspan(slice.offset, slice.size);
+                classInfo.vtables.back().functionIds = std::span<const FunctionId>(out.vtableFunctionIds).subspan(slice.offset, slice.size);
+                vtableFunctions.clear();
+            }
+        };
 
-                continue;
+        auto addVTable = [&classInfo, &slots, &addressPoints, &finishVTable](std::size_t offsetToTopIndex)
+        {
+            finishVTable();
+
+            auto& classVTable = classInfo.vtables.emplace_back();
+            classVTable.offset = ~(slots[offsetToTopIndex].value.low - 1);
+
+            addressPoints.emplace_back(static_cast<int32_t>(classVTable.offset.low), offsetToTopIndex + 2);
+        };
+
+        auto addPureVirtualFunction = [&out, &pureVirtualFunction, &vtableFunctions, &classInfo, &addToFunctionTable]()
+        {
+            if (!pureVirtualFunction)
+            {
+                pureVirtualFunction = &out.functions.emplace_back();
+                pureVirtualFunction->name = "(pure virtual function)";
+                addToFunctionTable(*pureVirtualFunction);
             }
 
-            auto functionSymbols = functionSymbolsIterator->second;
-            const auto& functionSymbol = functionSymbols.back();
+            classInfo.hasMissingFunctions = true;
+            vtableFunctions.push_back(pureVirtualFunction);
+        };
+
+        auto addFunction = [&](const Slot &slot, std::span<const SymbolInfo* const> functionSymbols)
+        {
+            const auto& functionAddress = slot.value;
+            const auto& functionSymbol = *functionSymbols.back();
 
             auto functionSymbolName = functionSymbol.name;
             if (functionSymbolName == "__cxa_deleted_virtual" || functionSymbolName == "__cxa_pure_virtual")
             {
                 addPureVirtualFunction();
-                continue;
+                return;
             }
 
             FunctionInfo *functionInfoPtr = nullptr;
 
-            auto functionInfoIterator = addressToFunctionMap.find(functionAddress);
-            if (functionInfoIterator != addressToFunctionMap.end())
+            auto& knownFunction = slot.importSymbols.empty() ? addressToFunctionMap[functionAddress] : importedFunctionMap[slot.importSymbols.data()];
+            if (knownFunction)
             {
-                const auto& functionInfo = functionInfoIterator->second;
+                const auto& functionInfo = knownFunction;
                 functionInfoPtr = functionInfo;
-            }
-            else
-            {
-                auto demangledSymbolPtr = demangleSymbol(functionSymbolName.c_str());
-                auto demangledSymbol = std::string(demangledSymbolPtr.get());
-                std::string name = demangledSymbol;
-                std::string shortName = demangledSymbol;
-                std::string nameSpace = demangledSymbol;
-
-                auto startOfName = demangledSymbol.rfind("::");
-                if (startOfName != std::string::npos)
-                {
-                    name = name.substr(startOfName + 2);
-                    nameSpace.resize(startOfName);
-                }
 
-                auto startOfArgs = demangledSymbol.rfind('(');
-                if (startOfArgs != std::string::npos)
+                if (functionInfo->classes.back() != &classInfo)
                 {
-                    shortName = shortName.substr(startOfName + 2, startOfArgs - startOfName - 2);
+                    functionInfo->classes.push_back(&classInfo);
                 }
+            }
+            else
+            {
+                auto demangled = demangler.demangle(functionSymbolName.data());
 
                 FunctionInfo functionInfo;
 
-                functionInfo.id = functionAddress;
+                functionInfo.id = slot.importSymbols.empty() ? functionAddress : functionSymbol.address;
                 functionInfo.symbol = functionSymbol;
-                functionInfo.demangledSymbol = demangledSymbol;
-                functionInfo.name = name;
-                functionInfo.shortName = shortName;
-                functionInfo.nameSpace = nameSpace;
+                functionInfo.demangledSymbol = demangled.text;
+                functionInfo.name = demangled.name;
+                functionInfo.shortName = demangled.shortName;
+                functionInfo.nameSpace = demangled.nameSpace;
                 functionInfo.isThunk = false;
                 functionInfo.isMulti = functionSymbols.size() > 1;
                 functionInfo.classes.push_back(&classInfo);
@@ -255,18 +502,159 @@ Out parse(ProgramInfo &programInfo)
                 if (functionSymbol.name.starts_with("_ZTh"))
                 {
                     functionInfo.isThunk = true;
-                    functionInfo.name = demangledSymbol.substr(21); // remove "non-virtual thunk to" substring
+                    functionInfo.name = demangled.entity; // without "non-virtual thunk to "
                 }
 
                 out.functions.push_back(functionInfo);
                 functionInfoPtr = &out.functions.back();
+                addToFunctionTable(*functionInfoPtr);
 
-                addressToFunctionMap[functionAddress] = functionInfoPtr;
+                knownFunction = functionInfoPtr;
             }
 
-            classVTable->functions.push_back(functionInfoPtr);
+            vtableFunctions.push_back(functionInfoPtr);
+        };
+
+        // Every vtable of the class points at its typeinfo, right before the first function.
+        std::vector<std::size_t> typeInfoSlots;
+        if (classInfo.type != ClassHierarchy::NONE)
+        {
+            auto typeInfoAddress = static_cast<unsigned long long>(out.hierarchy.types()[classInfo.type].id);
+            for (std::size_t slotIndex = 1; slotIndex < slots.size(); ++slotIndex)
+            {
+                if (static_cast<unsigned long long>(slots[slotIndex].value) == typeInfoAddress)
+                {
+                    typeInfoSlots.push_back(slotIndex);
+                }
+            }
         }
+
+        if (typeInfoSlots.empty())
+        {
+            for (std::size_t slotIndex = 0; slotIndex < slots.size(); ++slotIndex)
+            {
+                const auto& functionAddress = slots[slotIndex].value;
+                auto functionSymbols = slotSymbols(slots[slotIndex]);
+
+                // This could be the end of the vtable, or it could just be a pure/deleted func.
+                if (functionSymbols.empty())
+                {
+                    if (classInfo.vtables.empty() || static_cast<unsigned long long>(functionAddress) != 0)
+                    {
+                        addVTable(slotIndex);
+
+                        // Skip the RTTI pointer
+                        slotIndex++;
+                    }
+                    else
+                    {
+                        addPureVirtualFunction();
+                    }
+
+                    continue;
+                }
+
+                addFunction(slots[slotIndex], functionSymbols);
+            }
+        }
+        else
+        {
+            // Each vtable is [vcall and vbase offsets] offset to top, RTTI pointer, functions.
+            auto isOffset = [&](std::size_t slotIndex)
+            {
+                return !slots[slotIndex].relocated && symbolsAt(slots[slotIndex].value).empty();
+            };
+
+            for (std::size_t vtableIndex = 0; vtableIndex < typeInfoSlots.size(); ++vtableIndex)
+            {
+                auto typeInfoSlot = typeInfoSlots[vtableIndex];
+                addVTable(typeInfoSlot - 1);
+
+                auto end = slots.size();
+                if (vtableIndex + 1 < typeInfoSlots.size())
+                {
+                    end = typeInfoSlots[vtableIndex + 1] - 1;
+                    while (end > typeInfoSlot + 1 && isOffset(end - 1))
+                    {
+                        end--;
+                    }
+                }
+
+                for (auto slotIndex = typeInfoSlot + 1; slotIndex < end; ++slotIndex)
+                {
+                    auto functionSymbols = slotSymbols(slots[slotIndex]);
+                    if (functionSymbols.empty())
+                    {
+                        addPureVirtualFunction();
+                        continue;
+                    }
+
+                    addFunction(slots[slotIndex], functionSymbols);
+                }
+            }
+        }
+
+        finishVTable();
+
+        if (classInfo.type == ClassHierarchy::NONE)
+        {
+            co_yield classInfo;
+            continue;
+        }
+
+        // Lay out the base subobjects, reading virtual base offsets out of the vtables, and match them to the vtables.
+        std::vector<std::pair<uint32_t, int64_t>> subobjects{{classInfo.type, 0}};
+        for (std::size_t subobjectIndex = 0; subobjectIndex < subobjects.size(); ++subobjectIndex)
+        {
+            auto [subobjectType, subobjectOffset] = subobjects[subobjectIndex];
+
+            for (const auto& base : out.hierarchy.bases(subobjectType))
+            {
+                auto baseOffset = subobjectOffset + base.offset;
+
+                if (base.isVirtual)
+                {
+                    auto addressPoint = std::ranges::find(addressPoints, subobjectOffset, &std::pair<int64_t, std::size_t>::first);
+                    if (addressPoint == addressPoints.end())
+                    {
+                        continue;
+                    }
+
+                    auto vbaseOffsetSlot = static_cast<int64_t>(addressPoint->second) + base.offset / programInfo.addressSize;
+                    if (vbaseOffsetSlot < 0 || vbaseOffsetSlot >= static_cast<int64_t>(slots.size()))
+                    {
+                        continue;
+                    }
+
+                    baseOffset = subobjectOffset + signedValue(programInfo, slots[vbaseOffsetSlot].value);
+                }
+
+                if (std::ranges::find(subobjects, std::pair{base.type, baseOffset}) == subobjects.end())
+                {
+                    subobjects.emplace_back(base.type, baseOffset);
+                }
+            }
+        }
+
+        for (auto& vtable : classInfo.vtables)
+        {
+            auto subobject = std::ranges::find(subobjects, static_cast<int64_t>(static_cast<int32_t>(vtable.offset.low)), &std::pair<uint32_t, int64_t>::second);
+            if (subobject != subobjects.end())
+            {
+                vtable.type = subobject->first;
+            }
+        }
+
+        co_yield classInfo;
+    }
+}
+
+Out parse(ProgramInfo &programInfo)
+{
+    Out out{};
+    for ([[maybe_unused]] const auto& classInfo : parseClasses(programInfo, out))
+    {
     }
 
     return out;
-};
+};
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "generator.hpp"
 #include "reader.hpp"
+#include "hierarchy.hpp"
 
 #include <functional>
 #include <list>
@@ -16,8 +18,11 @@ std::span<const unsigned char> getDataForSymbol(const ProgramInfo &programInfo,
 
 struct ClassInfo;
 
+using FunctionId = uint32_t; // Index into Out::functionTable
+
 struct FunctionInfo
 {
+    FunctionId index{};
     LargeNumber id;
     SymbolInfo symbol;
     std::string demangledSymbol; // CNEO_Player::CBaseEntity::EndTouch(CBaseEntity*)
@@ -32,21 +37,55 @@ struct FunctionInfo
 struct VTable
 {
     LargeNumber offset;
-    std::vector<FunctionInfo*> functions;
+    uint32_t type{ClassHierarchy::NONE}; // Class of the subobject this vtable belongs to
+    std::span<FunctionInfo* const> functions; // Slice of Out::vtableFunctions, shared by identical vtables
+    std::span<const FunctionId> functionIds; // Same slice of Out::vtableFunctionIds
 };
 
 struct ClassInfo
 {
     LargeNumber id;
     std::string name;
+    uint32_t type{ClassHierarchy::NONE}; // Index into Out::hierarchy
     std::vector<VTable> vtables;
     bool hasMissingFunctions;
 };
 
+// The FunctionInfo fields the formatter compares, packed by function index. Equal names get equal IDs.
+struct FunctionTable
+{
+    enum Flags : uint8_t
+    {
+        THUNK = 1,
+        MULTI = 2,
+        HAS_SYMBOL = 4,
+        DESTRUCTOR = 8,
+    };
+
+    std::vector<uint32_t> nameIds;
+    std::vector<uint32_t> shortNameIds;
+    std::vector<uint8_t> flags;
+    std::vector<const FunctionInfo*> functions;
+
+    std::size_t size() const { return functions.size(); }
+    bool has(FunctionId function, Flags flag) const { return (flags[function] & flag) != 0; }
+};
+
 struct Out
 {
     std::list<ClassInfo> classes;
     std::list<FunctionInfo> functions;
+    std::vector<FunctionInfo*> vtableFunctions;
+    std::vector<FunctionId> vtableFunctionIds;
+    FunctionTable functionTable;
+    ClassHierarchy hierarchy;
 };
 
 Out parse(ProgramInfo &programInfo);
+
+// Same as parse(), filling `out` as it goes and yielding every class as soon as its vtables are read, in parse() order.
+// A yielded class is complete and stays where it is in `out`, along with its vtable slices and the functions and
+// function table entries they refer to. Functions belong to out.functions and are shared between classes, so
+// FunctionInfo::classes keeps growing as later classes use them. The rest of `out` is complete once the generator
+// is done. `programInfo` and `out` must outlive the generator.
+Generator<const ClassInfo&> parseClasses(ProgramInfo &programInfo, Out &out);
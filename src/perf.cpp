@@ -0,0 +1,118 @@
+#include "perf.hpp"
+
+#include <fmt/format.h>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+struct PerfEventConfig
+{
+    uint32_t type;
+    uint64_t config;
+    std::string_view name;
+};
+
+static constexpr uint64_t cacheConfig(uint64_t cache, uint64_t operation, uint64_t result)
+{
+    return cache | (operation << 8) | (result << 16);
+}
+
+// In PerfEvent order.
+static constexpr std::array<PerfEventConfig, PERF_EVENT_COUNT> PERF_EVENT_CONFIGS{{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), "L1d misses"},
+    {PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), "LLC misses"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses"},
+}};
+
+PerfCounts PerfCounts::operator-(const PerfCounts& other) const
+{
+    PerfCounts counts;
+    for (std::size_t n = 0; n < PERF_EVENT_COUNT; n++)
+    {
+        if (values[n] && other.values[n])
+        {
+            counts.values[n] = *values[n] - std::min(*values[n], *other.values[n]);
+        }
+    }
+
+    return counts;
+}
+
+PerfCounters::PerfCounters()
+{
+    m_fds.fill(-1);
+
+    for (std::size_t n = 0; n < PERF_EVENT_COUNT; n++)
+    {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_EVENT_CONFIGS[n].type;
+        attr.config = PERF_EVENT_CONFIGS[n].config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1; // Threads started later count into this counter
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        // Not a group: inherited counters can't be read as one, and each event gets its own slot when multiplexed.
+        m_fds[n] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        if (m_fds[n] < 0 && m_error.empty())
+        {
+            m_error = fmt::format("{} - {}", PERF_EVENT_CONFIGS[n].name, std::strerror(errno));
+        }
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (auto fd : m_fds)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+bool PerfCounters::available() const
+{
+    return std::ranges::any_of(m_fds, [](int fd) { return fd >= 0; });
+}
+
+PerfCounts PerfCounters::read() const
+{
+    PerfCounts counts;
+
+    for (std::size_t n = 0; n < PERF_EVENT_COUNT; n++)
+    {
+        // Value, time enabled, time running
+        uint64_t data[3]{};
+        if (m_fds[n] < 0 || ::read(m_fds[n], data, sizeof(data)) != sizeof(data))
+        {
+            continue;
+        }
+
+        // Never scheduled, e.g. a virtual machine without that counter
+        if (data[2] == 0)
+        {
+            continue;
+        }
+
+        if (data[2] < data[1])
+        {
+            counts.values[n] = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+        }
+        else
+        {
+            counts.values[n] = data[0];
+        }
+    }
+
+    return counts;
+}
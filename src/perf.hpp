@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class PerfEvent
+{
+    Cycles,
+    Instructions,
+    L1dMisses,
+    LlcMisses,
+    BranchMisses
+};
+
+constexpr std::size_t PERF_EVENT_COUNT = 5;
+
+// Event counts, scaled up when the kernel multiplexed a counter. Events that couldn't be counted have no value.
+struct PerfCounts
+{
+    std::array<std::optional<uint64_t>, PERF_EVENT_COUNT> values;
+
+    std::optional<uint64_t> operator[](PerfEvent event) const { return values[static_cast<std::size_t>(event)]; }
+    PerfCounts operator-(const PerfCounts& other) const;
+};
+
+// Hardware counters for the calling thread and every thread it starts afterwards, user space only, so they work with
+// perf_event_paranoid up to 2. Containers often have no perf_event_open() at all, then nothing is counted.
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // At least one event is counted.
+    bool available() const;
+
+    // Why the first event that failed couldn't be opened.
+    const std::string& error() const { return m_error; }
+
+    PerfCounts read() const;
+
+private:
+    std::array<int, PERF_EVENT_COUNT> m_fds;
+    std::string m_error;
+};
@@ -1,4 +1,8 @@
 #include "reader.hpp"
+#include "elf.hpp"
+#include "dwarf.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
 
 #define __LIBELF_INTERNAL__ 1
 
@@ -7,10 +11,13 @@
 
 #define R_386_32 1
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
 
+#include <functional>
+#include <iterator>
 #include <string>
 
 #include <sys/mman.h>
@@ -19,13 +26,6 @@
 #include <unistd.h>
 #include <fcntl.h>
 
-struct VTableFieldOffsetDataRaw
-{
-    uint64_t class_name_ptr;
-    uint64_t member_name_ptr;
-    uint64_t offset;
-};
-
 LargeNumber::LargeNumber() : high{}, low{}, isUnsigned{}
 {
 
@@ -55,8 +55,10 @@ std::ostream& operator<<(std::ostream& os, const LargeNumber& number)
     return os;
 }
 
-ProgramInfo process(char *image, std::size_t size)
+static ProgramInfo processLibelf(char *image, std::size_t size, const ReaderOptions &options, std::span<char> debugImage)
 {
+    TRACE_SCOPE("process (libelf)");
+
     ProgramInfo programInfo = {};
 
     if (elf_version(EV_CURRENT) == EV_NONE)
@@ -116,6 +118,10 @@ ProgramInfo process(char *image, std::size_t size)
     Elf_Scn *relocationTableScn = nullptr;
 
     Elf_Scn *dynamicSymbolTableScn = nullptr;
+    size_t dynamicSymbolStringTableIndex = SHN_UNDEF;
+
+    Elf_Scn *dynamicScn = nullptr;
+    size_t dynamicStringTableIndex = SHN_UNDEF;
 
     Elf_Scn *symbolTableScn = nullptr;
 
@@ -130,6 +136,11 @@ ProgramInfo process(char *image, std::size_t size)
     Elf64_Addr relRodataOffset = 0;
     Elf_Scn *relRodataScn = nullptr;
 
+    Elf_Scn *memberOffsetsScn = nullptr;
+
+    std::vector<ElfSection> sections;
+    sections.reserve(numberOfSections);
+
     for (size_t elfSectionIndex = 0; elfSectionIndex < numberOfSections; ++elfSectionIndex)
     {
         Elf_Scn *elfScn = elf_getscn(elf, elfSectionIndex);
@@ -160,6 +171,12 @@ ProgramInfo process(char *image, std::size_t size)
         else if (elfSectionHeader.sh_type == SHT_DYNSYM && strcmp(name, ".dynsym") == 0)
         {
             dynamicSymbolTableScn = elfScn;
+            dynamicSymbolStringTableIndex = elfSectionHeader.sh_link;
+        }
+        else if (elfSectionHeader.sh_type == SHT_DYNAMIC && strcmp(name, ".dynamic") == 0)
+        {
+            dynamicScn = elfScn;
+            dynamicStringTableIndex = elfSectionHeader.sh_link;
         }
         else if (elfSectionHeader.sh_type == SHT_SYMTAB && strcmp(name, ".symtab") == 0)
         {
@@ -184,74 +201,193 @@ ProgramInfo process(char *image, std::size_t size)
         }
         else if(elfSectionHeader.sh_type == SHT_PROGBITS && strcmp(name, ".member_offsets") == 0)
         {
-            Elf_Data* data = elf_getdata(elfScn, nullptr);
-            if (data && data->d_size > 0)
-            {
-                size_t entry_count = data->d_size / sizeof(VTableFieldOffsetDataRaw);
-                auto entries = static_cast<const VTableFieldOffsetDataRaw*>(data->d_buf);
+            memberOffsetsScn = elfScn;
+        }
 
-                for (size_t i = 0; i < entry_count; ++i)
+        // Member offset names can point into any section, so all headers are kept for address translation.
+        auto& section = sections.emplace_back();
+        section.name = name;
+        section.index = static_cast<unsigned int>(elfSectionIndex);
+        section.type = elfSectionHeader.sh_type;
+        section.flags = elfSectionHeader.sh_flags;
+        section.address = elfSectionHeader.sh_addr;
+        section.offset = elfSectionHeader.sh_offset;
+        section.size = elfSectionHeader.sh_type == SHT_NOBITS ? 0 : elfSectionHeader.sh_size;
+        section.entrySize = elfSectionHeader.sh_entsize;
+        section.link = elfSectionHeader.sh_link;
+    }
+
+    // A stripped image has its symbol table in the debug file, which keeps the section numbering of the image.
+    Elf *symbolElf = elf;
+    Elf *debugElf = nullptr;
+    if (!symbolTableScn && !debugImage.empty())
+    {
+        debugElf = elf_memory(debugImage.data(), debugImage.size());
+        GElf_Ehdr debugElfHeader;
+        if (debugElf && gelf_getehdr(debugElf, &debugElfHeader) == &debugElfHeader && debugElfHeader.e_ident[EI_CLASS] == elfHeader.e_ident[EI_CLASS])
+        {
+            size_t numberOfDebugSections = 0;
+            elf_getshdrnum(debugElf, &numberOfDebugSections);
+
+            for (size_t debugSectionIndex = 1; debugSectionIndex < numberOfDebugSections; ++debugSectionIndex)
+            {
+                Elf_Scn *debugScn = elf_getscn(debugElf, debugSectionIndex);
+                GElf_Shdr debugSectionHeader;
+                if (!debugScn || gelf_getshdr(debugScn, &debugSectionHeader) != &debugSectionHeader || debugSectionHeader.sh_type != SHT_SYMTAB)
                 {
-#if 0
-                    std::cout << "VTableFieldOffsetData entry " << i << ":\n";
-                    std::cout << "  Class name: " << &image[entries[i].class_name_ptr] << "\n";
-                    std::cout << "  Member name: " << &image[entries[i].member_name_ptr] << "\n";
-                    std::cout << "  Offset: " << entries[i].offset << " (0x" << std::hex << entries[i].offset << std::dec << ")\n";
-#endif
-                    programInfo.vtableFieldDataEntries.emplace_back(&image[entries[i].class_name_ptr], &image[entries[i].member_name_ptr], entries[i].offset);
+                    continue;
                 }
+
+                symbolElf = debugElf;
+                symbolTableScn = debugScn;
+                stringTableIndex = debugSectionHeader.sh_link;
+                stringTableScn = elf_getscn(debugElf, stringTableIndex);
+                break;
             }
         }
-
-        if (relocationTableScn && dynamicSymbolTableScn && symbolTableScn && stringTableScn && rodataScn && relRodataScn)
+        else
         {
-            break;
+            programInfo.warnings.push_back("debug file is ignored - it isn't an ELF file of the same class as the library");
         }
     }
 
     if (!symbolTableScn || !stringTableScn || !rodataScn)
     {
         programInfo.error = "Failed to find all required ELF sections.";
+        if (debugElf)
+        {
+            elf_end(debugElf);
+        }
         return programInfo;
     }
 
     programInfo.rodataStart = rodataOffset;
     programInfo.rodataIndex = rodataIndex;
 
+    // libelf loads section data lazily, so everything the tasks below touch is loaded up front.
+    auto getAllData = [](Elf_Scn *scn)
+    {
+        std::vector<Elf_Data *> chunks;
+        Elf_Data *data = nullptr;
+        while (scn && (data = elf_getdata(scn, data)) != nullptr)
+        {
+            chunks.push_back(data);
+        }
+        return chunks;
+    };
+
+    auto relocationData = getAllData(relocationTableScn);
+    auto dynamicSymbolData = getAllData(dynamicSymbolTableScn);
+    auto symbolData = getAllData(symbolTableScn);
+    elf_strptr(symbolElf, stringTableIndex, 0);
+    if (dynamicSymbolTableScn)
+    {
+        elf_strptr(elf, dynamicSymbolStringTableIndex, 0);
+    }
+
+    // The libelf handles are closed before returning, so unlike the native backend everything is decoded here.
+    std::vector<std::function<void()>> tasks;
+    std::vector<RelocationInfo> relocations;
+
     if (relocationTableScn && dynamicSymbolTableScn)
     {
-        Elf_Data *relocationData = nullptr;
-        while ((relocationData = elf_getdata(relocationTableScn, relocationData)) != nullptr)
+        tasks.emplace_back([elf, dynamicSymbolStringTableIndex, &relocationData, &dynamicSymbolData, &relocations]()
         {
-            int relocationIndex = 0;
-            GElf_Rel relocation;
-            while (gelf_getrel(relocationData, relocationIndex++, &relocation) == &relocation)
-            {
-                size_t type = GELF_R_TYPE(relocation.r_info);
-                if (type != R_386_32)
-                {
-                    continue;
-                }
+            TRACE_SCOPE("read relocations");
 
-                Elf_Data *symbolData = nullptr;
-                while ((symbolData = elf_getdata(dynamicSymbolTableScn, symbolData)) != nullptr)
+            for (auto relocationChunk : relocationData)
+            {
+                int relocationIndex = 0;
+                GElf_Rel relocation;
+                while (gelf_getrel(relocationChunk, relocationIndex++, &relocation) == &relocation)
                 {
-                    GElf_Sym symbol;
-                    int symbolIndex = GELF_R_SYM(relocation.r_info);
-                    if (gelf_getsym(symbolData, symbolIndex, &symbol) != &symbol)
+                    size_t type = GELF_R_TYPE(relocation.r_info);
+                    if (type != R_386_32)
                     {
                         continue;
                     }
 
-                    RelocationInfo relocationInfo;
-                    relocationInfo.address = relocation.r_offset;
-                    relocationInfo.target = symbol.st_value;
-                    programInfo.relocations.push_back(std::move(relocationInfo));
+                    for (auto symbolChunk : dynamicSymbolData)
+                    {
+                        GElf_Sym symbol;
+                        int symbolIndex = GELF_R_SYM(relocation.r_info);
+                        if (gelf_getsym(symbolChunk, symbolIndex, &symbol) != &symbol)
+                        {
+                            continue;
+                        }
+
+                        RelocationInfo relocationInfo;
+                        relocationInfo.address = relocation.r_offset;
+                        relocationInfo.target = symbol.st_value;
+
+                        if (symbol.st_shndx == SHN_UNDEF)
+                        {
+                            if (auto importName = elf_strptr(elf, dynamicSymbolStringTableIndex, symbol.st_name))
+                            {
+                                relocationInfo.importName = importName;
+                            }
+                        }
+
+                        relocations.push_back(std::move(relocationInfo));
+
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    auto symbolSize = programInfo.addressSize == 8 ? sizeof(Elf64_Sym) : sizeof(Elf32_Sym);
+
+    std::vector<std::pair<Elf_Data *, IndexRange>> symbolRanges;
+    for (auto symbolChunk : symbolData)
+    {
+        for (const auto& range : splitRange(symbolChunk->d_size / symbolSize, resolveJobCount(options.jobs), SYMBOLS_PER_TASK))
+        {
+            symbolRanges.emplace_back(symbolChunk, range);
+        }
+    }
 
+    std::vector<std::vector<SymbolInfo>> symbolParts(symbolRanges.size());
+    std::vector<std::vector<std::string>> symbolErrors(symbolRanges.size());
+
+    for (std::size_t part = 0; part < symbolRanges.size(); ++part)
+    {
+        tasks.emplace_back([symbolElf, stringTableIndex, skipUnusedSymbols = options.skipUnusedSymbols, &symbolRange = symbolRanges[part], &symbolPart = symbolParts[part], &errors = symbolErrors[part]]()
+        {
+            TRACE_SCOPE("read symbols");
+
+            auto [symbolChunk, range] = symbolRange;
+            symbolPart.reserve(range.end - range.begin);
+
+            for (std::size_t symbolIndex = range.begin; symbolIndex < range.end; ++symbolIndex)
+            {
+                GElf_Sym symbol;
+                if (gelf_getsym(symbolChunk, static_cast<int>(symbolIndex), &symbol) != &symbol)
+                {
                     break;
                 }
+
+                const char *name = elf_strptr(symbolElf, stringTableIndex, symbol.st_name);
+                if (!name)
+                {
+                    errors.push_back("Failed to read the symbol name for " + std::to_string(symbolIndex + 1) + ". (" + std::string(elf_errmsg(-1)) + ")");
+                    continue;
+                }
+
+                if (skipUnusedSymbols && (symbol.st_value == 0 || symbol.st_size == 0 || name[0] == '\0'))
+                {
+                    continue;
+                }
+
+                SymbolInfo symbolInfo;
+                symbolInfo.section = symbol.st_shndx;
+                symbolInfo.address = symbol.st_value;
+                symbolInfo.size = symbol.st_size;
+                symbolInfo.name = name;
+                symbolPart.push_back(std::move(symbolInfo));
             }
-        }
+        });
     }
 
     Elf_Data *rodata = nullptr;
@@ -259,8 +395,7 @@ ProgramInfo process(char *image, std::size_t size)
     {
         RodataChunk rodataChunk;
         rodataChunk.offset = rodata->d_off;
-        auto buffer = static_cast<char *>(rodata->d_buf);
-        rodataChunk.data = std::vector<unsigned char>(buffer, buffer + rodata->d_size);
+        rodataChunk.data = {static_cast<const unsigned char *>(rodata->d_buf), rodata->d_size};
         programInfo.rodataChunks.push_back(std::move(rodataChunk));
     }
 
@@ -274,36 +409,114 @@ ProgramInfo process(char *image, std::size_t size)
         {
             RodataChunk relRodataChunk;
             relRodataChunk.offset = relRodata->d_off;
-            auto buffer = static_cast<char *>(relRodata->d_buf);
-            relRodataChunk.data = std::vector<unsigned char>(buffer, buffer + relRodata->d_size);
+            relRodataChunk.data = {static_cast<const unsigned char *>(relRodata->d_buf), relRodata->d_size};
             programInfo.relRodataChunks.push_back(std::move(relRodataChunk));
         }
     }
 
-    Elf_Data *symbolData = nullptr;
-    while ((symbolData = elf_getdata(symbolTableScn, symbolData)) != nullptr)
+    MemberOffsetIndex memberOffsets;
+    std::vector<std::string> memberOffsetErrors;
+
+    if (memberOffsetsScn)
+    {
+        Elf_Data *data = elf_getdata(memberOffsetsScn, nullptr);
+        if (data && data->d_size > 0)
+        {
+            tasks.emplace_back([image, &sections, data, &memberOffsets, &memberOffsetErrors]()
+            {
+                TRACE_SCOPE("read member offsets");
+
+                memberOffsets = readMemberOffsets(image, sections, {static_cast<const unsigned char *>(data->d_buf), data->d_size}, memberOffsetErrors);
+            });
+        }
+    }
+
+    runConcurrently(tasks, options.jobs);
+
+    for (const auto& error : memberOffsetErrors)
+    {
+        std::cerr << error << std::endl;
+    }
+
+    programInfo.symbols = LazySection<std::vector<SymbolInfo>>(mergeSymbolParts(symbolParts, symbolErrors));
+    programInfo.relocations = LazySection<std::vector<RelocationInfo>>(std::move(relocations));
+
+    if (debugElf)
+    {
+        ElfImage debugElfImage(debugImage.data(), debugImage.size());
+        addDwarfMemberOffsets(debugImage.data(), debugImage.size(), debugElfImage.sections(), memberOffsets);
+    }
+    else
+    {
+        addDwarfMemberOffsets(image, size, sections, memberOffsets);
+    }
+
+    programInfo.memberOffsets = LazySection<MemberOffsetIndex>(std::move(memberOffsets));
+
+    Elf_Data *dynamicData = nullptr;
+    while (dynamicScn && (dynamicData = elf_getdata(dynamicScn, dynamicData)) != nullptr)
     {
-        size_t symbolIndex = 0;
-        GElf_Sym symbol;
-        while (gelf_getsym(symbolData, symbolIndex++, &symbol) == &symbol)
+        GElf_Dyn entry;
+        for (int entryIndex = 0; gelf_getdyn(dynamicData, entryIndex, &entry) == &entry && entry.d_tag != DT_NULL; ++entryIndex)
         {
-            const char *name = elf_strptr(elf, stringTableIndex, symbol.st_name);
-            if (!name)
+            if (entry.d_tag != DT_NEEDED)
             {
-                std::cerr << "Failed to symbol name for " + std::to_string(symbolIndex) + ". (" + std::string(elf_errmsg(-1)) + ")" << std::endl;
                 continue;
             }
 
-            SymbolInfo symbolInfo;
-            symbolInfo.section = symbol.st_shndx;
-            symbolInfo.address = symbol.st_value;
-            symbolInfo.size = symbol.st_size;
-            symbolInfo.name = name;
-            programInfo.symbols.push_back(std::move(symbolInfo));
+            auto neededLibrary = elf_strptr(elf, dynamicStringTableIndex, entry.d_un.d_val);
+            if (neededLibrary && *neededLibrary)
+            {
+                programInfo.neededLibraries.push_back(neededLibrary);
+            }
         }
     }
 
+    if (debugElf)
+    {
+        elf_end(debugElf);
+    }
+
     elf_end(elf);
     return programInfo;
 }
 
+std::vector<SymbolInfo> mergeSymbolParts(std::vector<std::vector<SymbolInfo>> &symbolParts, const std::vector<std::vector<std::string>> &symbolErrors)
+{
+    std::size_t symbolCount = 0;
+    for (const auto& symbolPart : symbolParts)
+    {
+        symbolCount += symbolPart.size();
+    }
+
+    std::vector<SymbolInfo> symbols;
+    symbols.reserve(symbolCount);
+
+    for (std::size_t part = 0; part < symbolParts.size(); ++part)
+    {
+        for (const auto& error : symbolErrors[part])
+        {
+            std::cerr << error << std::endl;
+        }
+
+        std::move(symbolParts[part].begin(), symbolParts[part].end(), std::back_inserter(symbols));
+        symbolParts[part] = {};
+    }
+
+    return symbols;
+}
+
+ProgramInfo process(char *image, std::size_t size, const ReaderOptions &options, std::span<char> debugImage)
+{
+    switch (options.backend)
+    {
+    case ElfBackend::Native:
+        return processNative(image, size, options, debugImage);
+    case ElfBackend::Libelf:
+        return processLibelf(image, size, options, debugImage);
+    }
+
+    ProgramInfo programInfo = {};
+    programInfo.error = "Unknown ELF backend.";
+    return programInfo;
+}
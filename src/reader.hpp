@@ -1,9 +1,17 @@
 #pragma once
 
+#include "memberoffsets.hpp"
+
 #include <fmt/format.h>
 
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct LargeNumber
@@ -30,10 +38,11 @@ struct fmt::formatter<LargeNumber> : formatter<std::string>
     }
 };
 
+// Views into the input image, which has to outlive ProgramInfo.
 struct RodataChunk
 {
     LargeNumber offset;
-    std::vector<unsigned char> data;
+    std::span<const unsigned char> data;
 };
 
 struct SymbolInfo
@@ -41,25 +50,83 @@ struct SymbolInfo
     unsigned int section;
     LargeNumber address;
     LargeNumber size;
-    std::string name;
+    std::string_view name; // Always NUL-terminated, points into the string table
 };
 
 struct RelocationInfo
 {
     LargeNumber address;
     LargeNumber target;
+    std::string_view importName; // Undefined symbol the relocation refers to, defined by another library
+    std::span<const SymbolInfo* const> importSymbols; // Symbols at its address in that library, see SymbolCache
 };
 
-struct MemberOffset
+// A section decoded the first time it is accessed, from whichever thread gets there first, and kept.
+template <typename T>
+class LazySection
 {
-    std::string className;
-    std::string memberName;
-    uint64_t offset;
+public:
+    LazySection() : m_state{std::make_unique<State>()} {}
+
+    explicit LazySection(std::function<T()> decode) : LazySection()
+    {
+        m_state->decode = std::move(decode);
+    }
+
+    // Already decoded.
+    explicit LazySection(T value) : LazySection()
+    {
+        m_state->value = std::move(value);
+    }
+
+    const T& get() const
+    {
+        decode();
+        return m_state->value;
+    }
+
+    T& get()
+    {
+        decode();
+        return m_state->value;
+    }
+
+    // Drops the value, and the decoder with it if it never ran. Not thread-safe.
+    void release()
+    {
+        std::call_once(m_state->once, [] {});
+        m_state->decode = {};
+        m_state->value = {};
+    }
+
+private:
+    struct State
+    {
+        std::once_flag once;
+        std::function<T()> decode;
+        T value{};
+    };
+
+    void decode() const
+    {
+        std::call_once(m_state->once, [state = m_state.get()]()
+        {
+            if (state->decode)
+            {
+                state->value = state->decode();
+                state->decode = {};
+            }
+        });
+    }
+
+    std::unique_ptr<State> m_state;
 };
 
+// The sections after the rodata chunks are decoded on first access, so a run only pays for what it uses.
 struct ProgramInfo
 {
     std::string error;
+    std::vector<std::string> warnings; // Problems that didn't stop the decoding, like an unusable debug file
     int addressSize;
     unsigned int rodataIndex;
     LargeNumber rodataStart;
@@ -67,9 +134,32 @@ struct ProgramInfo
     unsigned int relRodataIndex;
     LargeNumber relRodataStart;
     std::vector<RodataChunk> relRodataChunks;
-    std::vector<SymbolInfo> symbols;
-    std::vector<RelocationInfo> relocations;
-    std::vector<MemberOffset> vtableFieldDataEntries;
+    std::vector<std::string_view> neededLibraries; // DT_NEEDED entries, in order
+    LazySection<std::vector<SymbolInfo>> symbols;
+    LazySection<std::vector<RelocationInfo>> relocations;
+    LazySection<MemberOffsetIndex> memberOffsets;
 };
 
-ProgramInfo process(char *image, std::size_t size);
+enum class ElfBackend
+{
+    Native,
+    Libelf,
+};
+
+struct ReaderOptions
+{
+    ElfBackend backend{ElfBackend::Native};
+    unsigned int jobs{0};
+    bool skipUnusedSymbols{false}; // Drop symbols parse() never looks at (no address, size or name)
+};
+
+// Symbol table slice decoded by a single task.
+constexpr std::size_t SYMBOLS_PER_TASK = 16384;
+
+// Concatenates per-task results in order, so the output does not depend on scheduling.
+std::vector<SymbolInfo> mergeSymbolParts(std::vector<std::vector<SymbolInfo>> &symbolParts, const std::vector<std::vector<std::string>> &symbolErrors);
+
+// The symbol table and debug info of a stripped image are read from `debugImage`, its separate debug file, which has
+// to outlive ProgramInfo as well. Everything else comes from the image. Errors in a lazily decoded section are printed
+// when it is decoded.
+ProgramInfo process(char *image, std::size_t size, const ReaderOptions &options = {}, std::span<char> debugImage = {});
@@ -0,0 +1,432 @@
+#include "search.hpp"
+#include "demangler.hpp"
+#include "hash.hpp"
+#include "output.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_set>
+
+// The text and arrays of the index follow the header as they are in memory, in host byte order.
+struct SearchIndexHeader
+{
+    char magic[8];
+    uint64_t librarySize;
+    int64_t modificationTime;
+    uint64_t fieldsHash;
+    uint64_t textSize;
+    uint64_t entryCount;
+    uint64_t trigramCount;
+    uint64_t postingCount;
+};
+
+constexpr char SEARCH_INDEX_MAGIC[8] = {'G', 'D', 'F', 'I', 'N', 'D', '0', '2'};
+
+// The text is padded so that the arrays after it are aligned in a mapped file.
+static uint64_t alignArray(uint64_t size)
+{
+    return (size + 7) & ~uint64_t{7};
+}
+
+static char foldCase(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static uint32_t trigramKey(const char *text)
+{
+    return static_cast<uint32_t>(static_cast<unsigned char>(foldCase(text[0]))) << 16
+        | static_cast<uint32_t>(static_cast<unsigned char>(foldCase(text[1]))) << 8
+        | static_cast<uint32_t>(static_cast<unsigned char>(foldCase(text[2])));
+}
+
+// Distinct trigrams of the text, in increasing order.
+static void collectTrigrams(std::string_view text, std::vector<uint32_t>& keys)
+{
+    keys.clear();
+    for (std::size_t i = 0; i + 3 <= text.size(); i++)
+    {
+        keys.push_back(trigramKey(text.data() + i));
+    }
+
+    std::ranges::sort(keys);
+    auto duplicates = std::ranges::unique(keys);
+    keys.erase(duplicates.begin(), duplicates.end());
+}
+
+// `foldedQuery` is lowercase already.
+static bool containsFolded(std::string_view text, std::string_view foldedQuery)
+{
+    return std::search(text.begin(), text.end(), foldedQuery.begin(), foldedQuery.end(), [](char a, char b) { return foldCase(a) == b; }) != text.end();
+}
+
+SearchIndexKey SearchIndexKey::of(const std::filesystem::path& libraryPath, const FieldNames& referencedFields)
+{
+    SearchIndexKey key;
+    key.size = std::filesystem::file_size(libraryPath);
+    key.modificationTime = std::filesystem::last_write_time(libraryPath).time_since_epoch().count();
+
+    std::string fields;
+    for (const auto& [className, memberName] : referencedFields)
+    {
+        fields += className;
+        fields += '\0';
+        fields += memberName;
+        fields += '\0';
+    }
+
+    key.fieldsHash = hashString(fields);
+
+    return key;
+}
+
+SearchIndex::SearchIndex(const Offsets& offsets, const MemberOffsetIndex& memberOffsets, const FieldNames& referencedFields, std::span<const SymbolInfo> symbols)
+{
+    std::string text;
+    std::vector<Entry> entries;
+
+    auto addEntry = [&](SearchEntryKind kind, std::string_view entryText, std::string_view mangledName, int32_t linuxValue, int32_t windowsValue)
+    {
+        Entry entry{};
+        entry.kind = kind;
+        entry.textOffset = static_cast<uint32_t>(text.size());
+        entry.textSize = static_cast<uint32_t>(entryText.size());
+        entry.mangledNameSize = static_cast<uint32_t>(mangledName.size());
+        entry.values[0] = linuxValue;
+        entry.values[1] = windowsValue;
+        entries.push_back(entry);
+
+        text += entryText;
+        text += mangledName;
+    };
+
+    for (const auto& [className, classVTables] : offsets)
+    {
+        for (const auto& [namespaceName, classNamespace] : classVTables)
+        {
+            for (const auto& [functionName, functionOffsets] : classNamespace)
+            {
+                addEntry(SearchEntryKind::VTableMethod, fmt::format("{}::{}::{}", className, namespaceName, functionName), {}, functionOffsets.linuxIndex, functionOffsets.windowsIndex);
+            }
+        }
+    }
+
+    for (const auto& member : listMemberOffsets(memberOffsets, referencedFields))
+    {
+        addEntry(SearchEntryKind::VTableField, fmt::format("{}::{}", member.className, member.memberName), {}, static_cast<int32_t>(member.offset), 0);
+    }
+
+    // .symtab repeats most of .dynsym.
+    Demangler demangler;
+    std::unordered_set<std::string_view> seenNames;
+    for (const auto& symbol : symbols)
+    {
+        if (symbol.name.empty() || !seenNames.insert(symbol.name).second)
+        {
+            continue;
+        }
+
+        auto demangled = demangler.demangle(symbol.name.data()).text;
+        addEntry(SearchEntryKind::Symbol, demangled, demangled == symbol.name ? std::string_view{} : symbol.name, 0, 0);
+    }
+
+    // (trigram, entry) pairs, sorted they are the posting lists one after another.
+    std::vector<uint64_t> pairs;
+    std::vector<uint32_t> keys;
+    for (uint32_t i = 0; i < entries.size(); i++)
+    {
+        collectTrigrams(std::string_view(text).substr(entries[i].textOffset, entries[i].textSize), keys);
+        for (auto key : keys)
+        {
+            pairs.push_back(static_cast<uint64_t>(key) << 32 | i);
+        }
+    }
+
+    std::ranges::sort(pairs);
+
+    std::vector<Trigram> trigrams;
+    std::vector<uint32_t> postings;
+    postings.reserve(pairs.size());
+    for (auto pair : pairs)
+    {
+        auto key = static_cast<uint32_t>(pair >> 32);
+        if (trigrams.empty() || trigrams.back().key != key)
+        {
+            trigrams.push_back({key, static_cast<uint32_t>(postings.size()), 0});
+        }
+
+        trigrams.back().count++;
+        postings.push_back(static_cast<uint32_t>(pair));
+    }
+
+    SearchIndexHeader header{};
+    std::memcpy(header.magic, SEARCH_INDEX_MAGIC, sizeof(header.magic));
+    header.textSize = text.size();
+    header.entryCount = entries.size();
+    header.trigramCount = trigrams.size();
+    header.postingCount = postings.size();
+
+    auto appendArray = [&](const auto *data, std::size_t size)
+    {
+        auto bytes = reinterpret_cast<const char *>(data);
+        m_image.insert(m_image.end(), bytes, bytes + size * sizeof(*data));
+    };
+
+    m_image.reserve(sizeof(header) + alignArray(text.size()) + entries.size() * sizeof(Entry) + trigrams.size() * sizeof(Trigram) + postings.size() * sizeof(uint32_t));
+    appendArray(&header, 1);
+    appendArray(text.data(), text.size());
+    m_image.resize(sizeof(header) + alignArray(text.size()));
+    appendArray(entries.data(), entries.size());
+    appendArray(trigrams.data(), trigrams.size());
+    appendArray(postings.data(), postings.size());
+
+    view(m_image.data(), m_image.size());
+}
+
+bool SearchIndex::view(const char *image, std::size_t size)
+{
+    static_assert(std::is_trivially_copyable_v<Entry> && std::is_trivially_copyable_v<Trigram>);
+
+    if (size < sizeof(SearchIndexHeader))
+    {
+        return false;
+    }
+
+    SearchIndexHeader header;
+    std::memcpy(&header, image, sizeof(header));
+
+    // Sizes from the file, checked one at a time so that nothing overflows.
+    auto remaining = size - sizeof(header);
+    auto take = [&](uint64_t count, std::size_t elementSize) -> const char *
+    {
+        if (count > remaining / elementSize)
+        {
+            return nullptr;
+        }
+
+        auto data = image + (size - remaining);
+        remaining -= count * elementSize;
+        return data;
+    };
+
+    auto text = take(header.textSize, 1);
+    if (!text || !take(alignArray(header.textSize) - header.textSize, 1))
+    {
+        return false;
+    }
+
+    auto entries = take(header.entryCount, sizeof(Entry));
+    auto trigrams = entries ? take(header.trigramCount, sizeof(Trigram)) : nullptr;
+    auto postings = trigrams ? take(header.postingCount, sizeof(uint32_t)) : nullptr;
+    if (!postings || remaining != 0)
+    {
+        return false;
+    }
+
+    m_text = {text, header.textSize};
+    m_entries = {reinterpret_cast<const Entry *>(entries), header.entryCount};
+    m_trigrams = {reinterpret_cast<const Trigram *>(trigrams), header.trigramCount};
+    m_postings = {reinterpret_cast<const uint32_t *>(postings), header.postingCount};
+
+    auto badEntry = [&](const Entry& entry) { return uint64_t{entry.textOffset} + entry.textSize + entry.mangledNameSize > m_text.size(); };
+    auto badTrigram = [&](const Trigram& trigram) { return uint64_t{trigram.first} + trigram.count > m_postings.size(); };
+    return std::ranges::none_of(m_entries, badEntry) && std::ranges::none_of(m_trigrams, badTrigram);
+}
+
+SearchEntry SearchIndex::entry(uint32_t index) const
+{
+    const auto& entry = m_entries[index];
+    std::string_view text{m_text};
+
+    SearchEntry result;
+    result.kind = entry.kind;
+    result.text = text.substr(entry.textOffset, entry.textSize);
+    result.mangledName = text.substr(entry.textOffset + entry.textSize, entry.mangledNameSize);
+    result.values[0] = entry.values[0];
+    result.values[1] = entry.values[1];
+    return result;
+}
+
+std::span<const uint32_t> SearchIndex::postings(uint32_t key) const
+{
+    auto trigram = std::ranges::lower_bound(m_trigrams, key, {}, &Trigram::key);
+    if (trigram == m_trigrams.end() || trigram->key != key)
+    {
+        return {};
+    }
+
+    return std::span<const uint32_t>(m_postings).subspan(trigram->first, trigram->count);
+}
+
+SearchIndex::Result SearchIndex::find(std::string_view query) const
+{
+    Result result;
+
+    std::string foldedQuery(query);
+    std::ranges::transform(foldedQuery, foldedQuery.begin(), foldCase);
+
+    auto addMatch = [&](uint32_t index)
+    {
+        if (result.entries.size() < MAX_RESULTS)
+        {
+            result.entries.push_back(entry(index));
+        }
+        result.matchCount++;
+    };
+
+    // Too short for a trigram, every entry is a candidate.
+    if (foldedQuery.size() < 3)
+    {
+        for (uint32_t i = 0; i < m_entries.size(); i++)
+        {
+            if (containsFolded(entry(i).text, foldedQuery))
+            {
+                addMatch(i);
+            }
+        }
+
+        return result;
+    }
+
+    std::vector<uint32_t> keys;
+    collectTrigrams(foldedQuery, keys);
+
+    // An entry containing the query has all its trigrams, starting from the rarest one.
+    std::vector<std::span<const uint32_t>> lists;
+    for (auto key : keys)
+    {
+        lists.push_back(postings(key));
+    }
+    std::ranges::sort(lists, {}, &std::span<const uint32_t>::size);
+
+    if (!lists.front().empty())
+    {
+        std::vector<uint32_t> candidates(lists.front().begin(), lists.front().end());
+        std::vector<uint32_t> remaining;
+        for (const auto& list : std::span(lists).subspan(1))
+        {
+            remaining.clear();
+            std::ranges::set_intersection(candidates, list, std::back_inserter(remaining));
+            candidates.swap(remaining);
+        }
+
+        // Entry numbers come from the file, they are only checked when used.
+        for (auto candidate : candidates)
+        {
+            if (candidate < m_entries.size() && containsFolded(entry(candidate).text, foldedQuery))
+            {
+                addMatch(candidate);
+            }
+        }
+    }
+
+    if (result.matchCount != 0)
+    {
+        return result;
+    }
+
+    // Nothing contains it, rank the entries sharing at least half of its trigrams by how many they share.
+    result.fuzzy = true;
+
+    std::vector<uint16_t> scores(m_entries.size());
+    for (const auto& list : lists)
+    {
+        for (auto index : list)
+        {
+            if (index < scores.size())
+            {
+                scores[index]++;
+            }
+        }
+    }
+
+    auto threshold = (keys.size() + 1) / 2;
+    std::vector<uint32_t> matches;
+    for (uint32_t i = 0; i < m_entries.size(); i++)
+    {
+        if (scores[i] >= threshold)
+        {
+            matches.push_back(i);
+        }
+    }
+
+    auto count = std::min(matches.size(), MAX_RESULTS);
+    std::ranges::partial_sort(matches, matches.begin() + static_cast<std::ptrdiff_t>(count), [&](uint32_t a, uint32_t b)
+    {
+        if (scores[a] != scores[b])
+        {
+            return scores[a] > scores[b];
+        }
+
+        if (m_entries[a].textSize != m_entries[b].textSize)
+        {
+            return m_entries[a].textSize < m_entries[b].textSize;
+        }
+
+        return a < b;
+    });
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        result.entries.push_back(entry(matches[i]));
+    }
+    result.matchCount = matches.size();
+
+    return result;
+}
+
+std::optional<SearchIndex> SearchIndex::load(const std::filesystem::path& path, const SearchIndexKey& key)
+{
+    if (!std::filesystem::exists(path))
+    {
+        return std::nullopt;
+    }
+
+    InputOptions options;
+    options.keepPageCache = true;
+
+    SearchIndex index;
+    index.m_file = std::make_unique<InputFile>(path.string(), options);
+
+    auto image = index.m_file->data();
+    auto size = index.m_file->size();
+
+    SearchIndexHeader header{};
+    if (size < sizeof(header) || std::memcmp(image, SEARCH_INDEX_MAGIC, sizeof(header.magic)) != 0)
+    {
+        throw std::runtime_error(fmt::format("Search index \"{}\" is damaged", path.string()));
+    }
+
+    std::memcpy(&header, image, sizeof(header));
+    if (header.librarySize != key.size || header.modificationTime != key.modificationTime || header.fieldsHash != key.fieldsHash)
+    {
+        return std::nullopt;
+    }
+
+    if (!index.view(image, size))
+    {
+        throw std::runtime_error(fmt::format("Search index \"{}\" is damaged", path.string()));
+    }
+
+    return index;
+}
+
+void SearchIndex::save(const std::filesystem::path& path, const SearchIndexKey& key) const
+{
+    std::string contents(m_image.begin(), m_image.end());
+
+    SearchIndexHeader header;
+    std::memcpy(&header, contents.data(), sizeof(header));
+    header.librarySize = key.size;
+    header.modificationTime = key.modificationTime;
+    header.fieldsHash = key.fieldsHash;
+    std::memcpy(contents.data(), &header, sizeof(header));
+
+    writeOutputFile(path, contents);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "input.hpp"
+#include "memberoffsets.hpp"
+#include "reader.hpp"
+#include "writer.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class SearchEntryKind : uint8_t
+{
+    VTableMethod, // Class::Namespace::Function, with the linux and windows indices
+    VTableField, // Class::member, with the offset
+    Symbol, // Demangled symbol, with the mangled name
+};
+
+struct SearchEntry
+{
+    SearchEntryKind kind;
+    std::string_view text;
+    std::string_view mangledName; // Symbols only
+    int32_t values[2]; // Linux and Windows index, or the field offset
+};
+
+// Size and modification time of the library an index was built from, and the template fields it resolved. A saved
+// index is only used for the same ones.
+struct SearchIndexKey
+{
+    uint64_t size{};
+    int64_t modificationTime{};
+    uint64_t fieldsHash{};
+
+    static SearchIndexKey of(const std::filesystem::path& libraryPath, const FieldNames& referencedFields);
+};
+
+// Case-insensitive search over the vtable methods, fields and demangled symbols of a library, through an index of
+// the trigrams of every entry. Entries are demangled once when the index is built. The index is laid out in memory like
+// in its file, a loaded index is mapped and a query only touches the posting lists and entries it needs.
+class SearchIndex
+{
+public:
+    static constexpr std::size_t MAX_RESULTS = 50;
+
+    // Fields are those of listMemberOffsets().
+    SearchIndex(const Offsets& offsets, const MemberOffsetIndex& memberOffsets, const FieldNames& referencedFields, std::span<const SymbolInfo> symbols);
+
+    // Nothing if the file doesn't exist or was built from another library. Throws std::runtime_error if it's damaged.
+    // The file stays in the page cache for the next query.
+    static std::optional<SearchIndex> load(const std::filesystem::path& path, const SearchIndexKey& key);
+
+    // Throws std::runtime_error on failure.
+    void save(const std::filesystem::path& path, const SearchIndexKey& key) const;
+
+    std::size_t size() const { return m_entries.size(); }
+
+    struct Result
+    {
+        std::vector<SearchEntry> entries; // At most MAX_RESULTS
+        std::size_t matchCount{0};
+        bool fuzzy{false}; // No entry contains the query, these share most of its trigrams
+    };
+
+    // Entries containing the query in index order, or the closest ones if none does.
+    Result find(std::string_view query) const;
+
+private:
+    SearchIndex() = default;
+
+    struct Entry
+    {
+        SearchEntryKind kind;
+        uint32_t textOffset; // Into m_text, the mangled name follows the text
+        uint32_t textSize;
+        uint32_t mangledNameSize;
+        int32_t values[2];
+    };
+
+    struct Trigram
+    {
+        uint32_t key;
+        uint32_t first; // Into m_postings, entry numbers in increasing order
+        uint32_t count;
+    };
+
+    // Points the arrays into an index image, returns false if they don't fit in it.
+    bool view(const char *image, std::size_t size);
+
+    SearchEntry entry(uint32_t index) const;
+    std::span<const uint32_t> postings(uint32_t key) const;
+
+    std::vector<char> m_image; // Built index
+    std::unique_ptr<InputFile> m_file; // or loaded one
+
+    std::string_view m_text;
+    std::span<const Entry> m_entries;
+    std::span<const Trigram> m_trigrams;
+    std::span<const uint32_t> m_postings;
+};
@@ -0,0 +1,215 @@
+#include "stats.hpp"
+
+#include <fmt/format.h>
+
+#include <sys/resource.h>
+
+static void getFaults(long &majorFaults, long &minorFaults)
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    majorFaults = usage.ru_majflt;
+    minorFaults = usage.ru_minflt;
+}
+
+bool Stats::enablePerfCounters(std::string& error)
+{
+    auto perfCounters = std::make_unique<PerfCounters>();
+    if (!perfCounters->available())
+    {
+        error = perfCounters->error();
+        return false;
+    }
+
+    m_perfCounters = std::move(perfCounters);
+    return true;
+}
+
+// Phases open on this thread, innermost last, with those a PhaseContext stands in for.
+struct OpenPhase
+{
+    const Stats *stats;
+    std::size_t index;
+};
+
+static thread_local std::vector<OpenPhase> t_openPhases;
+
+std::size_t Stats::currentPhase() const
+{
+    for (auto openPhase = t_openPhases.rbegin(); openPhase != t_openPhases.rend(); ++openPhase)
+    {
+        if (openPhase->stats == this)
+        {
+            return openPhase->index;
+        }
+    }
+
+    return NONE;
+}
+
+std::size_t Stats::begin(std::string name)
+{
+    auto parent = currentPhase();
+
+    std::scoped_lock lock(m_mutex);
+
+    PhaseStats phase{std::move(name), {}, 0, 0};
+    phase.parent = parent;
+    phase.depth = parent == NONE ? 0 : m_phases[parent].depth + 1;
+    m_phases.push_back(std::move(phase));
+
+    t_openPhases.push_back({this, m_phases.size() - 1});
+    return m_phases.size() - 1;
+}
+
+void Stats::record(std::size_t index, PhaseStats phase)
+{
+    // Phases end in reverse order on a thread, they are scoped.
+    t_openPhases.pop_back();
+
+    std::scoped_lock lock(m_mutex);
+
+    phase.parent = m_phases[index].parent;
+    phase.depth = m_phases[index].depth;
+    m_phases[index] = std::move(phase);
+}
+
+std::vector<PhaseStats> Stats::phases() const
+{
+    std::scoped_lock lock(m_mutex);
+    return m_phases;
+}
+
+static std::string indentedName(const PhaseStats& phase)
+{
+    return std::string(phase.depth * 2, ' ') + phase.name;
+}
+
+void Stats::print(std::ostream& os) const
+{
+    std::scoped_lock lock(m_mutex);
+
+    os << fmt::format("{:<20} {:>12} {:>14} {:>14}", "Phase", "Time (ms)", "Major faults", "Minor faults") << std::endl;
+
+    PhaseStats total{"total", {}, 0, 0};
+    for (const auto& phase : m_phases)
+    {
+        os << fmt::format("{:<20} {:>12.3f} {:>14} {:>14}", indentedName(phase), std::chrono::duration<double, std::milli>(phase.duration).count(), phase.majorFaults, phase.minorFaults) << std::endl;
+
+        // A nested phase is part of the one it ran in already.
+        if (phase.parent != NONE)
+        {
+            continue;
+        }
+
+        total.duration += phase.duration;
+        total.majorFaults += phase.majorFaults;
+        total.minorFaults += phase.minorFaults;
+    }
+
+    os << fmt::format("{:<20} {:>12.3f} {:>14} {:>14}", total.name, std::chrono::duration<double, std::milli>(total.duration).count(), total.majorFaults, total.minorFaults) << std::endl;
+
+    if (m_perfCounters)
+    {
+        printCounters(os);
+    }
+}
+
+static std::string formatCount(std::optional<uint64_t> count)
+{
+    return count ? std::to_string(*count) : "-";
+}
+
+static std::string formatRatio(std::optional<uint64_t> count, std::optional<uint64_t> total)
+{
+    return count && total && *total != 0 ? fmt::format("{:.3f}", static_cast<double>(*count) / static_cast<double>(*total)) : "-";
+}
+
+void Stats::printCounters(std::ostream& os) const
+{
+    os << fmt::format("\n{:<20} {:>14} {:>14} {:>6} {:>12} {:>12} {:>13} {:>10} {:>9} {:>9} {:>9}", "Phase", "Cycles", "Instructions", "IPC", "L1d misses", "LLC misses", "Branch misses", "Slots", "L1d/slot", "LLC/slot", "BrM/slot") << std::endl;
+
+    for (const auto& phase : m_phases)
+    {
+        const auto& counters = phase.counters;
+        std::optional<uint64_t> slots;
+        if (phase.slots != 0)
+        {
+            slots = phase.slots;
+        }
+
+        os << fmt::format("{:<20} {:>14} {:>14} {:>6} {:>12} {:>12} {:>13} {:>10} {:>9} {:>9} {:>9}",
+            indentedName(phase),
+            formatCount(counters[PerfEvent::Cycles]),
+            formatCount(counters[PerfEvent::Instructions]),
+            formatRatio(counters[PerfEvent::Instructions], counters[PerfEvent::Cycles]),
+            formatCount(counters[PerfEvent::L1dMisses]),
+            formatCount(counters[PerfEvent::LlcMisses]),
+            formatCount(counters[PerfEvent::BranchMisses]),
+            formatCount(slots),
+            formatRatio(counters[PerfEvent::L1dMisses], slots),
+            formatRatio(counters[PerfEvent::LlcMisses], slots),
+            formatRatio(counters[PerfEvent::BranchMisses], slots)) << std::endl;
+    }
+}
+
+PhaseContext::PhaseContext(Stats *stats, std::size_t parent) : m_stats{stats}
+{
+    if (m_stats && parent != Stats::NONE)
+    {
+        t_openPhases.push_back({m_stats, parent});
+    }
+    else
+    {
+        m_stats = nullptr;
+    }
+}
+
+PhaseContext::~PhaseContext()
+{
+    if (m_stats)
+    {
+        t_openPhases.pop_back();
+    }
+}
+
+ScopedPhase::ScopedPhase(Stats *stats, std::string name) : m_stats{stats}, m_name{std::move(name)}, m_trace{m_name}
+{
+    if (!m_stats)
+    {
+        return;
+    }
+
+    m_index = m_stats->begin(m_name);
+    getFaults(m_majorFaults, m_minorFaults);
+
+    if (auto perfCounters = m_stats->perfCounters())
+    {
+        m_counters = perfCounters->read();
+    }
+
+    m_start = std::chrono::steady_clock::now();
+}
+
+ScopedPhase::~ScopedPhase()
+{
+    if (!m_stats)
+    {
+        return;
+    }
+
+    auto duration = std::chrono::steady_clock::now() - m_start;
+
+    PerfCounts counters;
+    if (auto perfCounters = m_stats->perfCounters())
+    {
+        counters = perfCounters->read() - m_counters;
+    }
+
+    long majorFaults = 0;
+    long minorFaults = 0;
+    getFaults(majorFaults, minorFaults);
+
+    // Copied, the trace span still needs the name
+    m_stats->record(m_index, {m_name, duration, majorFaults - m_majorFaults, minorFaults - m_minorFaults, counters, m_slots});
+}
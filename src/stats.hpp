@@ -0,0 +1,101 @@
+#pragma once
+
+#include "perf.hpp"
+#include "trace.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct PhaseStats
+{
+    std::string name;
+    std::chrono::nanoseconds duration;
+    long majorFaults;
+    long minorFaults;
+    PerfCounts counters{}; // With enablePerfCounters()
+    std::size_t slots{0}; // Vtable slots the phase went through, for the per-slot counts
+    std::size_t parent{SIZE_MAX}; // Index of the phase it ran inside of, SIZE_MAX for a top-level one
+    std::size_t depth{0}; // Number of phases it ran inside of, only top-level phases add up to the total
+};
+
+// Timing report printed by --stats.
+class Stats
+{
+public:
+    // Adds hardware counters to the phases recorded afterwards, counting the threads started afterwards too.
+    // Returns false, with the reason in `error`, if no counter can be opened; phases are still timed then.
+    bool enablePerfCounters(std::string& error);
+    const PerfCounters *perfCounters() const { return m_perfCounters.get(); }
+
+    static constexpr std::size_t NONE = SIZE_MAX;
+
+    // A phase is nested in the innermost one open on the same thread, or in the one a PhaseContext names for it.
+    // Phases are listed in start order.
+    std::size_t begin(std::string name);
+    void record(std::size_t index, PhaseStats phase);
+    void print(std::ostream& os) const;
+
+    // The innermost phase open on the calling thread, NONE if there is none.
+    std::size_t currentPhase() const;
+
+    std::vector<PhaseStats> phases() const;
+
+private:
+    friend class PhaseContext;
+
+    void printCounters(std::ostream& os) const;
+
+    mutable std::mutex m_mutex;
+    std::vector<PhaseStats> m_phases;
+    std::unique_ptr<PerfCounters> m_perfCounters;
+};
+
+// Records the wall time and page faults of its scope, and a trace span. Only the span is recorded when stats is null.
+class ScopedPhase
+{
+public:
+    ScopedPhase(Stats *stats, std::string name);
+    ~ScopedPhase();
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+    void setSlots(std::size_t slots) { m_slots = slots; }
+
+private:
+    Stats *m_stats;
+    std::size_t m_index{0};
+    std::string m_name;
+    TraceScope m_trace;
+    std::chrono::steady_clock::time_point m_start;
+    long m_majorFaults{0};
+    long m_minorFaults{0};
+    PerfCounts m_counters{};
+    std::size_t m_slots{0};
+};
+
+// Nests the phases the calling thread starts in `parent`, a phase of another thread that handed it work.
+class PhaseContext
+{
+public:
+    PhaseContext(Stats *stats, std::size_t parent);
+    ~PhaseContext();
+
+    PhaseContext(const PhaseContext&) = delete;
+    PhaseContext& operator=(const PhaseContext&) = delete;
+
+private:
+    Stats *m_stats;
+};
+
+template <typename Function>
+auto timePhase(Stats *stats, std::string name, Function&& function)
+{
+    ScopedPhase phase(stats, std::move(name));
+    return function();
+}
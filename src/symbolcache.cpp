@@ -0,0 +1,175 @@
+#include "symbolcache.hpp"
+#include "elf.hpp"
+#include "trace.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+struct SymbolCache::Library
+{
+    std::filesystem::path path;
+    std::string fileName;
+
+    std::once_flag loaded;
+    std::atomic<bool> opened{false};
+    std::atomic<bool> valid{false};
+    std::optional<InputFile> input;
+    std::vector<std::string_view> neededLibraries;
+    std::vector<SymbolInfo> symbols;
+    std::vector<const SymbolInfo*> symbolsByAddress;
+    std::unordered_map<std::string_view, unsigned long long> addressesByName;
+
+    // Every exported symbol at the address of `name`, aliases included, in address order like parse() sees them.
+    std::span<const SymbolInfo* const> find(std::string_view name) const
+    {
+        auto address = addressesByName.find(name);
+        if (address == addressesByName.end())
+        {
+            return {};
+        }
+
+        auto symbolsAt = std::ranges::equal_range(symbolsByAddress, address->second, {}, [](const SymbolInfo *symbol) { return static_cast<unsigned long long>(symbol->address); });
+        return {symbolsAt.begin(), symbolsAt.end()};
+    }
+};
+
+SymbolCache::SymbolCache(const std::vector<std::filesystem::path>& libraryPaths, const InputOptions& options) : m_options{options}
+{
+    for (const auto& libraryPath : libraryPaths)
+    {
+        auto& library = *m_libraries.emplace_back(std::make_unique<Library>());
+        library.path = libraryPath;
+        library.fileName = libraryPath.filename().string();
+    }
+}
+
+SymbolCache::~SymbolCache() = default;
+
+const SymbolCache::Library *SymbolCache::load(std::string_view fileName)
+{
+    auto it = std::ranges::find(m_libraries, fileName, &Library::fileName);
+    if (it == m_libraries.end())
+    {
+        return nullptr;
+    }
+
+    auto& library = **it;
+    std::call_once(library.loaded, [this, &library]
+    {
+        TRACE_SCOPE("load dependency", library.fileName);
+
+        try
+        {
+            library.input.emplace(library.path.string(), m_options);
+            library.opened = true;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << fmt::format("Warning: dependency library {} is ignored - {}", library.path.string(), e.what()) << std::endl;
+            return;
+        }
+
+        ElfImage elfImage(library.input->data(), library.input->size());
+        if (!elfImage.error().empty())
+        {
+            std::cerr << fmt::format("Warning: dependency library {} is ignored - {}", library.path.string(), elfImage.error()) << std::endl;
+            return;
+        }
+
+        library.neededLibraries = readNeededLibraries(elfImage);
+        library.symbols = readExportedSymbols(elfImage);
+
+        library.symbolsByAddress.reserve(library.symbols.size());
+        for (const auto& symbol : library.symbols)
+        {
+            library.symbolsByAddress.push_back(&symbol);
+            library.addressesByName.try_emplace(symbol.name, static_cast<unsigned long long>(symbol.address));
+        }
+
+        std::ranges::stable_sort(library.symbolsByAddress, {}, [](const SymbolInfo *symbol) { return static_cast<unsigned long long>(symbol->address); });
+
+        library.valid = true;
+    });
+
+    return library.valid ? &library : nullptr;
+}
+
+std::size_t SymbolCache::resolveImports(ProgramInfo& programInfo)
+{
+    TRACE_SCOPE("resolve imports");
+
+    // Dependencies in lookup order, each once.
+    std::vector<std::string_view> neededLibraries(programInfo.neededLibraries);
+    std::vector<const Library*> scope;
+    for (std::size_t n = 0; n < neededLibraries.size(); n++)
+    {
+        auto library = load(neededLibraries[n]);
+        if (!library || std::ranges::find(scope, library) != scope.end())
+        {
+            continue;
+        }
+
+        scope.push_back(library);
+
+        for (auto neededLibrary : library->neededLibraries)
+        {
+            if (std::ranges::find(neededLibraries, neededLibrary) == neededLibraries.end())
+            {
+                neededLibraries.push_back(neededLibrary);
+            }
+        }
+    }
+
+    std::size_t resolvedCount = 0;
+    if (scope.empty())
+    {
+        return resolvedCount;
+    }
+
+    for (auto& relocation : programInfo.relocations.get())
+    {
+        if (relocation.importName.empty())
+        {
+            continue;
+        }
+
+        for (auto library : scope)
+        {
+            auto symbols = library->find(relocation.importName);
+            if (!symbols.empty())
+            {
+                relocation.importSymbols = symbols;
+                resolvedCount++;
+                break;
+            }
+        }
+    }
+
+    return resolvedCount;
+}
+
+std::size_t SymbolCache::loadedCount() const
+{
+    return std::ranges::count_if(m_libraries, [](const auto& library) { return library->valid.load(); });
+}
+
+std::vector<std::filesystem::path> SymbolCache::openedPaths() const
+{
+    std::vector<std::filesystem::path> paths;
+    for (const auto& library : m_libraries)
+    {
+        if (library->opened)
+        {
+            paths.push_back(library->path);
+        }
+    }
+
+    return paths;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "input.hpp"
+#include "reader.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Exported symbols of the libraries a library imports vtable functions from (tier0, vstdlib, ...).
+// A dependency is loaded the first time a library needs it, and only once however many do, so one cache can serve
+// every library analysed in a run, from any thread. Resolved symbols point into the cache, it has to outlive them.
+class SymbolCache
+{
+public:
+    explicit SymbolCache(const std::vector<std::filesystem::path>& libraryPaths, const InputOptions& options = {});
+    ~SymbolCache();
+
+    SymbolCache(const SymbolCache&) = delete;
+    SymbolCache& operator=(const SymbolCache&) = delete;
+
+    // Sets RelocationInfo::importSymbols of the imported relocations: the first dependency exporting the name, searched
+    // breadth first from the DT_NEEDED entries like the dynamic linker does. Dependencies are matched by file name.
+    // Returns the number of relocations resolved.
+    std::size_t resolveImports(ProgramInfo& programInfo);
+
+    // Dependencies loaded so far.
+    std::size_t loadedCount() const;
+
+    // Dependencies opened so far, loaded or not, in --dep_library order.
+    std::vector<std::filesystem::path> openedPaths() const;
+
+private:
+    struct Library;
+
+    // Nullptr if no dependency has that file name or it couldn't be loaded.
+    const Library *load(std::string_view fileName);
+
+    InputOptions m_options;
+    std::vector<std::unique_ptr<Library>> m_libraries;
+};
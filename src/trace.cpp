@@ -0,0 +1,117 @@
+#include "trace.hpp"
+
+#include <fmt/format.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TraceEvent
+{
+    std::string name;
+    std::string argument;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point end;
+};
+
+struct ThreadBuffer
+{
+    unsigned int threadId;
+    std::vector<TraceEvent> events;
+};
+
+std::atomic<bool> Trace::s_enabled{false};
+
+static std::chrono::steady_clock::time_point s_origin;
+static std::mutex s_buffersMutex; // Only taken the first time a thread records something
+static std::vector<std::unique_ptr<ThreadBuffer>> s_buffers;
+static thread_local ThreadBuffer *t_buffer{};
+
+static ThreadBuffer *getThreadBuffer()
+{
+    if (!t_buffer)
+    {
+        std::scoped_lock lock(s_buffersMutex);
+
+        auto& buffer = s_buffers.emplace_back(std::make_unique<ThreadBuffer>());
+        buffer->threadId = static_cast<unsigned int>(s_buffers.size());
+        t_buffer = buffer.get();
+    }
+
+    return t_buffer;
+}
+
+void Trace::start()
+{
+    s_origin = std::chrono::steady_clock::now();
+
+    // The starting thread is shown as the main thread.
+    getThreadBuffer();
+
+    s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void Trace::record(std::string_view name, std::string_view argument, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    getThreadBuffer()->events.push_back({std::string(name), std::string(argument), start, end});
+}
+
+static std::string escapeJson(std::string_view text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+
+    for (auto c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            escaped += fmt::format("\\u{:04x}", static_cast<int>(c));
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+void Trace::write(std::ostream& os)
+{
+    std::scoped_lock lock(s_buffersMutex);
+
+    auto microseconds = [](std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for (const auto& buffer : s_buffers)
+    {
+        auto threadName = buffer->threadId == 1 ? std::string("main") : fmt::format("worker {}", buffer->threadId - 1);
+        os << (first ? "\n" : ",\n") << fmt::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"{}"}}}})", buffer->threadId, threadName);
+        first = false;
+
+        for (const auto& event : buffer->events)
+        {
+            os << ",\n" << fmt::format(R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f})", escapeJson(event.name), buffer->threadId, microseconds(event.start - s_origin), microseconds(event.end - event.start));
+
+            if (!event.argument.empty())
+            {
+                os << fmt::format(R"(,"args":{{"detail":"{}"}})", escapeJson(event.argument));
+            }
+
+            os << "}";
+        }
+    }
+
+    os << "\n]}\n";
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// Span recorder for --trace, written as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+// Every thread appends to its own buffer; the buffers are only read by write(), once the workers are done.
+class Trace
+{
+public:
+    static void start();
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    static void record(std::string_view name, std::string_view argument, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+    static void write(std::ostream& os);
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+// Records its scope as a span, the argument shows up in the span details. Costs a relaxed load when tracing is off.
+// Both strings have to outlive the scope.
+class TraceScope
+{
+public:
+    explicit TraceScope(std::string_view name, std::string_view argument = {})
+    {
+        if (Trace::enabled())
+        {
+            m_name = name;
+            m_argument = argument;
+            m_start = std::chrono::steady_clock::now();
+            m_active = true;
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_active)
+        {
+            Trace::record(m_name, m_argument, m_start, std::chrono::steady_clock::now());
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    std::string_view m_name;
+    std::string_view m_argument;
+    std::chrono::steady_clock::time_point m_start;
+    bool m_active{false};
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
@@ -1,84 +1,236 @@
 #include "writer.hpp"
 #include "formatter.hpp"
+#include "offsetindex.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "trace.hpp"
 
+#include <algorithm>
 #include <cstring>
+#include <exception>
 #include <fstream>
-#include <map>
+#include <functional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <span>
 #include <string>
+#include <unordered_map>
 
-struct FunctionOffsets
+// Adds the class of the line's VTableMethod placeholder, or the field of its VTableField one. Malformed lines are
+// reported later, when the file is written.
+static void collectReferences(const std::string& line, GamedataTemplate& gamedataTemplate)
 {
-    int linuxIndex;
-    int windowsIndex;
-};
+    auto startPos = line.find('#');
+    auto endPos = line.rfind('#');
+    if (startPos == std::string::npos || endPos == startPos)
+    {
+        return;
+    }
 
-using ClassNamespace = std::map<std::string, FunctionOffsets>;
-using ClassVTables = std::map<std::string, ClassNamespace>;
-using Offsets = std::map<std::string, ClassVTables>;
+    std::string_view placeholder(line.data() + startPos + 1, endPos - startPos - 1);
+    if (placeholder.starts_with("VTableMethod."))
+    {
+        placeholder.remove_prefix(std::string_view("VTableMethod.").size());
+        gamedataTemplate.referencedClasses.emplace(placeholder.substr(0, placeholder.find("::")));
+    }
+    else if (placeholder.starts_with("VTableField."))
+    {
+        placeholder.remove_prefix(std::string_view("VTableField.").size());
+        auto memberNameStartPos = placeholder.rfind("::");
+        if (memberNameStartPos != std::string_view::npos)
+        {
+            gamedataTemplate.referencedFields.emplace(placeholder.substr(0, memberNameStartPos), placeholder.substr(memberNameStartPos + 2));
+        }
+    }
+}
 
-Offsets prepareOffsets(const std::list<ClassInfo>& classes)
+GamedataTemplate readGamedataTemplate(const std::filesystem::path& inputFilePath)
 {
-    std::map<std::string, ClassVTables> offsets;
+    TRACE_SCOPE("read template", inputFilePath.native());
 
-    for (const auto& class_ : classes)
+    GamedataTemplate gamedataTemplate;
+    gamedataTemplate.path = inputFilePath;
+
+    // A bad name is reported when the file is rendered.
+    if (inputFilePath.empty() || inputFilePath.extension() != ".in")
     {
-        ClassVTables vtables;
-        ClassNamespace namespace_;
+        return gamedataTemplate;
+    }
 
-        auto vtable = formatVTable(class_);
+    std::ifstream inputStream(inputFilePath);
+    if (!inputStream)
+    {
+        gamedataTemplate.error = errno;
+        return gamedataTemplate;
+    }
 
-        for (const auto& function : vtable)
+    std::string line;
+    while (getline(inputStream, line))
+    {
+        collectReferences(line, gamedataTemplate);
+        gamedataTemplate.lines.push_back(std::move(line));
+    }
+
+    return gamedataTemplate;
+}
+
+TemplateReader::TemplateReader(std::vector<std::filesystem::path> inputFilePaths) : m_size{inputFilePaths.size()}
+{
+    m_thread = std::jthread([this, inputFilePaths = std::move(inputFilePaths)]
+    {
+        for (const auto& inputFilePath : inputFilePaths)
         {
-            if (!function.linuxIndex.has_value())
+            if (!m_templates.push(readGamedataTemplate(inputFilePath)))
             {
-                if (!function.name.starts_with('~'))
-                {
-                    std::cerr << fmt::format("Warning: function {} has no linuxIndex value", function.name) << std::endl;
-                }
+                return;
+            }
+        }
+
+        m_templates.close();
+    });
+}
 
-                continue;
+TemplateReader::TemplateReader(std::vector<GamedataTemplate> gamedataTemplates) : m_size{gamedataTemplates.size()}
+{
+    m_thread = std::jthread([this, gamedataTemplates = std::move(gamedataTemplates)]() mutable
+    {
+        for (auto& gamedataTemplate : gamedataTemplates)
+        {
+            if (!m_templates.push(std::move(gamedataTemplate)))
+            {
+                return;
             }
+        }
+
+        m_templates.close();
+    });
+}
+
+TemplateReader::~TemplateReader()
+{
+    // Unblocks the reader if the writer stopped early, the thread is joined right after.
+    m_templates.close();
+}
+
+std::optional<GamedataTemplate> TemplateReader::next()
+{
+    return m_templates.pop();
+}
 
-            if (!function.windowsIndex.has_value())
+// Warnings are returned rather than printed, so classes formatted on several threads can report them in class order.
+static ClassVTables formatClassVTables(VTableFormatter& formatter, const ClassInfo& classInfo, std::vector<std::string>& warnings)
+{
+    ClassVTables vtables;
+
+    auto vtable = formatter.format(classInfo);
+
+    for (const auto& function : vtable)
+    {
+        if (!function.linuxIndex.has_value())
+        {
+            if (!function.name.starts_with('~'))
             {
-                if (!function.name.starts_with('~'))
-                {
-                    std::cerr << fmt::format("Warning: function {} has no windowsIndex value", function.name) << std::endl;
-                }
+                warnings.push_back(fmt::format("Warning: function {} has no linuxIndex value", function.name));
+            }
 
-                continue;
+            continue;
+        }
+
+        if (!function.windowsIndex.has_value())
+        {
+            if (!function.name.starts_with('~'))
+            {
+                warnings.push_back(fmt::format("Warning: function {} has no windowsIndex value", function.name));
             }
 
-            vtables[function.nameSpace].emplace(function.name, FunctionOffsets{function.linuxIndex.value(), function.windowsIndex.value()});
+            continue;
         }
 
-        offsets.emplace(class_.name, vtables);
+        vtables[function.nameSpace].emplace(function.name, FunctionOffsets{function.linuxIndex.value(), function.windowsIndex.value()});
+    }
+
+    return vtables;
+}
+
+static void printWarnings(const std::vector<std::string>& warnings)
+{
+    for (const auto& warning : warnings)
+    {
+        std::cerr << warning << std::endl;
+    }
+}
+
+Offsets prepareOffsets(const Out& out, const ClassNames *referencedClasses, unsigned int jobs)
+{
+    TRACE_SCOPE("prepareOffsets");
+
+    std::vector<const ClassInfo*> classes;
+    for (const auto& class_ : out.classes)
+    {
+        if (referencedClasses && !referencedClasses->contains(class_.name))
+        {
+            continue;
+        }
+
+        classes.push_back(&class_);
+    }
+
+    struct FormattedClass
+    {
+        ClassVTables vtables;
+        std::vector<std::string> warnings;
+    };
+
+    std::vector<FormattedClass> formattedClasses(classes.size());
+    ParallelFormatter(out.functionTable, out.hierarchy, jobs).format(classes, [&](VTableFormatter& formatter, std::size_t index)
+    {
+        formattedClasses[index].vtables = formatClassVTables(formatter, *classes[index], formattedClasses[index].warnings);
+    });
+
+    // Merged in class order, so the first class with a name still wins and the warnings come out as with one thread.
+    Offsets offsets;
+    for (std::size_t index = 0; index < classes.size(); ++index)
+    {
+        printWarnings(formattedClasses[index].warnings);
+        offsets.emplace(classes[index]->name, std::move(formattedClasses[index].vtables));
     }
 
     return offsets;
 }
 
-std::optional<int> getVTableMethodOffset(Offsets offsets, const std::string& placeholder)
+// Stored for the caller if it asked for the error, printed otherwise.
+static void reportError(std::string *error, std::string message)
+{
+    if (error)
+    {
+        *error = std::move(message);
+        return;
+    }
+
+    std::cerr << fmt::format("Error: {}", message) << std::endl;
+}
+
+std::optional<int> getVTableMethodOffset(const Offsets& offsets, std::string_view placeholder, std::string *error)
 {
     // placeholder example: CBasePlayer::CBaseEntity::AcceptInput(char const*, CBaseEntity*, CBaseEntity*, variant_t, int).windows
     auto functionNameStartPos = placeholder.rfind("::");
     if (functionNameStartPos == std::string::npos)
     {
-        std::cerr << fmt::format("Error: incorrect format of symbol {} (missing \'::\' separator)", placeholder) << std::endl;
+        reportError(error, fmt::format("incorrect format of symbol {} (missing \'::\' separator)", placeholder));
         return std::nullopt;
     }
 
     auto systemNameStartPos = placeholder.rfind('.');
     if (systemNameStartPos == std::string::npos)
     {
-        std::cerr << fmt::format("Error: incorrect format of symbol {} (missing \'.\' separator)", placeholder) << std::endl;
+        reportError(error, fmt::format("incorrect format of symbol {} (missing \'.\' separator)", placeholder));
         return std::nullopt;
     }
 
     auto namespaceStartPos = placeholder.find("::");
     if (namespaceStartPos == std::string::npos)
     {
-        std::cerr << fmt::format("Error: incorrect format of symbol {} (missing \'::\' separator)", placeholder) << std::endl;
+        reportError(error, fmt::format("incorrect format of symbol {} (missing \'::\' separator)", placeholder));
         return std::nullopt;
     }
 
@@ -90,7 +242,7 @@ std::optional<int> getVTableMethodOffset(Offsets offsets, const std::string& pla
     auto classVTablesIterator = offsets.find(className);
     if (classVTablesIterator == offsets.end())
     {
-        std::cerr << fmt::format("Error: failed to find class vtable by its name \'{}\')", className) << std::endl;
+        reportError(error, fmt::format("failed to find class vtable by its name \'{}\')", className));
         return std::nullopt;
     }
     const auto& classVTables = classVTablesIterator->second;
@@ -98,7 +250,7 @@ std::optional<int> getVTableMethodOffset(Offsets offsets, const std::string& pla
     auto classNamespaceIterator = classVTables.find(namespaceName);
     if (classNamespaceIterator == classVTables.end())
     {
-        std::cerr << fmt::format("Error: failed to find class namespace by its name \'{}\')", namespaceName) << std::endl;
+        reportError(error, fmt::format("failed to find class namespace by its name \'{}\')", namespaceName));
         return std::nullopt;
     }
     const auto& classNamespace = classNamespaceIterator->second;
@@ -106,7 +258,7 @@ std::optional<int> getVTableMethodOffset(Offsets offsets, const std::string& pla
     auto functionIterator = classNamespace.find(functionName);
     if (functionIterator == classNamespace.end())
     {
-        std::cerr << fmt::format("Error: failed to find function by its name \'{}\'", functionName) << std::endl;
+        reportError(error, fmt::format("failed to find function by its name \'{}\'", functionName));
         return std::nullopt;
     }
     const auto& function = functionIterator->second;
@@ -116,155 +268,559 @@ std::optional<int> getVTableMethodOffset(Offsets offsets, const std::string& pla
     return isLinux ? function.linuxIndex : function.windowsIndex;
 }
 
-std::optional<int> getVTableFieldOffset(const std::vector<MemberOffset>& memberOffsets, const std::string& placeholder)
+std::optional<int> getVTableFieldOffset(const MemberOffsetIndex& memberOffsets, std::string_view placeholder, std::string *error)
 {
     // placeholder example: CGlobalEntityList::m_entityListeners
     auto functionNameStartPos = placeholder.rfind("::");
     if (functionNameStartPos == std::string::npos)
     {
-        std::cerr << fmt::format("Error: incorrect format of symbol {} (missing \'::\' separator)", placeholder) << std::endl;
+        reportError(error, fmt::format("incorrect format of symbol {} (missing \'::\' separator)", placeholder));
         return std::nullopt;
     }
 
     auto className = placeholder.substr(0, functionNameStartPos);
-    auto memberName = placeholder.substr(functionNameStartPos + 2, placeholder.size());
+    auto memberName = placeholder.substr(functionNameStartPos + 2);
 
-    for (const auto& memberOffset : memberOffsets)
+    auto offset = memberOffsets.find(className, memberName);
+    if (!offset.has_value())
     {
-        if (memberOffset.className == className && memberOffset.memberName == memberName)
+        return std::nullopt;
+    }
+
+    return static_cast<int>(offset.value());
+}
+
+std::vector<MemberOffset> listMemberOffsets(const MemberOffsetIndex& memberOffsets, const FieldNames& referencedFields)
+{
+    auto members = memberOffsets.entries();
+
+    std::set<std::pair<std::string_view, std::string_view>> listed;
+    for (const auto& member : members)
+    {
+        listed.emplace(member.className, member.memberName);
+    }
+
+    for (const auto& [className, memberName] : referencedFields)
+    {
+        if (listed.contains({className, memberName}))
         {
-            return memberOffset.offset;
+            continue;
+        }
+
+        if (auto offset = memberOffsets.find(className, memberName))
+        {
+            members.push_back({className, memberName, *offset});
         }
     }
 
-    return std::nullopt;
+    return members;
 }
 
-int writeGamedataFile(
-    const std::list<ClassInfo>& classes,
-    const std::vector<MemberOffset>& memberOffsets,
-    const std::vector<std::filesystem::path>& inputFilePaths,
-    const std::vector<std::filesystem::path>& outputDirectoryPaths)
+// Fills in the placeholders of one input file.
+static int renderGamedataFile(const Offsets& offsets, const LazySection<MemberOffsetIndex>& memberOffsets, const GamedataTemplate& gamedataTemplate, std::string& output)
 {
-    auto offsets = prepareOffsets(classes);
+    const auto& inputFilePath = gamedataTemplate.path;
 
-    auto outputDirectoryPathIterator = outputDirectoryPaths.begin();
+    TRACE_SCOPE("render", inputFilePath.native());
 
-    for (const auto& inputFilePath : inputFilePaths)
+    if (inputFilePath.empty())
     {
-        if (inputFilePath.empty())
+        std::cerr << "Error: input file name is empty" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    constexpr auto inputFileExtensionString = ".in";
+    auto inputFileExtension = inputFilePath.extension();
+
+    if (inputFileExtension != inputFileExtensionString)
+    {
+        std::cerr << fmt::format("Error: input file {} doesn't contain correct file extension {}", inputFilePath.string(), inputFileExtension.string()) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (gamedataTemplate.error != 0)
+    {
+        std::cerr << fmt::format("Error: input file {} open failed - {}", inputFilePath.string(), std::strerror(gamedataTemplate.error)) << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto lineNumber = 0u;
+    for (auto line : gamedataTemplate.lines)
+    {
+        lineNumber++;
+
+        auto startPos = line.find('#');
+        if (startPos != std::string::npos)
         {
-            std::cerr << "Error: input file name is empty" << std::endl;
-            return EXIT_FAILURE;
+            auto endPos = line.rfind('#');
+            if (endPos == startPos)
+            {
+                std::cerr << fmt::format("Error: input file {} contains only one \'#\' at line {}", inputFilePath.string(), lineNumber) << std::endl;
+                return EINVAL;
+            }
+
+            auto placeholder = line.substr(startPos + 1, endPos - startPos - 1);
+            if (placeholder.empty())
+            {
+                std::cerr << fmt::format("Error: placeholder in input file {} at line {} is empty", inputFilePath.string(), lineNumber) << std::endl;
+                return EINVAL;
+            }
+
+            auto entryTypeEndPos = placeholder.find('.');
+            if (entryTypeEndPos == std::string::npos)
+            {
+                std::cerr << fmt::format("Error: incorrect format of placeholder {} (missing \'.\' separator)", placeholder) << std::endl;
+                return EINVAL;
+            }
+
+            auto entryType = placeholder.substr(0, entryTypeEndPos);
+            placeholder = placeholder.substr(entryTypeEndPos + 1, placeholder.size());
+
+            std::string result;
+            if (entryType == "VTableMethod")
+            {
+                auto offset = getVTableMethodOffset(offsets, placeholder);
+                if (!offset.has_value())
+                {
+                    std::cerr << fmt::format("Error: failed to get vtable offset of placeholder {} from input file {} at line {}", placeholder, inputFilePath.string(), lineNumber) << std::endl;
+                    return EINVAL;
+                }
+                result = std::to_string(offset.value());
+            }
+            else if (entryType == "VTableField")
+            {
+                auto offset = getVTableFieldOffset(memberOffsets.get(), placeholder);
+                if (!offset.has_value())
+                {
+                    std::cerr << fmt::format("Error: failed to get member offset of placeholder {} from input file {} at line {}", placeholder, inputFilePath.string(), lineNumber) << std::endl;
+                    return EINVAL;
+                }
+                result = std::to_string(offset.value());
+            }
+            else
+            {
+                std::cerr << fmt::format("Error: unknown entryType {} in input file {} at line {}", entryType, inputFilePath.string(), lineNumber) << std::endl;
+                return EINVAL;
+            }
+
+            line.replace(startPos, endPos - startPos + 1, result);
         }
 
-        constexpr auto inputFileExtensionString = ".in";
-        auto inputFileExtension = inputFilePath.extension();
+        output += line;
+        output += '\n';
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Renders `inputCount` files, in input order as next() returns them, and writes each one to its output directories.
+static int writeGamedataFiles(
+    std::size_t inputCount,
+    const std::function<std::optional<GamedataTemplate>()>& next,
+    const std::vector<std::filesystem::path>& outputDirectoryPaths,
+    const WriterOptions& options,
+    const std::function<int(const GamedataTemplate&, std::string&)>& render)
+{
+    if (inputCount == 0 || outputDirectoryPaths.empty())
+    {
+        return EXIT_SUCCESS;
+    }
 
-        if (inputFileExtension != inputFileExtensionString)
+    // Without fan-out, inputs are paired with directories and the last directory takes the remaining inputs.
+    auto usedDirectoryCount = options.fanOut ? outputDirectoryPaths.size() : std::min(inputCount, outputDirectoryPaths.size());
+    auto usedDirectories = std::span(outputDirectoryPaths).first(usedDirectoryCount);
+
+    for (const auto& outputFileDir : usedDirectories)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(outputFileDir, error);
+
+        if (error || !std::filesystem::is_directory(outputFileDir))
         {
-            std::cerr << fmt::format("Error: input file {} doesn't contain correct file extension {}", inputFilePath.string(), inputFileExtension.string()) << std::endl;
+            std::cerr << fmt::format("Error: failed to create {} directory - {}", outputFileDir.string(), error.message()) << std::endl;
             return EXIT_FAILURE;
         }
+    }
 
-        std::ifstream inputStream(inputFilePath);
-        if (!inputStream)
+    std::size_t inputIndex = 0;
+    for (auto gamedataTemplate = next(); gamedataTemplate; gamedataTemplate = next(), ++inputIndex)
+    {
+        std::string output;
+        auto result = render(*gamedataTemplate, output);
+        if (result != EXIT_SUCCESS)
         {
-            std::cerr << fmt::format("Error: input file {} open failed - {}", inputFilePath.string(), std::strerror(errno)) << std::endl;
-            return EXIT_FAILURE;
+            return result;
         }
 
-        auto outputFileName = inputFilePath.filename().stem();
-        auto outputFileDir = *outputDirectoryPathIterator;
+        auto outputFileName = gamedataTemplate->path.filename().stem();
+        auto outputFileDirs = usedDirectories;
+        if (!options.fanOut)
+        {
+            outputFileDirs = usedDirectories.subspan(std::min(inputIndex, usedDirectories.size() - 1), 1);
+        }
 
-        std::filesystem::create_directory(outputFileDir);
+        auto outputFile = outputFileDirs.front() / outputFileName;
 
-        if (!std::filesystem::exists(outputFileDir))
+        try
         {
-            std::cerr << fmt::format("Error: failed to create {} directory", outputFileDir.string(), std::strerror(errno)) << std::endl;
-            return EXIT_FAILURE;
-        }
+            writeOutputFile(outputFile, output);
 
-        auto outputFile = outputFileDir / outputFileName;
+            // The other copies are made from the first one.
+            std::vector<std::function<void()>> tasks;
+            for (const auto& outputFileDir : outputFileDirs.subspan(1))
+            {
+                tasks.emplace_back([&outputFile, &output, &options, target = outputFileDir / outputFileName]
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    auto method = copyOutputFile(outputFile, target, output, options.hardLinks);
 
-        std::ofstream outputStream(outputFile);
-        if (!outputStream)
+                    // Named after the method, the trace shows what each output filesystem allowed.
+                    if (Trace::enabled())
+                    {
+                        Trace::record(fmt::format("copy file ({})", copyMethodName(method)), target.native(), start, std::chrono::steady_clock::now());
+                    }
+                });
+            }
+
+            runConcurrently(tasks, options.jobs);
+        }
+        catch (const std::exception& e)
         {
-            std::cerr << fmt::format("Error: output file {} open failed - {}", outputFile.string(), std::strerror(errno)) << std::endl;
+            std::cerr << fmt::format("Error: output file {} write failed - {}", outputFile.string(), e.what()) << std::endl;
             return EXIT_FAILURE;
         }
 
-        std::string line;
-        auto lineNumber = 0u;
-        while(getline(inputStream, line))
+        if (options.writtenFiles)
         {
-            lineNumber++;
+            for (const auto& outputFileDir : outputFileDirs)
+            {
+                options.writtenFiles->push_back(outputFileDir / outputFileName);
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int writeGamedataFile(
+    const Offsets& offsets,
+    const LazySection<MemberOffsetIndex>& memberOffsets,
+    TemplateReader& templates,
+    const std::vector<std::filesystem::path>& outputDirectoryPaths,
+    const WriterOptions& options)
+{
+    auto next = [&templates] { return templates.next(); };
+
+    return writeGamedataFiles(templates.size(), next, outputDirectoryPaths, options, [&](const GamedataTemplate& gamedataTemplate, std::string& output)
+    {
+        return renderGamedataFile(offsets, memberOffsets, gamedataTemplate, output);
+    });
+}
+
+int writeGamedataFile(
+    const ClassSource& classes,
+    const FunctionTable& functionTable,
+    const LazySection<MemberOffsetIndex>& memberOffsets,
+    TemplateReader& templates,
+    const std::vector<std::filesystem::path>& outputDirectoryPaths,
+    const WriterOptions& options)
+{
+    if (templates.size() == 0 || outputDirectoryPaths.empty())
+    {
+        return EXIT_SUCCESS;
+    }
 
-            auto startPos = line.find('#');
-            if (startPos != std::string::npos)
+    std::unordered_map<std::string_view, const ClassInfo*> classesByName;
+    std::optional<VTableFormatter> formatter;
+
+    // Only the format stage adds offsets, the writer takes the lock shared while it renders.
+    std::shared_mutex offsetsMutex;
+    Offsets offsets;
+
+    BoundedQueue<GamedataTemplate> formattedTemplates(TemplateReader::READ_AHEAD);
+    std::exception_ptr formatError;
+
+    // Formats the classes of the next files while the writer renders and writes the current one. Files are taken in
+    // order, each waits until the classes it refers to are parsed, or the parse is over for those the library doesn't
+    // have. If parsing or formatting throws, the writer finishes the files formatted so far and the exception is
+    // rethrown after the join.
+    std::jthread formatThread([&]
+    {
+        std::optional<GamedataTemplate> pending;
+        auto parsed = false;
+        auto stopped = false;
+
+        auto isReady = [&](const GamedataTemplate& gamedataTemplate)
+        {
+            return parsed || std::ranges::all_of(gamedataTemplate.referencedClasses, [&](const auto& className)
             {
-                auto endPos = line.rfind('#');
-                if (endPos == startPos)
-                {
-                    std::cerr << fmt::format("Error: input file {} contains only one \'#\' at line {}", inputFilePath.string(), lineNumber) << std::endl;
-                    return EINVAL;
-                }
+                return classesByName.contains(className);
+            });
+        };
 
-                auto placeholder = line.substr(startPos + 1, endPos - startPos - 1);
-                if (placeholder.empty())
+        auto format = [&](const GamedataTemplate& gamedataTemplate)
+        {
+            TRACE_SCOPE("format", gamedataTemplate.path.native());
+
+            for (const auto& className : gamedataTemplate.referencedClasses)
+            {
+                auto classInfo = classesByName.find(className);
+                if (classInfo == classesByName.end() || offsets.contains(className))
                 {
-                    std::cerr << fmt::format("Error: placeholder in input file {} at line {} is empty", inputFilePath.string(), lineNumber) << std::endl;
-                    return EINVAL;
+                    continue;
                 }
 
-                auto entryTypeEndPos = placeholder.find('.');
-                if (entryTypeEndPos == std::string::npos)
+                if (!formatter)
                 {
-                    std::cerr << fmt::format("Error: incorrect format of placeholder {} (missing \'.\' separator)", placeholder) << std::endl;
-                    return EINVAL;
+                    formatter.emplace(functionTable);
                 }
 
-                auto entryType = placeholder.substr(0, entryTypeEndPos);
-                placeholder = placeholder.substr(entryTypeEndPos + 1, placeholder.size());
+                std::vector<std::string> warnings;
+                auto vtables = formatClassVTables(*formatter, *classInfo->second, warnings);
+                printWarnings(warnings);
+
+                std::unique_lock lock(offsetsMutex);
+                offsets.emplace(className, std::move(vtables));
+            }
+        };
 
-                std::string result;
-                if (entryType == "VTableMethod")
+        // Formats and hands over the files whose classes are all there, up to the first one still waiting.
+        auto advance = [&]
+        {
+            while (!stopped)
+            {
+                if (!pending)
                 {
-                    auto offset = getVTableMethodOffset(offsets, placeholder);
-                    if (!offset.has_value())
+                    pending = templates.next();
+                    if (!pending)
                     {
-                        std::cerr << fmt::format("Error: failed to get vtable offset of placeholder {} from input file {} at line {}", placeholder, inputFilePath.string(), lineNumber) << std::endl;
-                        return EINVAL;
+                        return;
                     }
-                    result = std::to_string(offset.value());
                 }
-                else if (entryType == "VTableField")
+
+                if (!isReady(*pending))
                 {
-                    auto offset = getVTableFieldOffset(memberOffsets, placeholder);
-                    if (!offset.has_value())
+                    return;
+                }
+
+                format(*pending);
+
+                stopped = !formattedTemplates.push(std::move(*pending));
+                pending.reset();
+            }
+        };
+
+        try
+        {
+            advance();
+
+            if (pending)
+            {
+                classes([&](const ClassInfo& classInfo)
+                {
+                    // The first class with a name wins, like in prepareOffsets().
+                    if (!classesByName.try_emplace(classInfo.name, &classInfo).second || stopped || formatError)
+                    {
+                        return;
+                    }
+
+                    if (pending && pending->referencedClasses.contains(classInfo.name))
                     {
-                        std::cerr << fmt::format("Error: failed to get member offset of placeholder {} from input file {} at line {}", placeholder, inputFilePath.string(), lineNumber) << std::endl;
-                        return EINVAL;
+                        // The parse runs to the end whatever happens here, the error is rethrown after it.
+                        try
+                        {
+                            advance();
+                        }
+                        catch (...)
+                        {
+                            formatError = std::current_exception();
+                        }
                     }
-                    result = std::to_string(offset.value());
+                });
+
+                parsed = true;
+                if (!formatError)
+                {
+                    advance();
                 }
-                else
+            }
+        }
+        catch (...)
+        {
+            formatError = std::current_exception();
+        }
+
+        formattedTemplates.close();
+    });
+
+    auto next = [&formattedTemplates] { return formattedTemplates.pop(); };
+
+    auto result = writeGamedataFiles(templates.size(), next, outputDirectoryPaths, options, [&](const GamedataTemplate& gamedataTemplate, std::string& output)
+    {
+        std::shared_lock lock(offsetsMutex);
+        return renderGamedataFile(offsets, memberOffsets, gamedataTemplate, output);
+    });
+
+    // Stops the format stage if the writer gave up early.
+    formattedTemplates.close();
+    formatThread.join();
+
+    if (formatError)
+    {
+        std::rethrow_exception(formatError);
+    }
+
+    return result;
+}
+
+void writeOffsetIndex(const std::filesystem::path& path, const Offsets& offsets, const MemberOffsetIndex& memberOffsets, const FieldNames& referencedFields)
+{
+    TRACE_SCOPE("write offset index");
+
+    struct Key
+    {
+        OffsetIndexKey key;
+        uint64_t hash;
+        int64_t values[2];
+    };
+
+    std::vector<Key> keys;
+    for (const auto& [className, classVTables] : offsets)
+    {
+        for (const auto& [namespaceName, functions] : classVTables)
+        {
+            for (const auto& [functionName, functionOffsets] : functions)
+            {
+                auto key = offsetIndexKey(className, namespaceName, functionName);
+                keys.push_back({key, key.hash(), {functionOffsets.linuxIndex, functionOffsets.windowsIndex}});
+            }
+        }
+    }
+
+    // The first entry wins for duplicated members, like MemberOffsetIndex::find().
+    for (const auto& member : listMemberOffsets(memberOffsets, referencedFields))
+    {
+        if (memberOffsets.find(member.className, member.memberName) == member.offset)
+        {
+            auto key = offsetIndexKey(member.className, member.memberName);
+            keys.push_back({key, key.hash(), {static_cast<int64_t>(member.offset), 0}});
+        }
+    }
+
+    std::ranges::sort(keys, {}, &Key::hash);
+    auto duplicates = std::ranges::unique(keys, [](const Key& a, const Key& b)
+    {
+        return a.hash == b.hash && a.key.kind == b.key.kind && std::ranges::equal(a.key.parts, b.key.parts);
+    });
+    keys.erase(duplicates.begin(), duplicates.end());
+
+    if (keys.size() > UINT32_MAX / 2)
+    {
+        throw std::runtime_error(fmt::format("Failed to write offset index {}: too many entries", path.string()));
+    }
+
+    // Hash and displace: buckets of about 4 keys, the largest placed first, each with the first seed that puts all of
+    // its keys into free slots.
+    auto entryCount = static_cast<uint32_t>(keys.size());
+    auto bucketCount = std::max<uint32_t>(1, (entryCount + 3) / 4);
+
+    std::vector<std::vector<uint32_t>> buckets(bucketCount);
+    for (uint32_t keyIndex = 0; keyIndex < entryCount; ++keyIndex)
+    {
+        buckets[offsetIndexBucket(keys[keyIndex].hash, bucketCount)].push_back(keyIndex);
+    }
+
+    std::vector<uint32_t> bucketOrder(bucketCount);
+    for (uint32_t bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        bucketOrder[bucket] = bucket;
+    }
+    std::ranges::stable_sort(bucketOrder, std::greater<>(), [&buckets](uint32_t bucket) { return buckets[bucket].size(); });
+
+    constexpr uint32_t MAX_SEED = 1 << 24;
+
+    std::vector<uint32_t> seeds(bucketCount);
+    std::vector<uint32_t> slotKeys(entryCount, UINT32_MAX);
+    std::vector<uint32_t> slots;
+    for (auto bucket : bucketOrder)
+    {
+        if (buckets[bucket].empty())
+        {
+            break;
+        }
+
+        uint32_t seed = 0;
+        for (; seed < MAX_SEED; ++seed)
+        {
+            slots.clear();
+            for (auto keyIndex : buckets[bucket])
+            {
+                auto slot = offsetIndexSlot(keys[keyIndex].hash, seed, entryCount);
+                if (slotKeys[slot] != UINT32_MAX || std::ranges::find(slots, slot) != slots.end())
                 {
-                    std::cerr << fmt::format("Error: unknown entryType {} in input file {} at line {}", entryType, inputFilePath.string(), lineNumber) << std::endl;
-                    return EINVAL;
+                    break;
                 }
+                slots.push_back(slot);
+            }
 
-                line.replace(startPos, endPos - startPos + 1, result);
+            if (slots.size() == buckets[bucket].size())
+            {
+                break;
             }
+        }
 
-            outputStream << line << std::endl; // write to os
+        if (seed == MAX_SEED)
+        {
+            throw std::runtime_error(fmt::format("Failed to write offset index {}: no perfect hash found", path.string()));
         }
 
-        if (auto next = std::next(outputDirectoryPathIterator); next != outputDirectoryPaths.end())
+        seeds[bucket] = seed;
+        for (std::size_t i = 0; i < slots.size(); ++i)
         {
-            outputDirectoryPathIterator = next;
+            slotKeys[slots[i]] = buckets[bucket][i];
         }
     }
 
-    return EXIT_SUCCESS;
+    std::vector<OffsetIndexEntry> entries(entryCount);
+    std::string keyBytes;
+    for (uint32_t slot = 0; slot < entryCount; ++slot)
+    {
+        const auto& key = keys[slotKeys[slot]];
+
+        auto& entry = entries[slot];
+        entry.keyOffset = static_cast<uint32_t>(keyBytes.size());
+        entry.keySize = static_cast<uint32_t>(key.key.size());
+        entry.values[0] = key.values[0];
+        entry.values[1] = key.values[1];
+
+        keyBytes += static_cast<char>(key.key.kind);
+        for (std::size_t part = 0; part < key.key.partCount; ++part)
+        {
+            if (part != 0)
+            {
+                keyBytes += '\0';
+            }
+            keyBytes += key.key.parts[part];
+        }
+    }
+
+    if (keyBytes.size() > UINT32_MAX)
+    {
+        throw std::runtime_error(fmt::format("Failed to write offset index {}: too many entries", path.string()));
+    }
+
+    OffsetIndexHeader header{};
+    std::memcpy(header.magic, OFFSET_INDEX_MAGIC, sizeof(header.magic));
+    header.version = OFFSET_INDEX_VERSION;
+    header.entryCount = entryCount;
+    header.bucketCount = bucketCount;
+    header.keysSize = static_cast<uint32_t>(keyBytes.size());
+
+    std::string contents(reinterpret_cast<const char *>(&header), sizeof(header));
+    contents.append(reinterpret_cast<const char *>(seeds.data()), seeds.size() * sizeof(uint32_t));
+    contents.resize((contents.size() + 7) & ~std::size_t{7});
+    contents.append(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(OffsetIndexEntry));
+    contents += keyBytes;
+
+    writeOutputFile(path, contents);
 }
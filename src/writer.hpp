@@ -1,12 +1,118 @@
 #pragma once
 
+#include "parallel.hpp"
 #include "parser.hpp"
 
 #include <filesystem>
+#include <functional>
 #include <list>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
 
+struct FunctionOffsets
+{
+    int linuxIndex;
+    int windowsIndex;
+};
+
+using ClassNamespace = std::map<std::string, FunctionOffsets, std::less<>>;
+using ClassVTables = std::map<std::string, ClassNamespace, std::less<>>;
+using Offsets = std::map<std::string, ClassVTables, std::less<>>;
+
+using ClassNames = std::set<std::string, std::less<>>;
+using FieldNames = std::set<std::pair<std::string, std::string>, std::less<>>; // Class and member
+
+struct WriterOptions
+{
+    bool fanOut{false}; // Write every output file into every output directory
+    bool hardLinks{false}; // Fan-out copies are hard links to the first one
+    unsigned int jobs{0};
+    std::vector<std::filesystem::path> *writtenFiles{}; // Appended with every file written, copies included
+};
+
+// An input file read into memory, with the classes its VTableMethod placeholders and the fields its VTableField ones
+// refer to.
+struct GamedataTemplate
+{
+    std::filesystem::path path;
+    std::vector<std::string> lines;
+    ClassNames referencedClasses;
+    FieldNames referencedFields;
+    int error{0}; // errno of a failed open, reported when the file is rendered
+};
+
+GamedataTemplate readGamedataTemplate(const std::filesystem::path& inputFilePath);
+
+// Reads the input files in order on a background thread, at most READ_AHEAD files ahead of the writer.
+// Created before the library is processed, the files are usually ready by the time offsets are.
+class TemplateReader
+{
+public:
+    static constexpr std::size_t READ_AHEAD = 8;
+
+    explicit TemplateReader(std::vector<std::filesystem::path> inputFilePaths);
+
+    // Hands over files read before, in order.
+    explicit TemplateReader(std::vector<GamedataTemplate> gamedataTemplates);
+    ~TemplateReader();
+
+    TemplateReader(const TemplateReader&) = delete;
+    TemplateReader& operator=(const TemplateReader&) = delete;
+
+    std::size_t size() const { return m_size; }
+
+    // The next file in input order, nothing after the last one.
+    std::optional<GamedataTemplate> next();
+
+private:
+    std::size_t m_size;
+    BoundedQueue<GamedataTemplate> m_templates{READ_AHEAD};
+    std::jthread m_thread;
+};
+
+// Linux and Windows vtable indices by class, namespace and function. The first class or function with a name wins.
+// Classes are formatted on up to `jobs` threads (0 = one per core); the result and the warnings don't depend on it.
+Offsets prepareOffsets(const Out& out, const ClassNames *referencedClasses = nullptr, unsigned int jobs = 0);
+
+// Placeholders without their "VTableMethod."/"VTableField." prefix. Errors are stored in `error` if given, printed to
+// stderr otherwise.
+std::optional<int> getVTableMethodOffset(const Offsets& offsets, std::string_view placeholder, std::string *error = nullptr);
+std::optional<int> getVTableFieldOffset(const MemberOffsetIndex& memberOffsets, std::string_view placeholder, std::string *error = nullptr);
+
+// The .member_offsets entries, then the referenced fields only the debug info has. An image without .member_offsets
+// has nothing else to enumerate, its fields are only found through the templates. Names point into either argument.
+std::vector<MemberOffset> listMemberOffsets(const MemberOffsetIndex& memberOffsets, const FieldNames& referencedFields);
+
+// `memberOffsets` is decoded by the first VTableField placeholder rendered, if there is one.
+int writeGamedataFile(
+    const Offsets& offsets,
+    const LazySection<MemberOffsetIndex>& memberOffsets,
+    TemplateReader& templates,
+    const std::vector<std::filesystem::path>& outputDirectoryPaths,
+    const WriterOptions& options = {});
+
+// Binary index of every method and field of listMemberOffsets() for runtime lookups, see offsetindex.hpp for the reader.
+// Throws std::runtime_error on failure.
+void writeOffsetIndex(const std::filesystem::path& path, const Offsets& offsets, const MemberOffsetIndex& memberOffsets, const FieldNames& referencedFields);
+
+// Calls `onClass` with every class of the library in parse order, on the calling thread, as each one is parsed.
+using ClassSource = std::function<void(const std::function<void(const ClassInfo&)>& onClass)>;
+
+// Pipelined: the input files are read, their classes formatted and the files rendered and written on three threads,
+// with a bounded queue between each. A file is formatted as soon as the classes it refers to are parsed, while the
+// parse goes on; `functionTable` is filled by the same parse. `classes` is only called once a file refers to a class,
+// so the library needn't be parsed for files with VTableField placeholders alone.
+// Exceptions thrown by `classes` or while formatting are rethrown once the files formatted before are written.
 int writeGamedataFile(
-    const std::list<ClassInfo>& classes,
-    const std::vector<MemberOffset>& memberOffsets,
-    const std::vector<std::filesystem::path>& inputFilePaths,
-    const std::vector<std::filesystem::path>& outputDirectoryPaths);
+    const ClassSource& classes,
+    const FunctionTable& functionTable,
+    const LazySection<MemberOffsetIndex>& memberOffsets,
+    TemplateReader& templates,
+    const std::vector<std::filesystem::path>& outputDirectoryPaths,
+    const WriterOptions& options = {});